@@ -0,0 +1,112 @@
+#include "bus.h"
+
+#include <chrono>
+#include <iomanip>
+
+using namespace std;
+
+const int clocksPerFrame = 341 * 262;
+
+const int engineCount = 3;
+const CPU6502::executionEngine engines[engineCount] = { CPU6502::Interpret, CPU6502::CachedInterpret, CPU6502::Recompile };
+const char* engineNames[engineCount] = { "interpret: ", "cached:    ", "recompile: " };
+
+// Runs the cartridge for a number of frames and returns the time it took in
+// seconds, or a negative time when the ROM can't be loaded
+double runFrames(Bus& bus, CPU6502::executionEngine engine, bool idleSkip, int frames, uint32_t& screenHash){
+	if(!bus.loadCartridge()){
+		return -1;
+	}
+
+	bus.reset();
+	bus.cpu.engine = engine;
+	bus.cpu.idleSkip = idleSkip;
+
+	// Bus::reset keeps ram, start every engine from the same state
+	for(int i = 0; i < 2048; i++){
+		bus.ram()[i] = 0;
+	}
+
+	auto start = chrono::steady_clock::now();
+
+	for(int i = 0; i < frames * clocksPerFrame; i++){
+		bus.clock();
+	}
+
+	auto end = chrono::steady_clock::now();
+
+	// FNV-1a over the last frame so diverging engines are easy to spot. Native
+	// blocks run a few cycles ahead of the ppu, ram can differ at the last dot.
+	screenHash = 2166136261u;
+	for(int i = 0; i < windowWidth * windowHeight; i++){
+		screenHash = (screenHash ^ bus.ppu.screen[i]) * 16777619u;
+	}
+
+	return chrono::duration<double>(end - start).count();
+}
+
+// Best of a few interleaved runs per engine, so a busy moment on the machine
+// doesn't land on one engine only
+bool runEngines(Bus& bus, bool idleSkip, int frames, int repeats){
+	double best[engineCount] = {};
+	uint32_t hashes[engineCount] = {};
+
+	for(int repeat = 0; repeat < repeats; repeat++){
+		for(int engine = 0; engine < engineCount; engine++){
+			double time = runFrames(bus, engines[engine], idleSkip, frames, hashes[engine]);
+			if(time < 0){
+				return false;
+			}
+
+			if(repeat == 0 || time < best[engine]){
+				best[engine] = time;
+			}
+		}
+	}
+
+	cout << frames << " frames, " << (idleSkip ? "idle loops skipped" : "every instruction run") << ", best of " << repeats << endl;
+
+	for(int engine = 0; engine < engineCount; engine++){
+		cout << engineNames[engine] << best[engine] << "s screen " << hex << hashes[engine] << dec;
+
+		if(engines[engine] == CPU6502::Recompile && !JIT6502::available()){
+			cout << " (no JIT on this platform, interpreted)";
+		}
+
+		cout << endl;
+	}
+
+	cout << "speedup: cached " << best[0] / best[1] << "x, recompile " << best[0] / best[2] << "x" << endl;
+	return true;
+}
+
+int main(int argc, char* argv[]){
+	int frames = 600;
+	if(argc > 1){
+		frames = atoi(argv[1]);
+	}
+
+	int repeats = 3;
+	if(argc > 2){
+		repeats = max(1, atoi(argv[2]));
+	}
+
+	// Headless, so only emulation is timed and not presenting
+	Bus bus(true);
+
+	cout << fixed << setprecision(3);
+
+	// Games spend most of a frame waiting for vblank, which idle skip runs
+	// without the cpu. Without it every engine runs every instruction.
+	if(!runEngines(bus, true, frames, repeats)){
+		cerr << "can't load the ROM" << endl;
+		runProgram = false;
+		return 1;
+	}
+
+	cout << endl;
+	runEngines(bus, false, frames, repeats);
+
+	runProgram = false;
+	return 0;
+}
@@ -1,17 +1,30 @@
 #include "bus.h"
+#include "state.h"
 #include <fstream>
+#include <cstring>
 #include <iostream>
 #include <iomanip> 
+#include <iterator>
 
 using namespace std;
 
-Bus::Bus(){
+Bus::Bus(bool headless) : ppu(headless){
 	cpu.connectBus(this);
+	debugger.connectBus(this);
+	cheats.connectBus(this);
+
+	memset(traps, 0, sizeof(traps));
+	mapPages();
+
+	if(!headless)
+		windowInput.store(&input, memory_order_release);
 }
 
 void Bus::reset(){
 	cpu.reset();
 	ppu.reset();
+	inputFrame = ppu.frame;
+	nesClockCount = 0;
 	dmaPage = 0x0;
 	dmaAddr = 0x0;
 	dmaData = 0x0;
@@ -19,92 +32,300 @@ void Bus::reset(){
 	dmaData = false;
 }
 
-void Bus::writeCartridge(uint16_t address, uint8_t value){
-	cartridge[address] = value;
+void Bus::measureLatency(LatencyMonitor* monitor){
+	latency = monitor;
+
+	if(!ppu.headless)
+		windowLatency.store(monitor, memory_order_release);
 }
 
 void Bus::loadPpuRom(){
-	for(int i = 16384; i < 24576; i++){
-		ppu.ppuWrite(i - 16384, cartridge[i]);
+	for(int i = 0; i < 8192; i++){
+		ppu.ppuWrite(i, chrRom[i]);
 	}
 };
 
-void Bus::loadCartridge(){
-	std::ifstream myfile("donkey kong.nes");
-	char c;
-	for(int i = 0; i < 16; i++){
-		myfile.get(c);
-	}
-
-	for(int i = 0; i < 24576; i++){
-		myfile.get(c);
-		writeCartridge(i, c);
+bool Bus::loadCartridge(const char* path){
+	std::ifstream file(path, std::ios::binary);
+	if(!file.is_open()){
+		return false;
 	}
 
-	myfile.close();
-
-	loadPpuRom();
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return loadCartridge(data.data(), data.size());
 }
 
-uint8_t Bus::cpuRead(uint16_t address){
-	if(0 <= address && address <= 0x1FFF){
-		return cpuRam[address & 0x7FF];
+bool Bus::loadCartridge(const uint8_t* data, size_t size){
+	if(size < 16){
+		return false;
 	}
-	
-	if(0x2000 <= address && address <= 0x3FFF){
-		return ppu.cpuRead(address & 0x7);
+
+	const uint8_t* header = data;
+	if(header[0] != 'N' || header[1] != 'E' || header[2] != 'S' || header[3] != 0x1A){
+		return false;
 	}
 
-	if(address == 0x4016 || address == 0x4017){
-		uint8_t data = (controllerState[address & 0x1] & 0x80) > 0;
-		controllerState[address & 0x1] <<= 1;
-		return data;
+	uint8_t prgBanks = header[4]; 	// 16K units
+	uint8_t chrBanks = header[5]; 	// 8K units, none means CHR RAM
+	uint8_t mapper = (header[7] & 0xF0) | (header[6] >> 4);
+
+	if(mapper != 0 || prgBanks < 1 || prgBanks > 2 || chrBanks > 1){
+		return false;
 	}
 
-	if( 0x8000 <= address && address <= 0xBFFF){
-		return cartridge[address - 0x8000];		
+	size_t offset = 16;
+
+	// Trainer
+	if(header[6] & 0x04){
+		offset += 512;
 	}
 
-	if( 0xC000 <= address && address <= 0xFFFF){
-		return cartridge[address - 0xC000];		
+	if(size < offset + prgBanks * 16384 + chrBanks * 8192){
+		return false;
 	}
 
-	return 0x0;
-};
+	memset(chrRom, 0, sizeof(chrRom));
+	memcpy(prgRom, data + offset, prgBanks * 16384);
+	memcpy(chrRom, data + offset + prgBanks * 16384, chrBanks * 8192);
 
-void Bus::cpuWrite(uint16_t address, uint8_t value){
-	if( 0 <= address && address <= 0x1FFF){
-		cpuRam[address & 0x7FF] = value;
-	}
+	prgMask = prgBanks == 2 ? 0x7FFF : 0x3FFF;
+	mapPages();
 
-	if(0x2000 <= address && address <= 0x3FFF){
-		ppu.cpuWrite(address & 0x7, value);
+	if(header[6] & 0x08){
+		ppu.setMirroring(PPU2C02::FourScreen);
+	} else if(header[6] & 0x01){
+		ppu.setMirroring(PPU2C02::Vertical);
+	} else {
+		ppu.setMirroring(PPU2C02::Horizontal);
 	}
+	memset(prgRam, 0, sizeof(prgRam));
+
+	cpu.codeCache.flush();
+	loadPpuRom();
+	return true;
+}
+
+// Bumped whenever a component changes what it saves
+static const uint32_t stateVersion = 1;
+
+vector<uint8_t> Bus::saveState(){
+	StateWriter state;
+
+	state.write("NESSTATE", 8);
+	state.put(stateVersion);
+
+	state.write(cpuRam, sizeof(cpuRam));
+	state.write(prgRam, sizeof(prgRam));
+	state.write(controllerState, sizeof(controllerState));
+	state.write(controllers, sizeof(controllers));
+	state.put(nesClockCount);
+	state.put(cycle);
+	state.put(prgBank);
+	state.put(inputFrame);
 
-	if(address == 0x4014){
-		dmaPage = value;
-		dmaAddr = 0x00;
-		dmaTransfer = true;
+	state.put(dmaPage);
+	state.put(dmaAddr);
+	state.put(dmaData);
+	state.put(dmaDummy);
+	state.put(dmaTransfer);
+
+	cpu.saveState(state);
+	ppu.saveState(state);
+
+	return state.data;
+}
+
+bool Bus::loadState(const uint8_t* data, size_t size){
+	StateReader state(data, size);
+
+	char magic[8];
+	uint32_t version;
+	state.read(magic, 8);
+	state.get(version);
+
+	if(state.failed || memcmp(magic, "NESSTATE", 8) != 0 || version != stateVersion){
+		return false;
 	}
 
-	if(address == 0x4016 || address == 0x4017){
-		// TODO: Fixed value for now
-		controllerState[address & 0x1] = controller;
+	state.read(cpuRam, sizeof(cpuRam));
+	state.read(prgRam, sizeof(prgRam));
+	state.read(controllerState, sizeof(controllerState));
+	state.read(controllers, sizeof(controllers));
+	state.get(nesClockCount);
+	state.get(cycle);
+	state.get(prgBank);
+	state.get(inputFrame);
+
+	state.get(dmaPage);
+	state.get(dmaAddr);
+	state.get(dmaData);
+	state.get(dmaDummy);
+	state.get(dmaTransfer);
+
+	cpu.loadState(state);
+	ppu.loadState(state);
+
+	// Banks may have moved, and the code cache was dropped with the old ram
+	mapPages();
+
+	return !state.failed && state.atEnd();
+}
+
+void Bus::mapPages(){
+	for(int page = 0; page < 256; page++){
+		uint16_t address = page << 8;
+
+		if(address < 0x2000){
+			pageKinds[page] = RamPage;
+			pages[page] = cpuRam + (address & 0x7FF);
+		} else if(address < 0x4000){
+			pageKinds[page] = PpuPage;
+			pages[page] = nullptr;
+		} else if(address < 0x4100){
+			pageKinds[page] = IoPage;
+			pages[page] = nullptr;
+		} else if(address < 0x6000){
+			pageKinds[page] = OpenPage;
+			pages[page] = nullptr;
+		} else if(address < 0x8000){
+			pageKinds[page] = PrgRamPage;
+			pages[page] = prgRam + (address & 0x1FFF);
+		} else {
+			pageKinds[page] = PrgRomPage;
+			pages[page] = prgRom + (address & prgMask);
+		}
+
+		mapPage(page);
 	}
 
-	if( 0x8000 <= address && address <= 0xBFFF){
-		cartridge[address - 0x8000] = value;		
+	cheats.remap();
+}
+
+void Bus::patchPage(uint8_t page, uint8_t* copy){
+	pages[page] = copy != nullptr ? copy : prgRom + ((page << 8) & prgMask);
+	mapPage(page);
+	cpu.codeCache.invalidate(page << 8);
+}
+
+void Bus::mapPage(uint8_t page){
+	uint8_t* memory = pages[page];
+
+	readMap[page] = (traps[page] & ReadTrap) ? nullptr : memory;
+	fetchMap[page] = (traps[page] & ExecuteTrap) ? nullptr : memory;
+
+	bool direct = !(traps[page] & WriteTrap) && !CodeCache::isCodeAddress(page << 8);
+	writeMap[page] = direct ? memory : nullptr;
+}
+
+uint8_t Bus::readHandler(uint16_t address){
+	uint8_t page = address >> 8;
+	uint8_t value = 0x0;
+
+	switch(pageKinds[page]){
+		case PpuPage:
+			value = ppu.cpuRead(address & 0x7);
+			break;
+
+		case IoPage:
+			if(address == 0x4016 || address == 0x4017){
+				value = (controllerState[address & 0x1] & 0x80) > 0;
+				controllerState[address & 0x1] <<= 1;
+			}
+			break;
+
+		case OpenPage:
+			break;
+
+		default:
+			value = pages[page][address & 0xFF];
+			break;
 	}
 
-	if( 0xC000 <= address && address <= 0xFFFF){
-		cartridge[address - 0xC000] = value;		
+	if(traps[page] & ReadTrap)
+		debugger.checkRead(address, value);
+
+	return value;
+}
+
+void Bus::writeHandler(uint16_t address, uint8_t value){
+	uint8_t page = address >> 8;
+
+	switch(pageKinds[page]){
+		case RamPage:
+			pages[page][address & 0xFF] = value;
+			cpu.codeCache.invalidate(address);
+			break;
+
+		// Patched pages read from a copy, the write still goes to rom
+		case PrgRomPage:
+			prgRom[address & prgMask] = value;
+			cheats.romWritten(address);
+			cpu.codeCache.invalidate(address);
+			break;
+
+		case PrgRamPage:
+			pages[page][address & 0xFF] = value;
+			break;
+
+		case PpuPage:
+			ppu.cpuWrite(address & 0x7, value);
+			break;
+
+		case IoPage:
+			if(address == 0x4014){
+				dmaPage = value;
+				dmaAddr = 0x00;
+				dmaTransfer = true;
+			}
+
+			// Both ports latch on the strobe, $4017 writes belong to the APU
+			if(address == 0x4016){
+				if(drainInput == AtStrobe && (value & 0x1)){
+					uint64_t time = input.drain(ppu.frame, controllers);
+
+					if(latency != nullptr && time != 0)
+						latency->inputApplied(time);
+				}
+
+				controllerState[0] = controllers[0];
+				controllerState[1] = controllers[1];
+
+				if(latency != nullptr && (value & 0x1))
+					latency->latched(ppu.frame);
+			}
+			break;
 	}
-};
+
+	if(traps[page] & WriteTrap)
+		debugger.checkWrite(address, value);
+}
 
 #include <iostream>
 
 void Bus::clock(){
+	// A cpu polling $2002 only needs to run again once the status can change
+	if(cpu.idle && cpu.idleReadsStatus && ppu.atStatusEvent()){
+		cpu.wake();
+	}
+
 	ppu.clock();
+
+	if(ppu.frame != inputFrame){
+		inputFrame = ppu.frame;
+
+		if(latency != nullptr)
+			latency->frameDone(ppu.frame);
+
+		// Frozen ram is put back as vblank ends, once per frame
+		cheats.applyFreezes();
+
+		if(drainInput == AtFrameStart){
+			uint64_t time = input.drain(inputFrame, controllers);
+
+			if(latency != nullptr && time != 0)
+				latency->inputApplied(time);
+		}
+	}
 				
 	if(nesClockCount % 3 == 0){
 		if(dmaTransfer){
@@ -1,21 +1,54 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 #include "cpu6502.h"
 #include "ppu2C02.h"
+#include "input.h"
+#include "latency.h"
+#include "debugger.h"
+#include "cheats.h"
 
 class Bus{
-	uint8_t cartridge[24576];
+	uint8_t prgRom[32768];
+	uint8_t chrRom[8192];
+	uint16_t prgMask = 0x3FFF; 	// 16K PRG is mirrored at $C000
+	uint8_t prgRam[8192]; 		// $6000-$7FFF, also where test ROMs report results
 	uint8_t cpuRam[2048];
 	uint8_t controllerState[2];
 	uint8_t nesClockCount = 0;
+
+	// Frame input was last drained for
+	uint32_t inputFrame = 0;
+
+	enum pageKind{
+		RamPage = 0,
+		PpuPage = 1, 		// $2000-$3FFF
+		IoPage = 2, 		// $4000-$40FF
+		OpenPage = 3, 		// nothing mapped
+		PrgRamPage = 4,
+		PrgRomPage = 5
+	};
+
+	// Memory behind each page, null for registers and open bus
+	uint8_t* pages[256];
+	uint8_t pageKinds[256];
+
+	uint8_t readHandler(uint16_t address);
+	void writeHandler(uint16_t address, uint8_t value);
 public:
-	Bus();
+	// A headless bus renders into its own buffer and opens no window
+	Bus(bool headless = false);
 
 	void reset();
 
 	uint16_t cycle = 0;
 	CPU6502 cpu;
+
+	// PRG bank mapped at $8000. NROM never switches it, a mapper that does
+	// updates it for the CPU code cache to pick the right blocks and calls
+	// mapPages.
+	uint8_t prgBank = 0;
 	PPU2C02 ppu;
 
 	uint8_t dmaPage = 0x0;
@@ -25,12 +58,102 @@ public:
 	bool dmaDummy = true;
 	bool dmaTransfer = false;
 
-	void writeCartridge(uint16_t address, uint8_t value);
+	// Controller input. A windowed bus gets the keyboard through windowInput,
+	// frontends push into input from one thread of their own or set
+	// controllers directly on the emulation thread.
+	enum inputDrain{
+		AtFrameStart = 0, 	// when the ppu starts a frame
+		AtStrobe = 1 		// when the game strobes $4016
+	};
+
+	InputQueue input;
+	inputDrain drainInput = AtFrameStart;
+	uint8_t controllers[2] = { 0, 0 }; 	// buttons held on each port
+
+	// Input to photon latency, off while null. The window presenting a
+	// windowed bus reports its presents too.
+	LatencyMonitor* latency = nullptr;
+	void measureLatency(LatencyMonitor* monitor);
+
 	void loadPpuRom();
-	void loadCartridge();
 
-	uint8_t cpuRead(uint16_t address);
-	void cpuWrite(uint16_t address, uint8_t value);
+	// iNES file with mapper 0, false when it can't be read or uses another mapper
+	bool loadCartridge(const char* path = "donkey kong.nes");
+	bool loadCartridge(const uint8_t* data, size_t size);
+
+	// Whole machine between two clock calls, for a bus with the same
+	// cartridge. loadState is false for a truncated state or one of another
+	// version, which may leave the machine half loaded.
+	std::vector<uint8_t> saveState();
+	bool loadState(const uint8_t* data, size_t size);
+
+	uint8_t* ram(){ return cpuRam; }
+	uint8_t* sram(){ return prgRam; }
+
+	// CPU memory map in 256 byte pages. cpuRead, cpuWrite and the cpu's
+	// instruction fetches go through the page's pointer, a null page goes to
+	// the handlers instead: register pages, pages the debugger traps and for
+	// writes every page code can be decoded from, since those writes
+	// invalidate the code cache.
+	enum pageTrap{
+		ReadTrap = 0x1,
+		WriteTrap = 0x2,
+		ExecuteTrap = 0x4
+	};
+
+	uint8_t* readMap[256];
+	uint8_t* writeMap[256];
+	uint8_t* fetchMap[256];
+	uint8_t traps[256];
+
+	void mapPages();
+	void mapPage(uint8_t page);
+
+	// Execution breakpoints and memory watchpoints, set through it
+	Debugger debugger;
+
+	// Rom patches and ram freezes
+	Cheats cheats;
+
+	// Points a rom page at a patched copy, null maps the rom back
+	void patchPage(uint8_t page, uint8_t* copy);
+	const uint8_t* romPage(uint8_t page){ return prgRom + ((page << 8) & prgMask); }
+
+	uint8_t cpuRead(uint16_t address){
+		uint8_t* page = readMap[address >> 8];
+		if(page != nullptr)
+			return page[address & 0xFF];
+
+		return readHandler(address);
+	}
+
+	void cpuWrite(uint16_t address, uint8_t value){
+		uint8_t* page = writeMap[address >> 8];
+		if(page != nullptr){
+			page[address & 0xFF] = value;
+			return;
+		}
+
+		writeHandler(address, value);
+	}
+
+	// Instruction bytes, read watchpoints don't see them
+	uint8_t fetch(uint16_t address){
+		uint8_t* page = fetchMap[address >> 8];
+		if(page == nullptr)
+			page = pages[address >> 8];
+
+		if(page != nullptr)
+			return page[address & 0xFF];
+
+		return cpuRead(address);
+	}
+
+	// Memory without side effects or traps, 0 for registers and open bus
+	uint8_t peek(uint16_t address){
+		uint8_t* page = pages[address >> 8];
+		return page != nullptr ? page[address & 0xFF] : 0;
+	}
 
 	void clock();
 };
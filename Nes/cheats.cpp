@@ -0,0 +1,191 @@
+#include "cheats.h"
+#include "bus.h"
+
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+bool Cheats::decode(const string& code, uint16_t& address, uint8_t& value, int& compare){
+	static const char letters[] = "APZLGITYEOXUKSVN";
+
+	if(code.size() != 6 && code.size() != 8)
+		return false;
+
+	int n[8];
+	for(size_t i = 0; i < code.size(); i++){
+		char letter = (char)toupper((unsigned char)code[i]);
+		const char* found = letter != 0 ? strchr(letters, letter) : nullptr;
+
+		if(found == nullptr)
+			return false;
+
+		n[i] = (int)(found - letters);
+	}
+
+	// Each letter is 4 bits, scrambled over the address and the bytes
+	address = 0x8000
+		| ((n[3] & 7) << 12)
+		| ((n[5] & 7) << 8) | ((n[4] & 8) << 8)
+		| ((n[2] & 7) << 4) | ((n[1] & 8) << 4)
+		| (n[4] & 7) | (n[3] & 8);
+
+	value = ((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7);
+
+	if(code.size() == 6){
+		value |= n[5] & 8;
+		compare = -1;
+	} else {
+		value |= n[7] & 8;
+		compare = ((n[7] & 7) << 4) | ((n[6] & 8) << 4) | (n[6] & 7) | (n[5] & 8);
+	}
+
+	return true;
+}
+
+bool Cheats::addGameGenie(const string& code){
+	uint16_t address;
+	uint8_t value;
+	int compare;
+
+	if(!decode(code, address, value, compare))
+		return false;
+
+	return addPatch(address, value, compare);
+}
+
+bool Cheats::addPatch(uint16_t address, uint8_t value, int compare){
+	if(address < 0x8000)
+		return false;
+
+	removePatch(address);
+	patches.push_back({ address, value, compare });
+	patchPage(address >> 8);
+	return true;
+}
+
+void Cheats::removePatch(uint16_t address){
+	bool removed = false;
+
+	for(size_t i = 0; i < patches.size(); ){
+		if(patches[i].address == address){
+			patches.erase(patches.begin() + i);
+			removed = true;
+		} else {
+			i++;
+		}
+	}
+
+	if(removed)
+		patchPage(address >> 8);
+}
+
+bool Cheats::freeze(uint16_t address, uint8_t value){
+	if(address < 0x2000){
+		address &= 0x7FF;
+	} else if(address < 0x6000 || address > 0x7FFF){
+		return false;
+	}
+
+	for(Freeze& frozen : freezes){
+		if(frozen.address == address){
+			frozen.value = value;
+			return true;
+		}
+	}
+
+	freezes.push_back({ address, value });
+	return true;
+}
+
+void Cheats::unfreeze(uint16_t address){
+	if(address < 0x2000)
+		address &= 0x7FF;
+
+	for(size_t i = 0; i < freezes.size(); i++){
+		if(freezes[i].address == address){
+			freezes.erase(freezes.begin() + i);
+			return;
+		}
+	}
+}
+
+void Cheats::clear(){
+	patches.clear();
+	freezes.clear();
+
+	for(int page = 0; page < 256; page++){
+		if(!copies[page].empty())
+			patchPage(page);
+	}
+}
+
+// Rebuilds the copy of a rom page from rom and its patches
+void Cheats::patchPage(uint8_t page){
+	vector<uint8_t>& copy = copies[page];
+	const uint8_t* rom = bus->romPage(page);
+	bool patched = false;
+
+	for(const Patch& patch : patches){
+		if((patch.address >> 8) != page)
+			continue;
+
+		if(patch.compare >= 0 && rom[patch.address & 0xFF] != patch.compare)
+			continue;
+
+		if(!patched){
+			copy.assign(rom, rom + 256);
+			patched = true;
+		}
+
+		copy[patch.address & 0xFF] = patch.value;
+	}
+
+	if(!patched)
+		copy.clear();
+
+	bus->patchPage(page, patched ? copy.data() : nullptr);
+}
+
+void Cheats::applyFreezes(){
+	bool changed = false;
+
+	for(const Freeze& frozen : freezes){
+		uint8_t* memory = frozen.address < 0x2000 ? bus->ram() + frozen.address : bus->sram() + (frozen.address & 0x1FFF);
+
+		if(*memory == frozen.value)
+			continue;
+
+		*memory = frozen.value;
+		changed = true;
+
+		if(frozen.address < 0x2000)
+			bus->cpu.codeCache.invalidate(frozen.address);
+	}
+
+	// A skipped spin loop may be waiting on one of them
+	if(changed)
+		bus->cpu.wake();
+}
+
+void Cheats::remap(){
+	for(const Patch& patch : patches){
+		patchPage(patch.address >> 8);
+	}
+}
+
+void Cheats::romWritten(uint16_t address){
+	if(patches.empty())
+		return;
+
+	// Mirrored rom shows up in more than one page. A patch whose compare
+	// stopped matching has no copy, it may match again after this write.
+	const uint8_t* written = bus->romPage(address >> 8);
+
+	for(const Patch& patch : patches){
+		uint8_t page = patch.address >> 8;
+
+		if(bus->romPage(page) == written)
+			patchPage(page);
+	}
+}
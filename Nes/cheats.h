@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Bus;
+
+// Game Genie style rom patches and ram freezes, built into the bus memory map
+// instead of checked on accesses. A patched rom page is read from a copy with
+// the patches applied, so patched and unpatched pages cost the same. Frozen
+// addresses get their values back once per frame, as the ppu finishes
+// vblank.
+class Cheats{
+	struct Patch{
+		uint16_t address;
+		uint8_t value;
+		int compare; 		// rom byte the patch applies over, -1 for any
+	};
+
+	struct Freeze{
+		uint16_t address;
+		uint8_t value;
+	};
+
+	Bus *bus = nullptr;
+
+	std::vector<Patch> patches;
+	std::vector<Freeze> freezes;
+
+	// Patched copies of rom pages, empty for pages read straight from rom
+	std::vector<uint8_t> copies[256];
+
+	void patchPage(uint8_t page);
+public:
+	void connectBus(Bus* b){ bus = b; }
+
+	// Six or eight letter NES Game Genie code, false for a malformed one
+	static bool decode(const std::string& code, uint16_t& address, uint8_t& value, int& compare);
+
+	bool addGameGenie(const std::string& code);
+
+	// Rom addresses only ($8000-$FFFF), ram is frozen instead
+	bool addPatch(uint16_t address, uint8_t value, int compare = -1);
+	void removePatch(uint16_t address);
+
+	// Ram ($0000-$1FFF, mirrors included) or SRAM ($6000-$7FFF)
+	bool freeze(uint16_t address, uint8_t value);
+	void unfreeze(uint16_t address);
+
+	void clear();
+
+	bool active(){ return !patches.empty() || !freezes.empty(); }
+
+	// Bus side: once per frame, after remapping rom and after a rom write
+	void applyFreezes();
+	void remap();
+	void romWritten(uint16_t address);
+};
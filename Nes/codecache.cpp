@@ -0,0 +1,532 @@
+#include "codecache.h"
+#include "cpu6502.h"
+#include "bus.h"
+
+#include <cstring>
+
+using namespace std;
+
+// Addressing mode, base cycles, flags and cached interpreter handler of every
+// opcode, matching CPU6502::executeInstruction. Opcodes without a case there
+// (and the SHX/SHY oddities that fetch their operand differently) stay uncached.
+const CodeCache::OpcodeInfo CodeCache::opcodes[256] = {
+	{CPU6502::Implied,         7, Valid | EndsBlock, &CPU6502::decodedBrk},              // 0x00 BRK
+	{CPU6502::IndexedIndirect, 6, Valid | Reads, &CPU6502::decodedOra},                  // 0x01 ORA
+	{0,                        0, 0, nullptr},                                           // 0x02 ---
+	{0,                        0, 0, nullptr},                                           // 0x03 ---
+	{CPU6502::ZeroPage,        3, Valid, &CPU6502::decodedNop},                          // 0x04 NOP
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedOra},                  // 0x05 ORA
+	{CPU6502::ZeroPage,        5, Valid | Reads | Writes, &CPU6502::decodedAsl},         // 0x06 ASL
+	{0,                        0, 0, nullptr},                                           // 0x07 ---
+	{CPU6502::Implied,         3, Valid, &CPU6502::decodedPhp},                          // 0x08 PHP
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedOra},                          // 0x09 ORA
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedAsl},                          // 0x0A ASL
+	{0,                        0, 0, nullptr},                                           // 0x0B ---
+	{CPU6502::Absolute,        4, Valid, &CPU6502::decodedNop},                          // 0x0C NOP
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedOra},                  // 0x0D ORA
+	{CPU6502::Absolute,        6, Valid | Reads | Writes, &CPU6502::decodedAsl},         // 0x0E ASL
+	{0,                        0, 0, nullptr},                                           // 0x0F ---
+	{CPU6502::Relative,        2, Valid | Branch, &CPU6502::decodedBpl},                 // 0x10 BPL
+	{CPU6502::IndirectIndexed, 5, Valid | Reads | PageCross, &CPU6502::decodedOra},      // 0x11 ORA
+	{0,                        0, 0, nullptr},                                           // 0x12 ---
+	{0,                        0, 0, nullptr},                                           // 0x13 ---
+	{CPU6502::ZeroPageX,       4, Valid, &CPU6502::decodedNop},                          // 0x14 NOP
+	{CPU6502::ZeroPageX,       4, Valid | Reads, &CPU6502::decodedOra},                  // 0x15 ORA
+	{CPU6502::ZeroPageX,       6, Valid | Reads | Writes, &CPU6502::decodedAsl},         // 0x16 ASL
+	{0,                        0, 0, nullptr},                                           // 0x17 ---
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedClc},                          // 0x18 CLC
+	{CPU6502::AbsoluteY,       4, Valid | Reads | PageCross, &CPU6502::decodedOra},      // 0x19 ORA
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedNop},                          // 0x1A NOP
+	{0,                        0, 0, nullptr},                                           // 0x1B ---
+	{CPU6502::AbsoluteX,       4, Valid | PageCross, &CPU6502::decodedNop},              // 0x1C NOP
+	{CPU6502::AbsoluteX,       4, Valid | Reads | PageCross, &CPU6502::decodedOra},      // 0x1D ORA
+	{CPU6502::AbsoluteX,       7, Valid | Reads | Writes, &CPU6502::decodedAsl},         // 0x1E ASL
+	{0,                        0, 0, nullptr},                                           // 0x1F ---
+	{CPU6502::Absolute,        6, Valid | EndsBlock, &CPU6502::decodedJsr},              // 0x20 JSR
+	{CPU6502::IndexedIndirect, 6, Valid | Reads, &CPU6502::decodedAnd},                  // 0x21 AND
+	{0,                        0, 0, nullptr},                                           // 0x22 ---
+	{0,                        0, 0, nullptr},                                           // 0x23 ---
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedBit},                  // 0x24 BIT
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedAnd},                  // 0x25 AND
+	{CPU6502::ZeroPage,        5, Valid | Reads | Writes, &CPU6502::decodedRol},         // 0x26 ROL
+	{0,                        0, 0, nullptr},                                           // 0x27 ---
+	{CPU6502::Implied,         4, Valid, &CPU6502::decodedPlp},                          // 0x28 PLP
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedAnd},                          // 0x29 AND
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedRol},                          // 0x2A ROL
+	{0,                        0, 0, nullptr},                                           // 0x2B ---
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedBit},                  // 0x2C BIT
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedAnd},                  // 0x2D AND
+	{CPU6502::Absolute,        6, Valid | Reads | Writes, &CPU6502::decodedRol},         // 0x2E ROL
+	{0,                        0, 0, nullptr},                                           // 0x2F ---
+	{CPU6502::Relative,        2, Valid | Branch, &CPU6502::decodedBmi},                 // 0x30 BMI
+	{CPU6502::IndirectIndexed, 5, Valid | Reads | PageCross, &CPU6502::decodedAnd},      // 0x31 AND
+	{0,                        0, 0, nullptr},                                           // 0x32 ---
+	{0,                        0, 0, nullptr},                                           // 0x33 ---
+	{CPU6502::ZeroPageX,       4, Valid, &CPU6502::decodedNop},                          // 0x34 NOP
+	{CPU6502::ZeroPageX,       4, Valid | Reads, &CPU6502::decodedAnd},                  // 0x35 AND
+	{CPU6502::ZeroPageX,       6, Valid | Reads | Writes, &CPU6502::decodedRol},         // 0x36 ROL
+	{0,                        0, 0, nullptr},                                           // 0x37 ---
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedSec},                          // 0x38 SEC
+	{CPU6502::AbsoluteY,       4, Valid | Reads | PageCross, &CPU6502::decodedAnd},      // 0x39 AND
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedNop},                          // 0x3A NOP
+	{0,                        0, 0, nullptr},                                           // 0x3B ---
+	{CPU6502::AbsoluteX,       4, Valid | PageCross, &CPU6502::decodedNop},              // 0x3C NOP
+	{CPU6502::AbsoluteX,       4, Valid | Reads | PageCross, &CPU6502::decodedAnd},      // 0x3D AND
+	{CPU6502::AbsoluteX,       7, Valid | Reads | Writes, &CPU6502::decodedRol},         // 0x3E ROL
+	{0,                        0, 0, nullptr},                                           // 0x3F ---
+	{CPU6502::Implied,         6, Valid | EndsBlock, &CPU6502::decodedRti},              // 0x40 RTI
+	{CPU6502::IndexedIndirect, 6, Valid | Reads, &CPU6502::decodedEor},                  // 0x41 EOR
+	{0,                        0, 0, nullptr},                                           // 0x42 ---
+	{0,                        0, 0, nullptr},                                           // 0x43 ---
+	{CPU6502::ZeroPage,        3, Valid, &CPU6502::decodedNop},                          // 0x44 NOP
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedEor},                  // 0x45 EOR
+	{CPU6502::ZeroPage,        5, Valid | Reads | Writes, &CPU6502::decodedLsr},         // 0x46 LSR
+	{0,                        0, 0, nullptr},                                           // 0x47 ---
+	{CPU6502::Implied,         3, Valid, &CPU6502::decodedPha},                          // 0x48 PHA
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedEor},                          // 0x49 EOR
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedLsr},                          // 0x4A LSR
+	{0,                        0, 0, nullptr},                                           // 0x4B ---
+	{CPU6502::Absolute,        3, Valid | EndsBlock, &CPU6502::decodedJmp},              // 0x4C JMP
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedEor},                  // 0x4D EOR
+	{CPU6502::Absolute,        6, Valid | Reads | Writes, &CPU6502::decodedLsr},         // 0x4E LSR
+	{0,                        0, 0, nullptr},                                           // 0x4F ---
+	{CPU6502::Relative,        2, Valid | Branch, &CPU6502::decodedBvc},                 // 0x50 BVC
+	{CPU6502::IndirectIndexed, 5, Valid | Reads | PageCross, &CPU6502::decodedEor},      // 0x51 EOR
+	{0,                        0, 0, nullptr},                                           // 0x52 ---
+	{0,                        0, 0, nullptr},                                           // 0x53 ---
+	{CPU6502::ZeroPageX,       4, Valid, &CPU6502::decodedNop},                          // 0x54 NOP
+	{CPU6502::ZeroPageX,       4, Valid | Reads, &CPU6502::decodedEor},                  // 0x55 EOR
+	{CPU6502::ZeroPageX,       6, Valid | Reads | Writes, &CPU6502::decodedLsr},         // 0x56 LSR
+	{0,                        0, 0, nullptr},                                           // 0x57 ---
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedCli},                          // 0x58 CLI
+	{CPU6502::AbsoluteY,       4, Valid | Reads | PageCross, &CPU6502::decodedEor},      // 0x59 EOR
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedNop},                          // 0x5A NOP
+	{0,                        0, 0, nullptr},                                           // 0x5B ---
+	{CPU6502::AbsoluteX,       4, Valid | PageCross, &CPU6502::decodedNop},              // 0x5C NOP
+	{CPU6502::AbsoluteX,       4, Valid | Reads | PageCross, &CPU6502::decodedEor},      // 0x5D EOR
+	{CPU6502::AbsoluteX,       7, Valid | Reads | Writes, &CPU6502::decodedLsr},         // 0x5E LSR
+	{0,                        0, 0, nullptr},                                           // 0x5F ---
+	{CPU6502::Implied,         6, Valid | EndsBlock, &CPU6502::decodedRts},              // 0x60 RTS
+	{CPU6502::IndexedIndirect, 6, Valid | Reads, &CPU6502::decodedAdc},                  // 0x61 ADC
+	{0,                        0, 0, nullptr},                                           // 0x62 ---
+	{0,                        0, 0, nullptr},                                           // 0x63 ---
+	{CPU6502::ZeroPage,        3, Valid, &CPU6502::decodedNop},                          // 0x64 NOP
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedAdc},                  // 0x65 ADC
+	{CPU6502::ZeroPage,        5, Valid | Reads | Writes, &CPU6502::decodedRor},         // 0x66 ROR
+	{0,                        0, 0, nullptr},                                           // 0x67 ---
+	{CPU6502::Implied,         4, Valid, &CPU6502::decodedPla},                          // 0x68 PLA
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedAdc},                          // 0x69 ADC
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedRor},                          // 0x6A ROR
+	{0,                        0, 0, nullptr},                                           // 0x6B ---
+	{CPU6502::Indirect,        5, Valid | Reads | EndsBlock, &CPU6502::decodedJmp},      // 0x6C JMP
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedAdc},                  // 0x6D ADC
+	{CPU6502::Absolute,        6, Valid | Reads | Writes, &CPU6502::decodedRor},         // 0x6E ROR
+	{0,                        0, 0, nullptr},                                           // 0x6F ---
+	{CPU6502::Relative,        2, Valid | Branch, &CPU6502::decodedBvs},                 // 0x70 BVS
+	{CPU6502::IndirectIndexed, 5, Valid | Reads | PageCross, &CPU6502::decodedAdc},      // 0x71 ADC
+	{0,                        0, 0, nullptr},                                           // 0x72 ---
+	{0,                        0, 0, nullptr},                                           // 0x73 ---
+	{CPU6502::ZeroPageX,       4, Valid, &CPU6502::decodedNop},                          // 0x74 NOP
+	{CPU6502::ZeroPageX,       4, Valid | Reads, &CPU6502::decodedAdc},                  // 0x75 ADC
+	{CPU6502::ZeroPageX,       6, Valid | Reads | Writes, &CPU6502::decodedRor},         // 0x76 ROR
+	{0,                        0, 0, nullptr},                                           // 0x77 ---
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedSei},                          // 0x78 SEI
+	{CPU6502::AbsoluteY,       4, Valid | Reads | PageCross, &CPU6502::decodedAdc},      // 0x79 ADC
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedNop},                          // 0x7A NOP
+	{0,                        0, 0, nullptr},                                           // 0x7B ---
+	{CPU6502::AbsoluteX,       4, Valid | PageCross, &CPU6502::decodedNop},              // 0x7C NOP
+	{CPU6502::AbsoluteX,       4, Valid | Reads | PageCross, &CPU6502::decodedAdc},      // 0x7D ADC
+	{CPU6502::AbsoluteX,       7, Valid | Reads | Writes, &CPU6502::decodedRor},         // 0x7E ROR
+	{0,                        0, 0, nullptr},                                           // 0x7F ---
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedNop},                          // 0x80 NOP
+	{CPU6502::IndexedIndirect, 6, Valid | Writes, &CPU6502::decodedSta},                 // 0x81 STA
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedNop},                          // 0x82 NOP
+	{CPU6502::IndexedIndirect, 6, Valid | Writes, &CPU6502::decodedSax},                 // 0x83 SAX
+	{CPU6502::ZeroPage,        3, Valid | Writes, &CPU6502::decodedSty},                 // 0x84 STY
+	{CPU6502::ZeroPage,        3, Valid | Writes, &CPU6502::decodedSta},                 // 0x85 STA
+	{CPU6502::ZeroPage,        3, Valid | Writes, &CPU6502::decodedStx},                 // 0x86 STX
+	{CPU6502::ZeroPage,        3, Valid | Writes, &CPU6502::decodedSax},                 // 0x87 SAX
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedDey},                          // 0x88 DEY
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedNop},                          // 0x89 NOP
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedTxa},                          // 0x8A TXA
+	{0,                        0, 0, nullptr},                                           // 0x8B ---
+	{CPU6502::Absolute,        4, Valid | Writes, &CPU6502::decodedSty},                 // 0x8C STY
+	{CPU6502::Absolute,        4, Valid | Writes, &CPU6502::decodedSta},                 // 0x8D STA
+	{CPU6502::Absolute,        4, Valid | Writes, &CPU6502::decodedStx},                 // 0x8E STX
+	{CPU6502::Absolute,        4, Valid | Writes, &CPU6502::decodedSax},                 // 0x8F SAX
+	{CPU6502::Relative,        2, Valid | Branch, &CPU6502::decodedBcc},                 // 0x90 BCC
+	{CPU6502::IndirectIndexed, 6, Valid | Writes, &CPU6502::decodedSta},                 // 0x91 STA
+	{0,                        0, 0, nullptr},                                           // 0x92 ---
+	{0,                        0, 0, nullptr},                                           // 0x93 ---
+	{CPU6502::ZeroPageX,       4, Valid | Writes, &CPU6502::decodedSty},                 // 0x94 STY
+	{CPU6502::ZeroPageX,       4, Valid | Writes, &CPU6502::decodedSta},                 // 0x95 STA
+	{CPU6502::ZeroPageY,       4, Valid | Writes, &CPU6502::decodedStx},                 // 0x96 STX
+	{CPU6502::ZeroPageY,       4, Valid | Writes, &CPU6502::decodedSax},                 // 0x97 SAX
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedTya},                          // 0x98 TYA
+	{CPU6502::AbsoluteY,       5, Valid | Writes, &CPU6502::decodedSta},                 // 0x99 STA
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedTxs},                          // 0x9A TXS
+	{0,                        0, 0, nullptr},                                           // 0x9B ---
+	{0,                        0, 0, nullptr},                                           // 0x9C SHY
+	{CPU6502::AbsoluteX,       5, Valid | Writes, &CPU6502::decodedSta},                 // 0x9D STA
+	{0,                        0, 0, nullptr},                                           // 0x9E SHX
+	{0,                        0, 0, nullptr},                                           // 0x9F ---
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedLdy},                          // 0xA0 LDY
+	{CPU6502::IndexedIndirect, 6, Valid | Reads, &CPU6502::decodedLda},                  // 0xA1 LDA
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedLdx},                          // 0xA2 LDX
+	{CPU6502::IndexedIndirect, 6, Valid | Reads, &CPU6502::decodedLax},                  // 0xA3 LAX
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedLdy},                  // 0xA4 LDY
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedLda},                  // 0xA5 LDA
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedLdx},                  // 0xA6 LDX
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedLax},                  // 0xA7 LAX
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedTay},                          // 0xA8 TAY
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedLda},                          // 0xA9 LDA
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedTax},                          // 0xAA TAX
+	{0,                        0, 0, nullptr},                                           // 0xAB ---
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedLdy},                  // 0xAC LDY
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedLda},                  // 0xAD LDA
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedLdx},                  // 0xAE LDX
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedLax},                  // 0xAF LAX
+	{CPU6502::Relative,        2, Valid | Branch, &CPU6502::decodedBcs},                 // 0xB0 BCS
+	{CPU6502::IndirectIndexed, 5, Valid | Reads | PageCross, &CPU6502::decodedLda},      // 0xB1 LDA
+	{0,                        0, 0, nullptr},                                           // 0xB2 ---
+	{CPU6502::IndirectIndexed, 4, Valid | Reads | PageCross, &CPU6502::decodedLax},      // 0xB3 LAX
+	{CPU6502::ZeroPageX,       4, Valid | Reads, &CPU6502::decodedLdy},                  // 0xB4 LDY
+	{CPU6502::ZeroPageX,       4, Valid | Reads, &CPU6502::decodedLda},                  // 0xB5 LDA
+	{CPU6502::ZeroPageY,       4, Valid | Reads, &CPU6502::decodedLdx},                  // 0xB6 LDX
+	{CPU6502::ZeroPageY,       4, Valid | Reads, &CPU6502::decodedLax},                  // 0xB7 LAX
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedClv},                          // 0xB8 CLV
+	{CPU6502::AbsoluteY,       4, Valid | Reads | PageCross, &CPU6502::decodedLda},      // 0xB9 LDA
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedTsx},                          // 0xBA TSX
+	{0,                        0, 0, nullptr},                                           // 0xBB ---
+	{CPU6502::AbsoluteX,       4, Valid | Reads | PageCross, &CPU6502::decodedLdy},      // 0xBC LDY
+	{CPU6502::AbsoluteX,       4, Valid | Reads | PageCross, &CPU6502::decodedLda},      // 0xBD LDA
+	{CPU6502::AbsoluteY,       4, Valid | Reads | PageCross, &CPU6502::decodedLdx},      // 0xBE LDX
+	{CPU6502::AbsoluteY,       4, Valid | Reads | PageCross, &CPU6502::decodedLax},      // 0xBF LAX
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedCpy},                          // 0xC0 CPY
+	{CPU6502::IndexedIndirect, 6, Valid | Reads, &CPU6502::decodedCmp},                  // 0xC1 CMP
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedNop},                          // 0xC2 NOP
+	{0,                        0, 0, nullptr},                                           // 0xC3 ---
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedCpy},                  // 0xC4 CPY
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedCmp},                  // 0xC5 CMP
+	{CPU6502::ZeroPage,        5, Valid | Reads | Writes, &CPU6502::decodedDec},         // 0xC6 DEC
+	{0,                        0, 0, nullptr},                                           // 0xC7 ---
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedIny},                          // 0xC8 INY
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedCmp},                          // 0xC9 CMP
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedDex},                          // 0xCA DEX
+	{0,                        0, 0, nullptr},                                           // 0xCB ---
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedCpy},                  // 0xCC CPY
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedCmp},                  // 0xCD CMP
+	{CPU6502::Absolute,        6, Valid | Reads | Writes, &CPU6502::decodedDec},         // 0xCE DEC
+	{0,                        0, 0, nullptr},                                           // 0xCF ---
+	{CPU6502::Relative,        2, Valid | Branch, &CPU6502::decodedBne},                 // 0xD0 BNE
+	{CPU6502::IndirectIndexed, 5, Valid | Reads | PageCross, &CPU6502::decodedCmp},      // 0xD1 CMP
+	{0,                        0, 0, nullptr},                                           // 0xD2 ---
+	{0,                        0, 0, nullptr},                                           // 0xD3 ---
+	{CPU6502::ZeroPageX,       4, Valid, &CPU6502::decodedNop},                          // 0xD4 NOP
+	{CPU6502::ZeroPageX,       4, Valid | Reads, &CPU6502::decodedCmp},                  // 0xD5 CMP
+	{CPU6502::ZeroPageX,       6, Valid | Reads | Writes, &CPU6502::decodedDec},         // 0xD6 DEC
+	{0,                        0, 0, nullptr},                                           // 0xD7 ---
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedCld},                          // 0xD8 CLD
+	{CPU6502::AbsoluteY,       4, Valid | Reads | PageCross, &CPU6502::decodedCmp},      // 0xD9 CMP
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedNop},                          // 0xDA NOP
+	{0,                        0, 0, nullptr},                                           // 0xDB ---
+	{CPU6502::AbsoluteX,       4, Valid | PageCross, &CPU6502::decodedNop},              // 0xDC NOP
+	{CPU6502::AbsoluteX,       4, Valid | Reads | PageCross, &CPU6502::decodedCmp},      // 0xDD CMP
+	{CPU6502::AbsoluteX,       7, Valid | Reads | Writes, &CPU6502::decodedDec},         // 0xDE DEC
+	{0,                        0, 0, nullptr},                                           // 0xDF ---
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedCpx},                          // 0xE0 CPX
+	{CPU6502::IndexedIndirect, 6, Valid | Reads, &CPU6502::decodedSbc},                  // 0xE1 SBC
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedNop},                          // 0xE2 NOP
+	{0,                        0, 0, nullptr},                                           // 0xE3 ---
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedCpx},                  // 0xE4 CPX
+	{CPU6502::ZeroPage,        3, Valid | Reads, &CPU6502::decodedSbc},                  // 0xE5 SBC
+	{CPU6502::ZeroPage,        5, Valid | Reads | Writes, &CPU6502::decodedInc},         // 0xE6 INC
+	{0,                        0, 0, nullptr},                                           // 0xE7 ---
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedInx},                          // 0xE8 INX
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedExecute},                      // 0xE9 SBC
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedNop},                          // 0xEA NOP
+	{CPU6502::Immediate,       2, Valid, &CPU6502::decodedExecute},                      // 0xEB SBC
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedCpx},                  // 0xEC CPX
+	{CPU6502::Absolute,        4, Valid | Reads, &CPU6502::decodedSbc},                  // 0xED SBC
+	{CPU6502::Absolute,        6, Valid | Reads | Writes, &CPU6502::decodedInc},         // 0xEE INC
+	{0,                        0, 0, nullptr},                                           // 0xEF ---
+	{CPU6502::Relative,        2, Valid | Branch, &CPU6502::decodedBeq},                 // 0xF0 BEQ
+	{CPU6502::IndirectIndexed, 5, Valid | Reads | PageCross, &CPU6502::decodedSbc},      // 0xF1 SBC
+	{0,                        0, 0, nullptr},                                           // 0xF2 ---
+	{0,                        0, 0, nullptr},                                           // 0xF3 ---
+	{CPU6502::ZeroPageX,       4, Valid, &CPU6502::decodedNop},                          // 0xF4 NOP
+	{CPU6502::ZeroPageX,       4, Valid | Reads, &CPU6502::decodedSbc},                  // 0xF5 SBC
+	{CPU6502::ZeroPageX,       6, Valid | Reads | Writes, &CPU6502::decodedInc},         // 0xF6 INC
+	{0,                        0, 0, nullptr},                                           // 0xF7 ---
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedSed},                          // 0xF8 SED
+	{CPU6502::AbsoluteY,       4, Valid | Reads | PageCross, &CPU6502::decodedSbc},      // 0xF9 SBC
+	{CPU6502::Implied,         2, Valid, &CPU6502::decodedNop},                          // 0xFA NOP
+	{0,                        0, 0, nullptr},                                           // 0xFB ---
+	{CPU6502::AbsoluteX,       4, Valid | PageCross, &CPU6502::decodedNop},              // 0xFC NOP
+	{CPU6502::AbsoluteX,       4, Valid | Reads | PageCross, &CPU6502::decodedSbc},      // 0xFD SBC
+	{CPU6502::AbsoluteX,       7, Valid | Reads | Writes, &CPU6502::decodedInc},         // 0xFE INC
+	{0,                        0, 0, nullptr},                                           // 0xFF ---
+};
+
+CodeCache::CodeCache(){
+	memset(codePages, 0, sizeof(codePages));
+}
+
+CodeCache::~CodeCache(){
+	flush();
+	release();
+}
+
+// Code is only cached from cartridge space and from RAM above the stack.
+// Zero page and stack are written constantly and are interpreted instead.
+bool CodeCache::isCodeAddress(uint16_t address){
+	if(0x0200 <= address && address <= 0x1FFF)
+		return (address & 0x7FF) >= 0x200;
+
+	return 0x8000 <= address;
+}
+
+// Folds mirrors onto one page so a write invalidates every alias of it
+uint8_t CodeCache::codePage(uint16_t address){
+	if(address <= 0x1FFF)
+		return (address & 0x7FF) >> 8;
+
+	if(0x8000 <= address)
+		return 0x80 | ((address & 0x3FFF) >> 8);
+
+	return address >> 8;
+}
+
+uint8_t CodeCache::instructionLength(uint8_t mode){
+	switch(mode){
+		case CPU6502::Implied:
+			return 1;
+
+		case CPU6502::Absolute:
+		case CPU6502::AbsoluteX:
+		case CPU6502::AbsoluteY:
+		case CPU6502::Indirect:
+			return 3;
+	}
+
+	return 2;
+}
+
+uint16_t CodeCache::bankOf(uint16_t address){
+	return address < 0x8000 ? RamBank : bus->prgBank;
+}
+
+CodeBlock* CodeCache::fetch(uint16_t pc){
+	if(!retired.empty())
+		release();
+
+	if(!isCodeAddress(pc))
+		return nullptr;
+
+	if(recent.empty())
+		recent.assign(0x10000, nullptr);
+
+	uint16_t bank = bankOf(pc);
+
+	CodeBlock* block = recent[pc];
+	if(block != nullptr && block->bank == bank)
+		return block;
+
+	uint32_t key = (uint32_t)bank << 16 | pc;
+	auto found = blocks.find(key);
+
+	if(found != blocks.end()){
+		block = found->second;
+	} else {
+		block = decode(pc, bank);
+		if(block == nullptr)
+			return nullptr;
+
+		blocks[key] = block;
+
+		for(uint16_t address = block->start; address != block->end; address++){
+			uint8_t page = codePage(address);
+			vector<uint32_t>& keys = pageBlocks[page];
+			if(keys.empty() || keys.back() != key)
+				keys.push_back(key);
+
+			codePages[page] = 1;
+		}
+	}
+
+	recent[pc] = block;
+	return block;
+}
+
+CodeBlock* CodeCache::decode(uint16_t pc, uint16_t bank){
+	CodeBlock* block = new CodeBlock;
+	block->start = pc;
+	block->bank = bank;
+
+	int cycles = 0;
+	bool inRam = pc < 0x8000;
+
+	while((int)block->instructions.size() < maxInstructions){
+		uint8_t opcode = bus->peek(pc);
+		const OpcodeInfo& info = opcodes[opcode];
+
+		if(!(info.flags & Valid))
+			break;
+
+		DecodedInstruction instruction;
+		instruction.pc = pc;
+		instruction.opcode = opcode;
+		instruction.handler = info.handler;
+		instruction.length = instructionLength(info.mode);
+		instruction.mode = info.mode;
+		instruction.cycles = info.cycles;
+		instruction.flags = info.flags;
+
+		bool inRegion = true;
+		for(int i = 1; i < instruction.length; i++){
+			if(!isCodeAddress(pc + i) || inRam != ((uint16_t)(pc + i) < 0x8000))
+				inRegion = false;
+		}
+
+		if(!inRegion)
+			break;
+
+		if(instruction.length > 1)
+			instruction.operand = bus->peek(pc + 1);
+
+		if(instruction.length > 2)
+			instruction.operand |= bus->peek(pc + 2) << 8;
+
+		// Worst case: every possible page cross taken, branches taken across a page
+		int worstCase = info.cycles;
+		uint16_t next = pc + instruction.length;
+
+		if(info.flags & PageCross){
+			if(info.mode == CPU6502::IndirectIndexed || (instruction.operand & 0xFF) != 0)
+				instruction.pageCrossPossible = true;
+		}
+
+		if(info.flags & Branch){
+			uint16_t target = next + (int8_t)instruction.operand;
+			instruction.pageCrossPossible = (target & 0xFF00) != (next & 0xFF00);
+			worstCase += 2;
+		}
+
+		if(instruction.pageCrossPossible)
+			worstCase++;
+
+		// An instruction that may touch I/O runs alone in its block, so it
+		// starts at the exact cycle the interpreter would run it and DMA or
+		// register side effects happen before the next instruction
+		bool mayTouchIo = false;
+
+		if(info.flags & (Reads | Writes)){
+			mayTouchIo = true;
+			uint16_t first = instruction.operand;
+			uint16_t last = instruction.operand;
+
+			switch(info.mode){
+				case CPU6502::ZeroPage:
+				case CPU6502::ZeroPageX:
+				case CPU6502::ZeroPageY:
+					mayTouchIo = false;
+					break;
+
+				case CPU6502::AbsoluteX:
+				case CPU6502::AbsoluteY:
+					last = first + 0xFF;
+					if(last < first)
+						break;
+				// fallthrough
+				case CPU6502::Absolute:
+				case CPU6502::Indirect:
+					if(info.mode == CPU6502::Indirect)
+						last = first + 1;
+					mayTouchIo = !(last < 0x2000 || 0x6000 <= first);
+					break;
+			}
+		}
+
+		if(mayTouchIo && !block->instructions.empty())
+			break;
+
+		block->touchesIo = mayTouchIo;
+
+		if(cycles + worstCase > 200)
+			break;
+
+		cycles += worstCase;
+		block->instructions.push_back(instruction);
+		pc = next;
+
+		if(mayTouchIo || (info.flags & (Branch | EndsBlock)))
+			break;
+
+		// Code in RAM may be rewritten by its own stores
+		if(inRam && (info.flags & Writes))
+			break;
+
+		if(!isCodeAddress(pc) || inRam != (pc < 0x8000))
+			break;
+	}
+
+	if(block->instructions.empty()){
+		delete block;
+		return nullptr;
+	}
+
+	block->end = pc;
+	block->maxCycles = cycles;
+	return block;
+}
+
+void CodeCache::invalidatePage(uint8_t page){
+	vector<uint32_t> keys;
+	keys.swap(pageBlocks[page]);
+	codePages[page] = 0;
+	generation++;
+
+	for(uint32_t key : keys){
+		auto found = blocks.find(key);
+		if(found == blocks.end())
+			continue;
+
+		CodeBlock* block = found->second;
+		blocks.erase(found);
+
+		if(recent[block->start] == block)
+			recent[block->start] = nullptr;
+
+		// The block may still be executing, so it is only freed on the next lookup
+		retired.push_back(block);
+	}
+}
+
+void CodeCache::invalidateRam(){
+	for(uint16_t address = 0x0200; address < 0x0800; address += 0x100)
+		invalidate(address);
+}
+
+void CodeCache::flush(){
+	generation++;
+
+	for(auto& entry : blocks)
+		retired.push_back(entry.second);
+
+	blocks.clear();
+
+	for(int i = 0; i < 256; i++)
+		pageBlocks[i].clear();
+
+	memset(codePages, 0, sizeof(codePages));
+
+	if(!recent.empty())
+		recent.assign(0x10000, nullptr);
+}
+
+void CodeCache::release(){
+	for(CodeBlock* block : retired)
+		delete block;
+
+	retired.clear();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+class Bus;
+class CPU6502;
+struct DecodedInstruction;
+
+// Runs one decoded instruction the way its executeInstruction case would
+typedef void (*DecodedHandler)(CPU6502* cpu, const DecodedInstruction& instruction);
+
+// A 6502 instruction decoded once from memory
+struct DecodedInstruction{
+	DecodedHandler handler = nullptr;
+	uint16_t pc = 0;
+	uint16_t operand = 0;			// raw operand bytes, low byte first
+	uint8_t opcode = 0;
+	uint8_t length = 0;
+	uint8_t mode = 0;
+	uint8_t cycles = 0;				// base cycles, without page crossing or taken branches
+	uint8_t flags = 0;				// CodeCache::opcodeFlag bits of the opcode
+	bool pageCrossPossible = false;
+};
+
+// Straight line run of instructions. A block ends at a branch, jump, call or
+// return. An instruction that may touch an I/O register is a block of its
+// own, so it runs at the exact cycle the interpreter would run it and nothing
+// after it runs before the bus reacts to it.
+struct CodeBlock{
+	uint16_t start = 0;
+	uint16_t end = 0; 				// address following the last instruction
+	uint16_t bank = 0;
+	uint8_t maxCycles = 0; 			// worst case cycles of the whole block
+	bool touchesIo = false; 		// its only instruction may touch an I/O register
+	std::vector<DecodedInstruction> instructions;
+
+	void* native = nullptr; 		// entry point once compiled by JIT6502
+};
+
+class CodeCache{
+	Bus *bus = nullptr;
+
+	std::unordered_map<uint32_t, CodeBlock*> blocks;	// keyed by bank << 16 | pc
+	std::vector<CodeBlock*> recent;						// last block seen at each pc
+	std::vector<CodeBlock*> retired;					// invalidated, freed before the next lookup
+	std::vector<uint32_t> pageBlocks[256];				// keys of the blocks touching each code page
+
+	CodeBlock* decode(uint16_t pc, uint16_t bank);
+	void invalidatePage(uint8_t page);
+	void release();
+public:
+	// Non zero while a block covers the code page, native stores test it
+	uint8_t codePages[256];
+
+	CodeCache();
+	~CodeCache();
+
+	enum opcodeFlag{
+		Valid = 0x01,
+		Reads = 0x02, 				// reads memory at the operand address
+		Writes = 0x04, 				// writes memory at the operand address
+		PageCross = 0x08, 			// one extra cycle when indexing crosses a page
+		Branch = 0x10,
+		EndsBlock = 0x20 			// jumps, calls, returns and BRK
+	};
+
+	struct OpcodeInfo{
+		uint8_t mode;
+		uint8_t cycles;
+		uint8_t flags;
+		DecodedHandler handler;
+	};
+
+	static const OpcodeInfo opcodes[256];
+
+	static const uint16_t RamBank = 0x100;
+	static const int maxInstructions = 32;
+
+	// Bumped whenever a block is dropped so callers holding one know to look it up again
+	uint32_t generation = 0;
+
+	void connectBus(Bus* b){ bus = b; }
+
+	CodeBlock* fetch(uint16_t pc);
+
+	// Bank the code at address belongs to, RamBank below $8000
+	uint16_t bankOf(uint16_t address);
+
+	// Called by the bus for every write that may land on decoded code
+	void invalidate(uint16_t address){
+		uint8_t page = codePage(address);
+		if(codePages[page])
+			invalidatePage(page);
+	}
+
+	// Drops the blocks decoded from ram, for writes that didn't go through the bus
+	void invalidateRam();
+
+	void flush();
+
+	static bool isCodeAddress(uint16_t address);
+	static uint8_t codePage(uint16_t address);
+	static uint8_t instructionLength(uint8_t mode);
+};
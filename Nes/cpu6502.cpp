@@ -1,7 +1,7 @@
-#include <iomanip> 
 
 #include "bus.h"
 #include "cpu6502.h"
+#include "state.h"
 
 using namespace std;
 
@@ -19,6 +19,42 @@ void CPU6502::reset(){
 	p = 0x24;
 
 	waitCycle = 8;
+
+	idle = false;
+	idleRecording = false;
+	idleRejected = -1;
+}
+
+void CPU6502::saveState(StateWriter& state){
+	// A skipped loop is saved as the instruction it would be at
+	wake();
+
+	state.put(a);
+	state.put(x);
+	state.put(y);
+	state.put(pc);
+	state.put(s);
+	state.put(p);
+	state.put(waitCycle);
+	state.put(cycles);
+	state.put(instructionPc);
+}
+
+void CPU6502::loadState(StateReader& state){
+	state.get(a);
+	state.get(x);
+	state.get(y);
+	state.get(pc);
+	state.get(s);
+	state.get(p);
+	state.get(waitCycle);
+	state.get(cycles);
+	state.get(instructionPc);
+
+	idle = false;
+	idleRecording = false;
+	cachedBlock = nullptr;
+	codeCache.flush();
 }
 
 /* 
@@ -64,6 +100,27 @@ bool CPU6502::getFlag(uint8_t bit){
 	}
 }
 
+// Operand byte at pc, from the code cache when it already decoded the instruction
+uint8_t CPU6502::fetchOperand(){
+	if(operandPrefetched){
+		return prefetchedOperand & 0xFF;
+	}
+
+	return bus->fetch(pc);
+}
+
+// Two byte operand at pc, leaves pc on the high byte
+uint16_t CPU6502::fetchOperandWord(){
+	if(operandPrefetched){
+		pc++;
+		return prefetchedOperand;
+	}
+
+	uint16_t lo = bus->fetch(pc);
+	uint16_t hi = bus->fetch(++pc);
+	return lo | (hi << 8);
+}
+
 uint16_t CPU6502::getModeInstruction(int mode){
 	pc++;
 
@@ -73,30 +130,30 @@ uint16_t CPU6502::getModeInstruction(int mode){
 	
 	switch(mode){
 		case Immediate: 
-			return bus->cpuRead(pc);
+			return fetchOperand();
 	
 		case ZeroPage:
-			return bus->cpuRead(pc) & 0xFF;
+			return fetchOperand() & 0xFF;
 	
 		case ZeroPageX:
-			address = bus->cpuRead(pc);
+			address = fetchOperand();
 			return (uint8_t)(address + x) & 0xFF;
 
 	
 		case ZeroPageY:
-			address = bus->cpuRead(pc);
+			address = fetchOperand();
 			return (uint8_t)(address + y) & 0xFF;
 	
 		case Relative:
-			displacement = bus->cpuRead(pc);
+			displacement = fetchOperand();
 			return displacement;
 	
 		case Absolute:
-			address = (uint8_t)bus->cpuRead(pc) | (bus->cpuRead(++pc) << 8);
+			address = fetchOperandWord();
 			return address;
 	
 		case AbsoluteX:
-		 	address = (uint8_t)bus->cpuRead(pc) | (bus->cpuRead(++pc) << 8);
+		 	address = fetchOperandWord();
 			temp = address;
 			address += x;
 			
@@ -110,7 +167,7 @@ uint16_t CPU6502::getModeInstruction(int mode){
 
 	
 		case AbsoluteY:
-			address = (uint8_t)bus->cpuRead(pc) | (bus->cpuRead(++pc) << 8);
+			address = fetchOperandWord();
 			temp = address;
 			address += y;
 
@@ -123,20 +180,20 @@ uint16_t CPU6502::getModeInstruction(int mode){
 			return address;
 
 		case Indirect:
-			address = bus->cpuRead(pc) | (bus->cpuRead(++pc) << 8);
+			address = fetchOperandWord();
 			address = bus->cpuRead(address) | (bus->cpuRead(address & 0xFF00 | ((address + 1) & 0x00FF)) << 8);
 
 			return address;
 
 		case IndexedIndirect:
-			address = bus->cpuRead(pc);
+			address = fetchOperand();
 			address = (address + x) & 0xFF;
 			address = bus->cpuRead(address & 0xFF) | (bus->cpuRead(address & 0xFF00 | ((address + 1) & 0x00FF)) << 8);
 		
 			return address;
 
 		case IndirectIndexed:
-			address = bus->cpuRead(pc);
+			address = fetchOperand();
 			address = bus->cpuRead(address) | (bus->cpuRead(address & 0xFF00 | ((address + 1) & 0x00FF)) << 8);
 		
 			temp = address;
@@ -351,7 +408,7 @@ void CPU6502::sbc(uint8_t value){
 
 	bool carryIn = getFlag(Carry);
 
-	bool carryOut = a < value - 1 + carryIn;
+	bool carryOut = a < value + !carryIn;
 	a = a - value - !carryIn;
 
 	handleFlag(Carry, !carryOut);
@@ -817,6 +874,8 @@ void CPU6502::sax(uint16_t address){
 }
 
 void CPU6502::irq(){
+	wake();
+
 	if(getFlag(Interrupt) == 0){
 		bus->cpuWrite(0x100 | s, (pc >> 8) & 0x00FF);
 		s--;
@@ -834,10 +893,19 @@ void CPU6502::irq(){
 		pc = (hi << 8) | lo;
 
 		waitCycle = 7;
+
+#ifdef NES_PROFILE
+		profiler.interrupt(pc, codeCache.bankOf(pc));
+#endif
 	}
 }
 
 void CPU6502::nmi(){
+	wake();
+
+	// Every frame gets another try at the loops native code runs
+	idleRejected = -1;
+
 	bus->cpuWrite(0x100 | s, (pc >> 8) & 0x00FF);
 	s--;
 	bus->cpuWrite(0x100 | s, pc & 0x00FF);
@@ -856,36 +924,356 @@ void CPU6502::nmi(){
 	pc = temp;
 
 	waitCycle = 8;
+
+#ifdef NES_PROFILE
+	profiler.interrupt(pc, codeCache.bankOf(pc));
+#endif
 }
 
 void CPU6502::clock(){
+	// The tracer wants every instruction, resume where the loop would be
+	if(idle && tracer.enabled){
+		wake();
+	}
+
+	if(idle){
+		cycles++;
+		idleCycles++;
+#ifdef NES_PROFILE
+		profiler.idle();
+#endif
+		return;
+	}
+
 	if(waitCycle <= 0){
+		// Pages with breakpoints are left out of the fetch map. A breakpoint
+		// holds the cpu before the instruction without using up the cycle.
+		if(bus->fetchMap[pc >> 8] == nullptr && bus->debugger.breakAt(pc)){
+			return;
+		}
+
 		handleFlag(Unused, true);
 
-		if(false){ // debug
-			cout << uppercase << hex;
-			cout << /* "PC:" << */ setw(4) << pc;
-			cout << " A:" << setfill('0') << setw(2) << (int)a;
-			cout <<	" X:" << setfill('0') << setw(2) << (int)x;
-			cout << " Y:" << setfill('0') << setw(2) << (int)y; 
-			cout << " S:" << setfill('0') << setw(2) << (int)s;
-			cout << " P:";
-			cout << (0b10000000 & p ? "N" : "n");
-			cout << (0b01000000 & p ? "V" : "v");
-			cout << "u";
-			cout << (0b00010000 & p ? "B" : "b");
-			cout << (0b00001000 & p ? "D" : "d");
-			cout << (0b00000100 & p ? "I" : "i");
-			cout << (0b00000010 & p ? "Z" : "z");
-			cout << (0b00000001 & p ? "C" : "c");
-			cout << endl;
+		if(tracer.enabled){
+			traceInstruction();
+		}
+
+		instructionPc = pc;
+
+		// A skipped loop would skip the watchpoints on what it reads
+		bool watchIdle = idleSkip && !tracer.enabled && !bus->debugger.active();
+		bool readsStatus = false;
+		bool safe = false;
+
+#ifdef NES_PROFILE
+		uint8_t opcode = bus->peek(pc);
+#endif
+
+		// Native blocks look for spin loops where they end, a loop found
+		// there is recorded one interpreted instruction at a time
+		bool recompiled = engine == Recompile && !idleRecording && runRecompiled(watchIdle);
+
+		if(!recompiled){
+			safe = watchIdle && isIdleSafe(pc, readsStatus);
+
+			bool cached = engine == CachedInterpret && runCached();
+
+			if(!cached){
+				executeInstruction(bus->fetch(pc));
+			}
 		}
-		executeInstruction(bus->cpuRead(pc));
 
 		handleFlag(Unused, true);
+
+#ifdef NES_PROFILE
+		profiler.instruction(instructionPc, codeCache.bankOf(instructionPc), opcode, waitCycle, pc, codeCache.bankOf(pc));
+#endif
+
+		if(watchIdle && !recompiled){
+			watchIdleLoop(instructionPc, safe, readsStatus);
+		}
 	} 
 
 	waitCycle--;
+	cycles++;
+}
+
+// Records the instruction about to run at pc
+void CPU6502::traceInstruction(){
+	if(!tracer.isOpen()){
+		return;
+	}
+
+	// Operand bytes are read without going through the I/O registers
+
+	TraceRecord record;
+	record.cycle = cycles;
+	record.pc = pc;
+	record.scanline = bus->ppu.getScanline();
+	record.dot = bus->ppu.getCycle();
+	record.opcode = bus->peek(pc);
+	record.operand[0] = bus->peek(pc + 1);
+	record.operand[1] = bus->peek(pc + 2);
+	record.a = a;
+	record.x = x;
+	record.y = y;
+	record.s = s;
+	record.p = p;
+	record.reserved[0] = 0;
+	record.reserved[1] = 0;
+
+	tracer.record(record);
+}
+
+// True when the instruction at address only reads ram, rom or PPUSTATUS and
+// touches no stack. Repeated $2002 reads return the same value until the ppu
+// status changes, the bus wakes the cpu before that happens.
+bool CPU6502::isIdleSafe(uint16_t address, bool& readsStatus){
+	uint8_t opcode = bus->fetch(address);
+	const CodeCache::OpcodeInfo& info = CodeCache::opcodes[opcode];
+
+	if(!(info.flags & CodeCache::Valid) || (info.flags & CodeCache::Writes))
+		return false;
+
+	if((info.flags & CodeCache::EndsBlock) && opcode != 0x4C)
+		return false;
+
+	if(opcode == 0x08 || opcode == 0x28 || opcode == 0x48 || opcode == 0x68)
+		return false;
+
+	if(!(info.flags & CodeCache::Reads))
+		return true;
+
+	uint16_t operand = bus->fetch(address + 1);
+	uint16_t target;
+
+	switch(info.mode){
+		case Immediate:
+		case ZeroPage:
+		case ZeroPageX:
+		case ZeroPageY:
+			return true;
+
+		case Absolute:
+			target = operand | (bus->fetch(address + 2) << 8);
+			break;
+
+		case AbsoluteX:
+			target = (operand | (bus->fetch(address + 2) << 8)) + x;
+			break;
+
+		case AbsoluteY:
+			target = (operand | (bus->fetch(address + 2) << 8)) + y;
+			break;
+
+		default:
+			return false;
+	}
+
+	if(0x2000 <= target && target <= 0x3FFF && (target & 0x7) == 0x2){
+		readsStatus = true;
+		return true;
+	}
+
+	// Other registers and anything past them may change or have read side effects
+	return target < 0x2000 || target >= 0x8000;
+}
+
+// Called after every instruction. A short backward jump starts recording the
+// loop, coming back to its start with the same registers makes the cpu idle.
+// Under Recompile a loop that doesn't go idle goes back to native code.
+void CPU6502::watchIdleLoop(uint16_t instructionPc, bool safe, bool readsStatus){
+	if(!safe){
+		stopIdleRecording(instructionPc);
+		return;
+	}
+
+	IdleStep step = {pc, a, x, y, p, s, waitCycle};
+
+	if(idleRecording){
+		if(idleStepCount == maxIdleSteps){
+			stopIdleRecording(instructionPc);
+			return;
+		}
+
+		idleSteps[idleStepCount++] = step;
+		idleReadsStatus |= readsStatus;
+
+		if(pc != idleLoopStart)
+			return;
+
+		if(a == idleStart.a && x == idleStart.x && y == idleStart.y && p == idleStart.p && s == idleStart.s){
+			idlePeriod = 0;
+			for(int i = 0; i < idleStepCount; i++){
+				idlePeriod += idleSteps[i].cycles;
+			}
+
+			// This clock already ran the first cycle of the last instruction
+			idleCycles = idlePeriod - waitCycle + 1;
+			idle = true;
+			idleRecording = false;
+			return;
+		}
+
+		// A status read may change the registers once, a loop still changing
+		// them on its second pass isn't waiting
+		if(engine == Recompile && idleRestarted){
+			idleRejected = idleLoopStart;
+			idleRecording = false;
+			return;
+		}
+
+		idleRestarted = true;
+	} else if(pc > instructionPc || instructionPc - pc > maxIdleLoopBytes){
+		return;
+	} else {
+		idleRestarted = false;
+	}
+
+	// Start over at the loop head with the current registers
+	idleRecording = true;
+	idleLoopStart = pc;
+	idleLoopEnd = instructionPc;
+	idleStart = step;
+	idleStepCount = 0;
+	idleReadsStatus = false;
+}
+
+// Leaving the loop isn't a reason to run it natively, an unsafe instruction
+// or too many steps inside it are
+void CPU6502::stopIdleRecording(uint16_t instructionPc){
+	if(idleRecording && idleLoopStart <= instructionPc && instructionPc <= idleLoopEnd){
+		idleRejected = idleLoopStart;
+	}
+
+	idleRecording = false;
+}
+
+// Puts the registers where the skipped loop would have left them
+void CPU6502::wake(){
+	if(!idle){
+		return;
+	}
+
+	idle = false;
+
+	uint32_t position = (idleCycles - 1) % idlePeriod;
+
+	for(int i = 0; i < idleStepCount; i++){
+		const IdleStep& step = idleSteps[i];
+
+		if(position < step.cycles){
+			pc = step.pc;
+			a = step.a;
+			x = step.x;
+			y = step.y;
+			p = step.p;
+			s = step.s;
+			waitCycle = step.cycles - 1 - position;
+			return;
+		}
+
+		position -= step.cycles;
+	}
+}
+
+// Runs native blocks from pc one after another. The chain stops before a
+// block that could reach an NMI or a new frame, before an I/O block that
+// wouldn't be the first and after a jump back to a possible spin loop. False
+// when even the first block has to be interpreted.
+bool CPU6502::runRecompiled(bool watchIdle){
+	// Blocks would leave out all but their first instruction
+	if(tracer.enabled){
+		return false;
+	}
+
+#ifdef NES_PROFILE
+	// Whole blocks would hide single instructions from the profiler
+	return false;
+#endif
+
+	if(!JIT6502::available()){
+		return false;
+	}
+
+	// Native code reaches ram directly and runs past breakpoints
+	if(bus->debugger.active()){
+		return false;
+	}
+
+	// The interpreter would take an NMI or see a new frame's freezes and input
+	// between two instructions, blocks end before that dot
+	int32_t dots = bus->ppu.dotsUntilCpuEvent();
+	bool executed = false;
+
+	while(true){
+		CodeBlock* block = codeCache.fetch(pc);
+		if(block == nullptr){
+			break;
+		}
+
+		// Blocks run ahead of the ppu, an I/O access has to be at its own cycle
+		if(block->touchesIo && executed){
+			break;
+		}
+
+		if(3 * (waitCycle + block->maxCycles) >= dots || waitCycle + block->maxCycles > 0xFF){
+			break;
+		}
+
+		if(block->native == nullptr && !jit.compile(this, bus, block)){
+			codeCache.flush();
+			jit.reset();
+			break;
+		}
+
+		((void (*)(CPU6502*))block->native)(this);
+		handleFlag(Unused, true);
+		executed = true;
+
+		// A register write may start DMA, raise an NMI or move the next one
+		if(block->touchesIo){
+			if(bus->dmaTransfer){
+				break;
+			}
+
+			dots = bus->ppu.dotsUntilCpuEvent();
+		}
+
+		// A short jump back is recorded by the interpreter in case it spins
+		if(watchIdle){
+			const DecodedInstruction& last = block->instructions.back();
+			bool jumpsBack = (last.flags & CodeCache::Branch) || last.opcode == 0x4C;
+
+			if(jumpsBack && pc <= last.pc && last.pc - pc <= maxIdleLoopBytes && pc != idleRejected){
+				watchIdleLoop(last.pc, true, false);
+				break;
+			}
+		}
+	}
+
+	return executed;
+}
+
+// Runs the decoded instruction at pc, false when it has to be interpreted
+bool CPU6502::runCached(){
+	if(cachedBlock == nullptr 
+		|| cachedGeneration != codeCache.generation
+		|| cachedIndex >= cachedBlock->instructions.size() 
+		|| cachedBlock->instructions[cachedIndex].pc != pc){
+
+		cachedBlock = codeCache.fetch(pc);
+		cachedIndex = 0;
+		cachedGeneration = codeCache.generation;
+
+		if(cachedBlock == nullptr){
+			return false;
+		}
+	}
+
+	const DecodedInstruction& instruction = cachedBlock->instructions[cachedIndex++];
+	instruction.handler(this, instruction);
+	return true;
 }
 
 void CPU6502::executeInstruction(uint8_t opcode){
@@ -2158,24 +2546,28 @@ void CPU6502::executeInstruction(uint8_t opcode){
 		case 0x87:
 			address = getModeInstruction(ZeroPage);
 			sax(address);
+			waitCycle += 3;
 			break;
 
 	
 		case 0x97:
 			address = getModeInstruction(ZeroPageY);
 			sax(address);
+			waitCycle += 4;
 			break;
 
 	
 		case 0x8F:
 			address = getModeInstruction(Absolute);
 			sax(address);
+			waitCycle += 4;
 			break;
 
 	
 		case 0x83:
 			address = getModeInstruction(IndexedIndirect);
 			sax(address);
+			waitCycle += 6;
 			break;
 
 		
@@ -2245,3 +2637,428 @@ void CPU6502::executeInstruction(uint8_t opcode){
 
 	pc++;
 }
+
+/*
+** Cached interpreter handlers. The operand was read when the instruction was
+** decoded; pc, cycles and page crossing end up exactly as executeInstruction
+** leaves them.
+*/
+
+// Effective address, leaves pc on the last operand byte like getModeInstruction
+uint16_t CPU6502::decodedAddress(const DecodedInstruction& instruction){
+	if(instruction.mode == ZeroPage || instruction.mode == Absolute){
+		pc = instruction.pc + instruction.length - 1;
+		return instruction.operand;
+	}
+
+	pc = instruction.pc;
+	operandPrefetched = true;
+	prefetchedOperand = instruction.operand;
+
+	uint16_t address = getModeInstruction(instruction.mode);
+
+	operandPrefetched = false;
+	return address;
+}
+
+uint8_t CPU6502::decodedValue(const DecodedInstruction& instruction){
+	if(instruction.mode == Immediate || instruction.mode == Relative){
+		pc = instruction.pc + 1;
+		return instruction.operand & 0xFF;
+	}
+
+	return bus->cpuRead(decodedAddress(instruction));
+}
+
+void CPU6502::finishDecoded(const DecodedInstruction& instruction){
+	waitCycle += instruction.cycles;
+
+	if((instruction.flags & CodeCache::PageCross) && pageCrossed)
+		waitCycle++;
+
+	pc++;
+}
+
+// Odd cases go through the switch with the operand already fetched
+void CPU6502::decodedExecute(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->operandPrefetched = true;
+	cpu->prefetchedOperand = instruction.operand;
+
+	cpu->executeInstruction(instruction.opcode);
+
+	cpu->operandPrefetched = false;
+}
+
+/* 
+** Load or Store Operations 
+*/
+
+void CPU6502::decodedLda(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->lda(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedLdx(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->ldx(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedLdy(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->ldy(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedLax(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->lax(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedSta(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->sta(cpu->decodedAddress(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedStx(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->stx(cpu->decodedAddress(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedSty(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->sty(cpu->decodedAddress(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedSax(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->sax(cpu->decodedAddress(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+/*
+** Register Transfers and Stack Operations
+*/
+
+void CPU6502::decodedTax(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->tax();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedTay(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->tay();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedTxa(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->txa();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedTya(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->tya();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedTsx(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->tsx();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedTxs(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->txs();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedPha(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->pha();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedPhp(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->php();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedPla(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->pla();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedPlp(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->plp();
+	cpu->finishDecoded(instruction);
+}
+
+/*
+** Logical and Arithmetic
+*/
+
+void CPU6502::decodedAnd(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->andL(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedEor(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->eor(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedOra(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->ora(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedBit(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->bit(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedAdc(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->adc(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedSbc(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->sbc(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedCmp(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->cmp(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedCpx(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->cpx(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedCpy(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->cpy(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+/*
+** Increment and Decrements
+*/
+
+void CPU6502::decodedInc(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->inc(cpu->decodedAddress(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedInx(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->inx();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedIny(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->iny();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedDec(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->dec(cpu->decodedAddress(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedDex(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->dex();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedDey(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->dey();
+	cpu->finishDecoded(instruction);
+}
+
+/*
+** Shifts, the implied forms work on the accumulator
+*/
+
+void CPU6502::decodedAsl(CPU6502* cpu, const DecodedInstruction& instruction){
+	if(instruction.mode == Implied){
+		cpu->pc = instruction.pc;
+		cpu->asl(cpu->a, true);
+	} else {
+		cpu->asl(cpu->decodedAddress(instruction), false);
+	}
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedLsr(CPU6502* cpu, const DecodedInstruction& instruction){
+	if(instruction.mode == Implied){
+		cpu->pc = instruction.pc;
+		cpu->lsr(cpu->a, true);
+	} else {
+		cpu->lsr(cpu->decodedAddress(instruction), false);
+	}
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedRol(CPU6502* cpu, const DecodedInstruction& instruction){
+	if(instruction.mode == Implied){
+		cpu->pc = instruction.pc;
+		cpu->rol(cpu->a, true);
+	} else {
+		cpu->rol(cpu->decodedAddress(instruction), false);
+	}
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedRor(CPU6502* cpu, const DecodedInstruction& instruction){
+	if(instruction.mode == Implied){
+		cpu->pc = instruction.pc;
+		cpu->ror(cpu->a, true);
+	} else {
+		cpu->ror(cpu->decodedAddress(instruction), false);
+	}
+	cpu->finishDecoded(instruction);
+}
+
+/*
+** Jumps, Calls and Branches
+*/
+
+void CPU6502::decodedJmp(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->jmp(cpu->decodedAddress(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedJsr(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->jsr(cpu->decodedAddress(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedRts(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->rts();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedBcc(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->bcc(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedBcs(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->bcs(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedBeq(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->beq(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedBmi(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->bmi(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedBne(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->bne(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedBpl(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->bpl(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedBvc(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->bvc(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedBvs(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->bvs(cpu->decodedValue(instruction));
+	cpu->finishDecoded(instruction);
+}
+
+/*
+** Status Flag Changes
+*/
+
+void CPU6502::decodedClc(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->clc();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedCld(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->cld();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedCli(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->cli();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedClv(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->clv();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedSec(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->sec();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedSed(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->sed();
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedSei(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->sei();
+	cpu->finishDecoded(instruction);
+}
+
+/*
+** System Functions
+*/
+
+void CPU6502::decodedBrk(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->brk();
+	cpu->finishDecoded(instruction);
+}
+
+// Unofficial NOPs still resolve their operand for the page crossing cycle
+void CPU6502::decodedNop(CPU6502* cpu, const DecodedInstruction& instruction){
+	if(instruction.mode == Implied){
+		cpu->pc = instruction.pc;
+	} else if(instruction.mode == Immediate){
+		cpu->pc = instruction.pc + 1;
+	} else {
+		cpu->decodedAddress(instruction);
+	}
+	cpu->finishDecoded(instruction);
+}
+
+void CPU6502::decodedRti(CPU6502* cpu, const DecodedInstruction& instruction){
+	cpu->pc = instruction.pc;
+	cpu->rti();
+	cpu->finishDecoded(instruction);
+}
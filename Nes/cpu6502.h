@@ -3,7 +3,17 @@
 #include <iostream>
 #include <cstdint>
 
+#include "codecache.h"
+#include "jit6502.h"
+#include "tracer.h"
+
+#ifdef NES_PROFILE
+#include "profiler.h"
+#endif
+
 class Bus;
+class StateWriter;
+class StateReader;
 
 class CPU6502{
 	Bus *bus = nullptr;
@@ -19,11 +29,80 @@ public:
 
 	uint8_t waitCycle = 0; // cycles taken for an instruction
 
+	uint64_t cycles = 0; // cpu cycles since power on
+
+	uint16_t instructionPc = 0; // start of the last instruction begun
+
 	CPU6502();
 	
 	void reset();
 
-	void connectBus(Bus* b){ bus = b; }
+	// Registers and cycle position, an idle cpu is woken first
+	void saveState(StateWriter& state);
+	void loadState(StateReader& state);
+
+	void connectBus(Bus* b){ 
+		bus = b; 
+		codeCache.connectBus(b);
+	}
+
+	enum executionEngine{
+		Interpret = 0, 		// executeInstruction switch, one instruction at a time
+		Recompile = 1, 		// chains of blocks through JIT6502, falls back to Interpret
+		CachedInterpret = 2 	// decoded instructions from the code cache, one at a time
+	};
+
+	executionEngine engine = Interpret;
+
+	CodeCache codeCache;
+	JIT6502 jit;
+
+	// Position of the cached interpreter inside the current block
+	CodeBlock* cachedBlock = nullptr;
+	size_t cachedIndex = 0;
+	uint32_t cachedGeneration = 0;
+
+	// Spin loop fast-forward. A loop that only reads ram or rom and comes back
+	// to its start with the same registers repeats until an interrupt, so the
+	// cpu stops executing it and only counts cycles until nmi() or wake().
+	bool idleSkip = true;
+	bool idle = false;
+
+	// The loop polls $2002, the bus wakes the cpu whenever the ppu status may change
+	bool idleReadsStatus = false;
+
+	struct IdleStep{
+		uint16_t pc; 		// pc after the instruction
+		uint8_t a, x, y, p, s;
+		uint8_t cycles;
+	};
+
+	static const int maxIdleSteps = 8;
+	static const int maxIdleLoopBytes = 16;
+
+	IdleStep idleSteps[maxIdleSteps];
+	IdleStep idleStart;
+	int idleStepCount = 0;
+	bool idleRecording = false;
+	bool idleRestarted = false; 	// recording began again at the loop head
+	uint16_t idleLoopStart = 0;
+	uint16_t idleLoopEnd = 0; 		// the jump back that started the recording
+	int32_t idleRejected = -1; 		// last loop head that didn't go idle under Recompile, -1 for none
+	uint32_t idlePeriod = 0;
+	uint32_t idleCycles = 0;
+
+#ifdef NES_PROFILE
+	Profiler profiler;
+#endif
+
+	// Binary instruction trace, open() a file and set enabled
+	Tracer tracer;
+	void traceInstruction();
+
+	bool isIdleSafe(uint16_t address, bool& readsStatus);
+	void watchIdleLoop(uint16_t instructionPc, bool safe, bool readsStatus);
+	void stopIdleRecording(uint16_t instructionPc);
+	void wake();
 	
 	enum flag{
 		Carry = 0,
@@ -55,11 +134,19 @@ public:
 		AbsoluteY = 17,
 		Indirect = 18,
 		IndexedIndirect = 19,
-		IndirectIndexed = 20
+		IndirectIndexed = 20,
+		Implied = 21
 	};
 
 	bool pageCrossed = false;
 
+	// Operand bytes already decoded by the code cache, used instead of the bus
+	bool operandPrefetched = false;
+	uint16_t prefetchedOperand = 0;
+
+	uint8_t fetchOperand();
+	uint16_t fetchOperandWord();
+
 	uint16_t getModeInstruction(int);
 
 	void irq();
@@ -286,4 +373,84 @@ public:
 	void clock();
 	
 	void executeInstruction(uint8_t opcode);
+
+	bool runRecompiled(bool watchIdle);
+	bool runCached();
+
+	/*
+	** Cached interpreter handlers, one per operation
+	*/
+
+	uint16_t decodedAddress(const DecodedInstruction& instruction);
+	uint8_t decodedValue(const DecodedInstruction& instruction);
+	void finishDecoded(const DecodedInstruction& instruction);
+
+	static void decodedExecute(CPU6502* cpu, const DecodedInstruction& instruction);
+
+	static void decodedLda(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedLdx(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedLdy(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedLax(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedSta(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedStx(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedSty(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedSax(CPU6502* cpu, const DecodedInstruction& instruction);
+
+	static void decodedTax(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedTay(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedTxa(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedTya(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedTsx(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedTxs(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedPha(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedPhp(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedPla(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedPlp(CPU6502* cpu, const DecodedInstruction& instruction);
+
+	static void decodedAnd(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedEor(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedOra(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedBit(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedAdc(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedSbc(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedCmp(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedCpx(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedCpy(CPU6502* cpu, const DecodedInstruction& instruction);
+
+	static void decodedInc(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedInx(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedIny(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedDec(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedDex(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedDey(CPU6502* cpu, const DecodedInstruction& instruction);
+
+	static void decodedAsl(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedLsr(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedRol(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedRor(CPU6502* cpu, const DecodedInstruction& instruction);
+
+	static void decodedJmp(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedJsr(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedRts(CPU6502* cpu, const DecodedInstruction& instruction);
+
+	static void decodedBcc(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedBcs(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedBeq(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedBmi(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedBne(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedBpl(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedBvc(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedBvs(CPU6502* cpu, const DecodedInstruction& instruction);
+
+	static void decodedClc(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedCld(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedCli(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedClv(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedSec(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedSed(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedSei(CPU6502* cpu, const DecodedInstruction& instruction);
+
+	static void decodedBrk(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedNop(CPU6502* cpu, const DecodedInstruction& instruction);
+	static void decodedRti(CPU6502* cpu, const DecodedInstruction& instruction);
 };
@@ -0,0 +1,150 @@
+#include "debugger.h"
+#include "bus.h"
+
+using namespace std;
+
+uint16_t Debugger::fold(uint16_t address){
+	if(address < 0x2000)
+		return address & 0x7FF;
+
+	if(address < 0x4000)
+		return 0x2000 | (address & 0x7);
+
+	return address;
+}
+
+void Debugger::addBreakpoint(uint16_t address){
+	set(breakpoints, address, true);
+}
+
+void Debugger::removeBreakpoint(uint16_t address){
+	set(breakpoints, address, false);
+}
+
+void Debugger::watch(uint16_t address, uint16_t length, bool reads, bool writes){
+	for(uint32_t i = 0; i < length; i++){
+		if(reads)
+			set(readWatches, address + i, true);
+		if(writes)
+			set(writeWatches, address + i, true);
+	}
+}
+
+void Debugger::unwatch(uint16_t address, uint16_t length){
+	for(uint32_t i = 0; i < length; i++){
+		set(readWatches, address + i, false);
+		set(writeWatches, address + i, false);
+	}
+}
+
+void Debugger::clear(){
+	breakpoints.reset();
+	readWatches.reset();
+	writeWatches.reset();
+	trapCount = 0;
+
+	for(int page = 0; page < 256; page++){
+		bus->traps[page] = 0;
+		bus->mapPage(page);
+	}
+
+	passing = false;
+	stopped = false;
+}
+
+void Debugger::resume(){
+	if(stopped && last.reason == Breakpoint){
+		passing = true;
+		passPc = last.pc;
+	}
+
+	stopped = false;
+}
+
+void Debugger::set(bitset<0x10000>& traps, uint16_t address, bool on){
+	address = fold(address);
+
+	if(traps[address] == on)
+		return;
+
+	traps[address] = on;
+	trapCount += on ? 1 : -1;
+	updatePages(address);
+
+	// A loop being fast-forwarded would run past the new trap
+	bus->cpu.wake();
+}
+
+// Recomputes the traps of every page the folded address shows up in
+void Debugger::updatePages(uint16_t address){
+	uint8_t firstPage = address >> 8;
+	uint8_t lastPage = firstPage;
+	uint8_t pageStep = 1;
+
+	uint16_t start = address & 0xFF00;
+	uint16_t length = 0x100;
+
+	if(address < 0x800){
+		lastPage = firstPage + 0x18;
+		pageStep = 0x8;
+	} else if(address < 0x4000){
+		firstPage = 0x20;
+		lastPage = 0x3F;
+		start = 0x2000;
+		length = 8;
+	}
+
+	uint8_t pageTraps = 0;
+
+	for(uint32_t i = start; i < (uint32_t)start + length; i++){
+		if(readWatches[i])
+			pageTraps |= Bus::ReadTrap;
+		if(writeWatches[i])
+			pageTraps |= Bus::WriteTrap;
+		if(breakpoints[i])
+			pageTraps |= Bus::ExecuteTrap;
+	}
+
+	for(uint32_t page = firstPage; page <= lastPage; page += pageStep){
+		bus->traps[page] = pageTraps;
+		bus->mapPage(page);
+	}
+}
+
+void Debugger::hit(stopReason reason, uint16_t address, uint8_t value){
+	last.reason = reason;
+	last.address = address;
+	last.pc = reason == Breakpoint ? address : bus->cpu.instructionPc;
+	last.value = value;
+	last.cycle = bus->cpu.cycles;
+
+	if(!onStop || onStop(last))
+		stopped = true;
+}
+
+bool Debugger::breakAt(uint16_t pc){
+	if(!breakpoints[fold(pc)])
+		return false;
+
+	if(passing && passPc == pc){
+		passing = false;
+		return false;
+	}
+
+	// Still waiting here for resume
+	if(stopped && last.reason == Breakpoint && last.pc == pc)
+		return true;
+
+	hit(Breakpoint, pc, bus->peek(pc));
+	return stopped;
+}
+
+void Debugger::checkRead(uint16_t address, uint8_t value){
+	if(readWatches[fold(address)])
+		hit(ReadWatch, address, value);
+}
+
+void Debugger::checkWrite(uint16_t address, uint8_t value){
+	if(writeWatches[fold(address)])
+		hit(WriteWatch, address, value);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <bitset>
+#include <functional>
+
+class Bus;
+
+// Execution breakpoints and memory watchpoints. Setting one takes its 256 byte
+// page out of the bus memory map, so only accesses to that page go through a
+// handler that asks the debugger. Every other page keeps its direct mapping
+// and a session costs nothing while no traps are set.
+//
+// Addresses are CPU addresses, a ram or PPU register address also covers its
+// mirrors.
+class Debugger{
+public:
+	enum stopReason{
+		None = 0,
+		Breakpoint = 1, 	// before the instruction at address runs
+		ReadWatch = 2, 		// right after the read, the instruction still finishes
+		WriteWatch = 3 		// right after the write
+	};
+
+	struct Stop{
+		stopReason reason = None;
+		uint16_t address = 0; 	// breakpoint or accessed address
+		uint16_t pc = 0; 		// instruction doing the access
+		uint8_t value = 0; 		// read or written
+		uint64_t cycle = 0; 	// cpu cycle
+	};
+
+private:
+	Bus *bus = nullptr;
+
+	std::bitset<0x10000> breakpoints;
+	std::bitset<0x10000> readWatches;
+	std::bitset<0x10000> writeWatches;
+	int trapCount = 0;
+
+	// The breakpoint resumed from lets the cpu through once
+	bool passing = false;
+	uint16_t passPc = 0;
+
+	void hit(stopReason reason, uint16_t address, uint8_t value);
+	void set(std::bitset<0x10000>& traps, uint16_t address, bool on);
+	void updatePages(uint16_t address);
+public:
+	// Set by a hit. Frontends stop clocking the bus until resume, a bus
+	// clocked anyway keeps the cpu at its breakpoint.
+	bool stopped = false;
+	Stop last;
+
+	// Called on every hit, returning false keeps running (e.g. to only log)
+	std::function<bool(const Stop&)> onStop;
+
+	void connectBus(Bus* b){ bus = b; }
+
+	void addBreakpoint(uint16_t address);
+	void removeBreakpoint(uint16_t address);
+
+	void watch(uint16_t address, uint16_t length = 1, bool reads = true, bool writes = true);
+	void unwatch(uint16_t address, uint16_t length = 1);
+
+	void clear();
+	void resume();
+
+	// Any breakpoint or watchpoint set
+	bool active(){ return trapCount != 0; }
+
+	// Bus and cpu side, only for pages with traps
+	bool breakAt(uint16_t pc);
+	void checkRead(uint16_t address, uint8_t value);
+	void checkWrite(uint16_t address, uint8_t value);
+
+	// One address for all mirrors of ram and the PPU registers
+	static uint16_t fold(uint16_t address);
+};
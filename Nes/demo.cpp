@@ -11,15 +11,58 @@
 
 using namespace std;
 
-int main() {
+// demo [nearest|scale2x|scale3x|xbr] [factor] upscales the window
+int main(int argc, char* argv[]) {
 	Bus bus;
 	bus.cpu.connectBus(&bus);
 	bus.loadCartridge();
 	bus.reset();
+
+	Upscaler* upscaler = nullptr;
+
+	if(argc > 1){
+		string name = argv[1];
+		Upscaler::filter mode = Upscaler::Nearest;
+		int factor = 2;
+
+		if(name == "scale2x"){
+			mode = Upscaler::Scale2x;
+		} else if(name == "scale3x"){
+			mode = Upscaler::Scale3x;
+			factor = 3;
+		} else if(name == "xbr"){
+			mode = Upscaler::XbrLite;
+		} else if(name != "nearest"){
+			cerr << "unknown filter " << name << endl;
+			runProgram = false;
+			return 1;
+		}
+
+		if(argc > 2){
+			factor = atoi(argv[2]);
+		}
+
+		upscaler = new Upscaler();
+		if(!upscaler->setMode(mode, factor)){
+			cerr << name << " can't scale by " << factor << endl;
+			delete upscaler;
+			runProgram = false;
+			return 1;
+		}
+
+		setWindowUpscaler(upscaler);
+	}
 	
 	while(runProgram){
 		bus.clock();
 	}
 
+	setWindowUpscaler(nullptr);
+
+#ifdef NES_PROFILE
+	bus.cpu.profiler.dump("profile.txt");
+	bus.cpu.profiler.report(cout, 20);
+#endif
+
 	return 0;
 }
@@ -0,0 +1,173 @@
+#include "framebuffer.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+void indexedToRgb(const uint8_t* indices, uint32_t* rgb, size_t count, const uint32_t* palette){
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	const __m256i mask = _mm256_set1_epi32(0x3F);
+
+	for(; i + 8 <= count; i += 8){
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(indices + i)));
+		index = _mm256_and_si256(index, mask);
+
+		_mm256_storeu_si256((__m256i*)(rgb + i), _mm256_i32gather_epi32((const int*)palette, index, 4));
+	}
+#endif
+
+	for(; i < count; i++){
+		rgb[i] = palette[indices[i] & 0x3F];
+	}
+}
+
+void indexedToRgb(const uint16_t* indices, uint32_t* rgb, size_t count, const uint32_t* palette){
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	const __m256i mask = _mm256_set1_epi32(0x3F);
+
+	for(; i + 8 <= count; i += 8){
+		__m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(indices + i)));
+		index = _mm256_and_si256(index, mask);
+
+		_mm256_storeu_si256((__m256i*)(rgb + i), _mm256_i32gather_epi32((const int*)palette, index, 4));
+	}
+#endif
+
+	for(; i < count; i++){
+		rgb[i] = palette[indices[i] & 0x3F];
+	}
+}
+
+const int screenWidth = 256;
+const int screenHeight = 240;
+
+bool Observation::configure(int width, int height, int cropTop, int cropBottom, bool areaAverage){
+	if(width <= 0 || height <= 0 || cropTop < 0 || cropBottom < 0 || cropTop + cropBottom >= screenHeight)
+		return false;
+
+	this->width = width;
+	this->height = height;
+	this->cropTop = cropTop;
+	this->cropBottom = cropBottom;
+	this->areaAverage = areaAverage;
+
+	plane.assign(screenWidth * screenHeight, 0);
+	rowSum.assign(screenWidth, 0);
+
+	// Source columns and rows covered by each output pixel
+	int rows = screenHeight - cropTop - cropBottom;
+
+	columnStart.resize(width + 1);
+	for(int x = 0; x <= width; x++){
+		columnStart[x] = x * screenWidth / width;
+	}
+
+	rowStart.resize(height + 1);
+	for(int y = 0; y <= height; y++){
+		rowStart[y] = cropTop + y * rows / height;
+	}
+
+	return true;
+}
+
+void Observation::setPalette(const uint32_t* palette){
+	for(int i = 0; i < 64; i++){
+		uint32_t r = (palette[i] >> 16) & 0xFF;
+		uint32_t g = (palette[i] >> 8) & 0xFF;
+		uint32_t b = palette[i] & 0xFF;
+
+		luma[i] = (r * 299 + g * 587 + b * 114) / 1000;
+	}
+}
+
+void Observation::fromIndexed(const uint8_t* indices, uint8_t* out){
+	for(int i = cropTop * screenWidth; i < (screenHeight - cropBottom) * screenWidth; i++){
+		plane[i] = luma[indices[i] & 0x3F];
+	}
+
+	resample(out);
+}
+
+void Observation::fromIndexed(const uint16_t* indices, uint8_t* out){
+	for(int i = cropTop * screenWidth; i < (screenHeight - cropBottom) * screenWidth; i++){
+		plane[i] = luma[indices[i] & 0x3F];
+	}
+
+	resample(out);
+}
+
+void Observation::fromRgb(const uint32_t* rgb, uint8_t* out){
+	for(int i = cropTop * screenWidth; i < (screenHeight - cropBottom) * screenWidth; i++){
+		uint32_t r = (rgb[i] >> 16) & 0xFF;
+		uint32_t g = (rgb[i] >> 8) & 0xFF;
+		uint32_t b = rgb[i] & 0xFF;
+
+		plane[i] = (r * 299 + g * 587 + b * 114) / 1000;
+	}
+
+	resample(out);
+}
+
+void Observation::resample(uint8_t* out){
+	for(int y = 0; y < height; y++){
+		int top = rowStart[y];
+		int bottom = rowStart[y + 1] > top ? rowStart[y + 1] : top + 1;
+
+		if(!areaAverage){
+			const uint8_t* row = &plane[((top + bottom) / 2) * screenWidth];
+
+			for(int x = 0; x < width; x++){
+				out[y * width + x] = row[(columnStart[x] + columnStart[x + 1]) / 2];
+			}
+			continue;
+		}
+
+		// Sum the rows of the box first, 16 columns at a time
+		int column = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+		const __m128i zero = _mm_setzero_si128();
+
+		for(; column < screenWidth; column += 16){
+			__m128i lo = _mm_setzero_si128();
+			__m128i hi = _mm_setzero_si128();
+
+			for(int row = top; row < bottom; row++){
+				__m128i bytes = _mm_loadu_si128((const __m128i*)&plane[row * screenWidth + column]);
+				lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(bytes, zero));
+				hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(bytes, zero));
+			}
+
+			_mm_storeu_si128((__m128i*)&rowSum[column], lo);
+			_mm_storeu_si128((__m128i*)&rowSum[column + 8], hi);
+		}
+#endif
+
+		for(; column < screenWidth; column++){
+			uint16_t sum = 0;
+			for(int row = top; row < bottom; row++){
+				sum += plane[row * screenWidth + column];
+			}
+			rowSum[column] = sum;
+		}
+
+		for(int x = 0; x < width; x++){
+			int left = columnStart[x];
+			int right = columnStart[x + 1] > left ? columnStart[x + 1] : left + 1;
+
+			uint32_t sum = 0;
+			for(int i = left; i < right; i++){
+				sum += rowSum[i];
+			}
+
+			uint32_t count = (right - left) * (bottom - top);
+			out[y * width + x] = (sum + count / 2) / count;
+		}
+	}
+}
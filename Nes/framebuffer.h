@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Post-pass turning palette indexed pixels into RGB, SIMD when built with AVX2.
+// Indexed8 pixels are the 6 bit palette index. Indexed16 pixels also carry the
+// PPUMASK emphasis bits in bits 6-8; they are not applied to the RGB colors.
+void indexedToRgb(const uint8_t* indices, uint32_t* rgb, size_t count, const uint32_t* palette);
+void indexedToRgb(const uint16_t* indices, uint32_t* rgb, size_t count, const uint32_t* palette);
+
+// Reduced greyscale copy of the screen for agents, e.g. 84x84 or 128x120.
+// Pixels go through a luma table per palette entry, overscan rows can be
+// cropped, and each output pixel is the area average or the nearest source pixel.
+class Observation{
+	std::vector<uint8_t> plane; 		// luma of the uncropped rows
+	std::vector<uint16_t> rowSum;
+	std::vector<int> columnStart;
+	std::vector<int> rowStart;
+
+	void resample(uint8_t* out);
+public:
+	int width = 84;
+	int height = 84;
+	int cropTop = 8;
+	int cropBottom = 8;
+	bool areaAverage = true;
+
+	uint8_t luma[64];
+
+	// False, keeping the old settings, for an empty size or crops that leave no rows
+	bool configure(int width, int height, int cropTop, int cropBottom, bool areaAverage);
+	void setPalette(const uint32_t* palette);
+
+	// out holds width * height bytes
+	void fromIndexed(const uint8_t* indices, uint8_t* out);
+	void fromIndexed(const uint16_t* indices, uint8_t* out);
+	void fromRgb(const uint32_t* rgb, uint8_t* out);
+};
@@ -0,0 +1,37 @@
+#include "frameskip.h"
+
+using namespace std;
+
+bool AutoFrameSkip::skipNext(){
+	auto now = chrono::steady_clock::now();
+
+	if(!started){
+		start = now;
+		frames = 0;
+		skippedInRow = 0;
+		started = true;
+		return false;
+	}
+
+	frames++;
+
+	double emulated = frames * frameTime;
+	double elapsed = chrono::duration<double>(now - start).count();
+	double lag = elapsed - emulated;
+
+	// Paused or stalled, pretend the schedule starts now
+	if(lag > maxLag){
+		start = now;
+		frames = 0;
+		skippedInRow = 0;
+		return false;
+	}
+
+	if(lag > frameTime && skippedInRow < maxSkip){
+		skippedInRow++;
+		return true;
+	}
+
+	skippedInRow = 0;
+	return false;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+// Decides per frame whether the ppu may skip pixel output, so emulation keeps
+// up with real time when the host is too slow to render every frame.
+class AutoFrameSkip{
+	std::chrono::steady_clock::time_point start;
+	uint64_t frames = 0;
+	int skippedInRow = 0;
+	bool started = false;
+public:
+	bool enabled = false;
+
+	// Every maxSkip + 1 frame is rendered even when far behind
+	int maxSkip = 4;
+
+	// NTSC frame rate
+	double frameTime = 1.0 / 60.0988;
+
+	// Further behind than this the schedule is reset instead of caught up
+	double maxLag = 0.25;
+
+	// Called when a frame finishes, true when the next one should be skipped
+	bool skipNext();
+
+	void restart(){ started = false; }
+};
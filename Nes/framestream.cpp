@@ -0,0 +1,516 @@
+#include "framestream.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+static const int tilesX = FrameStreamWriter::width / 8;
+static const int tilesY = FrameStreamWriter::height / 8;
+static const size_t frameSize = FrameStreamWriter::width * FrameStreamWriter::height;
+static const size_t maskSize = tilesX * tilesY / 8;
+
+static const uint64_t keyFlag = 1ull << 63;
+
+static void putLittle(FILE* file, uint64_t value, int bytes){
+	uint8_t buffer[8];
+	for(int i = 0; i < bytes; i++){
+		buffer[i] = (uint8_t)(value >> (8 * i));
+	}
+	fwrite(buffer, 1, bytes, file);
+}
+
+static bool getLittle(FILE* file, uint64_t& value, int bytes){
+	uint8_t buffer[8];
+	if(fread(buffer, 1, bytes, file) != (size_t)bytes)
+		return false;
+
+	value = 0;
+	for(int i = 0; i < bytes; i++){
+		value |= (uint64_t)buffer[i] << (8 * i);
+	}
+	return true;
+}
+
+// Streams of millions of frames go past 2 GB
+static int seek(FILE* file, uint64_t offset){
+#if defined(_WIN32)
+	return _fseeki64(file, (__int64)offset, SEEK_SET);
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+// Sequences of a token (literal count in the high nibble, match length - 4 in
+// the low one, 15 meaning more length bytes follow, each 255 meaning another),
+// the literals, and a 16 bit offset back to the match. The last sequence has
+// literals only.
+size_t lzBound(size_t size){
+	return size + size / 255 + 16;
+}
+
+static uint32_t read32(const uint8_t* p){
+	uint32_t value;
+	memcpy(&value, p, 4);
+	return value;
+}
+
+size_t lzCompress(const uint8_t* in, size_t size, uint8_t* out){
+	const int hashBits = 14;
+
+	// Positions + 1 of the last 4 byte sequence with each hash
+	static thread_local uint32_t table[1 << hashBits];
+	memset(table, 0, sizeof(table));
+
+	uint8_t* op = out;
+	size_t anchor = 0;
+	size_t i = 0;
+
+	auto putLength = [&](size_t length){
+		while(length >= 255){
+			*op++ = 255;
+			length -= 255;
+		}
+		*op++ = (uint8_t)length;
+	};
+
+	auto putLiterals = [&](size_t literals, uint8_t matchNibble){
+		*op++ = (uint8_t)((literals < 15 ? literals : 15) << 4 | matchNibble);
+		if(literals >= 15)
+			putLength(literals - 15);
+
+		memcpy(op, in + anchor, literals);
+		op += literals;
+	};
+
+	while(i + 4 <= size){
+		uint32_t sequence = read32(in + i);
+		uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+		size_t candidate = table[hash];
+		table[hash] = (uint32_t)i + 1;
+
+		if(candidate == 0 || i - (candidate - 1) > 0xFFFF || read32(in + candidate - 1) != sequence){
+			i++;
+			continue;
+		}
+
+		size_t match = candidate - 1;
+		size_t length = 4;
+		while(i + length < size && in[match + length] == in[i + length]){
+			length++;
+		}
+
+		putLiterals(i - anchor, (uint8_t)(length - 4 < 15 ? length - 4 : 15));
+
+		size_t offset = i - match;
+		*op++ = (uint8_t)offset;
+		*op++ = (uint8_t)(offset >> 8);
+
+		if(length - 4 >= 15)
+			putLength(length - 4 - 15);
+
+		i += length;
+		anchor = i;
+	}
+
+	putLiterals(size - anchor, 0);
+
+	return op - out;
+}
+
+bool lzDecompress(const uint8_t* in, size_t size, uint8_t* out, size_t outSize){
+	const uint8_t* ip = in;
+	const uint8_t* end = in + size;
+	uint8_t* op = out;
+	uint8_t* outEnd = out + outSize;
+
+	auto getLength = [&](size_t& length){
+		uint8_t byte;
+		do{
+			if(ip >= end)
+				return false;
+
+			byte = *ip++;
+			length += byte;
+		} while(byte == 255);
+
+		return true;
+	};
+
+	while(ip < end){
+		uint8_t token = *ip++;
+
+		size_t literals = token >> 4;
+		if(literals == 15 && !getLength(literals))
+			return false;
+
+		if((size_t)(end - ip) < literals || (size_t)(outEnd - op) < literals)
+			return false;
+
+		memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		if(ip == end)
+			break;
+
+		if(end - ip < 2)
+			return false;
+
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		size_t length = token & 0xF;
+		if(length == 15 && !getLength(length))
+			return false;
+		length += 4;
+
+		if(offset == 0 || offset > (size_t)(op - out) || (size_t)(outEnd - op) < length)
+			return false;
+
+		const uint8_t* match = op - offset;
+
+		if(offset == 1){
+			memset(op, *match, length);
+		} else if(offset >= length){
+			memcpy(op, match, length);
+		} else {
+			for(size_t k = 0; k < length; k++){
+				op[k] = match[k];
+			}
+		}
+
+		op += length;
+	}
+
+	return op == outEnd;
+}
+
+FrameStreamWriter::~FrameStreamWriter(){
+	close();
+}
+
+bool FrameStreamWriter::open(const string& path){
+	close();
+
+	file = fopen(path.c_str(), "wb");
+	index = fopen((path + ".idx").c_str(), "wb");
+
+	if(file == nullptr || index == nullptr){
+		cerr << "Cannot open frame stream " << path << endl;
+
+		if(file != nullptr)
+			fclose(file);
+		if(index != nullptr)
+			fclose(index);
+
+		file = index = nullptr;
+		return false;
+	}
+
+	setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+	if(keyInterval < 1)
+		keyInterval = 1;
+
+	fwrite("NESFRAME", 1, 8, file);
+	putLittle(file, width, 2);
+	putLittle(file, height, 2);
+	putLittle(file, keyInterval, 4);
+	offset = 16;
+
+	fwrite("NESINDEX", 1, 8, index);
+
+	queue.assign(queueSize < 1 ? 1 : queueSize, Entry());
+	head = 0;
+	count = 0;
+
+	previous.assign(frameSize, 0);
+	written = 0;
+
+	frames = 0;
+	rawBytes = 0;
+	compressedBytes = 0;
+
+	running = true;
+	writer = thread(&FrameStreamWriter::run, this);
+
+	return true;
+}
+
+void FrameStreamWriter::close(){
+	{
+		lock_guard<mutex> lock(queueMutex);
+		if(!running)
+			return;
+
+		running = false;
+	}
+
+	queueReady.notify_one();
+	writer.join();
+
+	fclose(file);
+	fclose(index);
+	file = index = nullptr;
+}
+
+// Only the emulation thread fills slots, and the writer doesn't touch one
+// until publish
+FrameStreamWriter::Entry* FrameStreamWriter::reserve(){
+	unique_lock<mutex> lock(queueMutex);
+	queueSpace.wait(lock, [&](){ return count < (int)queue.size() || !running; });
+
+	if(!running)
+		return nullptr;
+
+	return &queue[(head + count) % queue.size()];
+}
+
+void FrameStreamWriter::publish(){
+	{
+		lock_guard<mutex> lock(queueMutex);
+		count++;
+	}
+
+	queueReady.notify_one();
+}
+
+void FrameStreamWriter::push(const uint8_t* indices){
+	Entry* entry = reserve();
+	if(entry == nullptr)
+		return;
+
+	entry->repeat = false;
+	entry->indices.resize(frameSize);
+	for(size_t i = 0; i < frameSize; i++){
+		entry->indices[i] = indices[i] & 0x3F;
+	}
+	publish();
+}
+
+void FrameStreamWriter::push(const uint16_t* indices){
+	Entry* entry = reserve();
+	if(entry == nullptr)
+		return;
+
+	entry->repeat = false;
+	entry->indices.resize(frameSize);
+	for(size_t i = 0; i < frameSize; i++){
+		entry->indices[i] = indices[i] & 0x3F;
+	}
+	publish();
+}
+
+void FrameStreamWriter::repeat(){
+	Entry* entry = reserve();
+	if(entry == nullptr)
+		return;
+
+	entry->repeat = true;
+	publish();
+}
+
+void FrameStreamWriter::write(const Entry& entry){
+	const uint8_t* frame = entry.repeat ? previous.data() : entry.indices.data();
+	bool key = written % keyInterval == 0;
+
+	if(key){
+		raw.assign(frame, frame + frameSize);
+	} else {
+		raw.assign(maskSize, 0);
+
+		for(int tile = 0; tile < tilesX * tilesY; tile++){
+			size_t start = (tile / tilesX) * 8 * width + (tile % tilesX) * 8;
+
+			bool changed = false;
+			for(int row = 0; row < 8 && !changed; row++){
+				changed = memcmp(frame + start + row * width, &previous[start + row * width], 8) != 0;
+			}
+
+			if(!changed)
+				continue;
+
+			raw[tile / 8] |= 1 << (tile % 8);
+
+			for(int row = 0; row < 8; row++){
+				for(int x = 0; x < 8; x++){
+					size_t i = start + row * width + x;
+					raw.push_back(frame[i] ^ previous[i]);
+				}
+			}
+		}
+	}
+
+	compressed.resize(lzBound(raw.size()));
+	size_t size = lzCompress(raw.data(), raw.size(), compressed.data());
+
+	putLittle(index, offset | (key ? keyFlag : 0), 8);
+
+	putLittle(file, size, 4);
+	putLittle(file, raw.size(), 4);
+	fwrite(compressed.data(), 1, size, file);
+	offset += 8 + size;
+
+	if(!entry.repeat)
+		memcpy(previous.data(), frame, frameSize);
+
+	written++;
+	frames++;
+	rawBytes += frameSize;
+	compressedBytes += 8 + size;
+}
+
+void FrameStreamWriter::run(){
+	while(true){
+		Entry* entry;
+
+		{
+			unique_lock<mutex> lock(queueMutex);
+			queueReady.wait(lock, [&](){ return count > 0 || !running; });
+
+			// Closing still writes what was queued
+			if(count == 0)
+				break;
+
+			entry = &queue[head];
+		}
+
+		write(*entry);
+
+		{
+			lock_guard<mutex> lock(queueMutex);
+			head = (head + 1) % queue.size();
+			count--;
+		}
+
+		queueSpace.notify_one();
+	}
+
+	fflush(file);
+	fflush(index);
+}
+
+FrameStreamReader::~FrameStreamReader(){
+	close();
+}
+
+bool FrameStreamReader::open(const string& path){
+	close();
+
+	FILE* indexFile = fopen((path + ".idx").c_str(), "rb");
+	file = fopen(path.c_str(), "rb");
+
+	char magic[8];
+	uint64_t width, height, interval;
+
+	bool valid = file != nullptr && indexFile != nullptr
+		&& fread(magic, 1, 8, file) == 8 && memcmp(magic, "NESFRAME", 8) == 0
+		&& getLittle(file, width, 2) && getLittle(file, height, 2) && getLittle(file, interval, 4)
+		&& width == FrameStreamWriter::width && height == FrameStreamWriter::height && interval > 0
+		&& fread(magic, 1, 8, indexFile) == 8 && memcmp(magic, "NESINDEX", 8) == 0;
+
+	if(valid){
+		uint64_t entry;
+		while(getLittle(indexFile, entry, 8)){
+			offsets.push_back(entry);
+		}
+
+		valid = offsets.empty() || (offsets[0] & keyFlag) != 0;
+	}
+
+	if(indexFile != nullptr)
+		fclose(indexFile);
+
+	if(!valid){
+		cerr << "Cannot read frame stream " << path << endl;
+		close();
+		return false;
+	}
+
+	current.assign(frameSize, 0);
+	currentFrame = -1;
+
+	return true;
+}
+
+void FrameStreamReader::close(){
+	if(file != nullptr)
+		fclose(file);
+
+	file = nullptr;
+	offsets.clear();
+	currentFrame = -1;
+}
+
+// Decodes frame on top of current, which holds the frame before it unless
+// frame is a keyframe
+bool FrameStreamReader::apply(uint32_t frame){
+	uint64_t size, rawSize;
+
+	if(seek(file, offsets[frame] & ~keyFlag) != 0
+			|| !getLittle(file, size, 4) || !getLittle(file, rawSize, 4)
+			|| size > lzBound(frameSize + maskSize + frameSize) || rawSize > maskSize + frameSize){
+		return false;
+	}
+
+	compressed.resize(size);
+	raw.resize(rawSize);
+
+	if(fread(compressed.data(), 1, size, file) != size || !lzDecompress(compressed.data(), size, raw.data(), rawSize))
+		return false;
+
+	if(offsets[frame] & keyFlag){
+		if(rawSize != frameSize)
+			return false;
+
+		current = raw;
+	} else {
+		if(rawSize < maskSize)
+			return false;
+
+		const uint8_t* tile = raw.data() + maskSize;
+
+		for(int t = 0; t < tilesX * tilesY; t++){
+			if(!(raw[t / 8] & (1 << (t % 8))))
+				continue;
+
+			if(tile + 64 > raw.data() + rawSize)
+				return false;
+
+			size_t start = (t / tilesX) * 8 * FrameStreamWriter::width + (t % tilesX) * 8;
+
+			for(int row = 0; row < 8; row++){
+				for(int x = 0; x < 8; x++){
+					current[start + row * FrameStreamWriter::width + x] ^= *tile++;
+				}
+			}
+		}
+	}
+
+	currentFrame = frame;
+	return true;
+}
+
+bool FrameStreamReader::read(uint32_t frame, uint8_t* indices){
+	if(file == nullptr || frame >= offsets.size())
+		return false;
+
+	uint32_t key = frame;
+	while(!(offsets[key] & keyFlag)){
+		key--;
+	}
+
+	// Reading on from the last frame skips decoding the keyframe again
+	uint32_t first = (currentFrame >= key && currentFrame <= frame) ? (uint32_t)currentFrame + 1 : key;
+
+	for(uint32_t f = first; f <= frame; f++){
+		if(!apply(f)){
+			currentFrame = -1;
+			return false;
+		}
+	}
+
+	memcpy(indices, current.data(), frameSize);
+	return true;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Lossless stream of palette indexed 256x240 frames for datasets, one palette
+// index byte per pixel (emphasis bits of Indexed16 frames are not kept).
+//
+// Every keyInterval frames is a keyframe holding the whole frame. The frames
+// in between hold only the 8x8 tiles that changed, as a 960 bit tile mask and
+// the changed tiles XORed with the previous frame. Every record is LZ
+// compressed on a background thread.
+//
+// <path>          "NESFRAME", width, height, key interval (u16 u16 u32), then
+//                 per frame: u32 compressed size, u32 raw size, compressed bytes
+// <path>.idx      "NESINDEX", then per frame a u64 record offset, top bit set
+//                 for keyframes
+class FrameStreamWriter{
+	struct Entry{
+		std::vector<uint8_t> indices;
+		bool repeat = false;
+	};
+
+	FILE* file = nullptr;
+	FILE* index = nullptr;
+	uint64_t offset = 0;
+
+	// Ring of queueSize entries, head is the next to compress
+	std::vector<Entry> queue;
+	int head = 0;
+	int count = 0;
+
+	std::thread writer;
+	std::mutex queueMutex;
+	std::condition_variable queueReady;
+	std::condition_variable queueSpace;
+	bool running = false;
+
+	// Writer thread
+	std::vector<uint8_t> previous;
+	std::vector<uint8_t> raw;
+	std::vector<uint8_t> compressed;
+	uint32_t written = 0;
+
+	Entry* reserve();
+	void publish();
+
+	void run();
+	void write(const Entry& entry);
+public:
+	static const int width = 256;
+	static const int height = 240;
+
+	~FrameStreamWriter();
+
+	// Set before opening
+	uint32_t keyInterval = 60;
+	int queueSize = 8;
+
+	std::atomic<uint64_t> frames{0};
+	std::atomic<uint64_t> rawBytes{0};
+	std::atomic<uint64_t> compressedBytes{0};
+
+	bool open(const std::string& path);
+
+	// Compresses what is still queued and closes both files
+	void close();
+
+	bool isOpen(){ return running; }
+
+	// Waits for room when the queue is full, a dataset can't lose frames
+	void push(const uint8_t* indices);
+	void push(const uint16_t* indices);
+
+	// Same frame again, e.g. one the ppu skipped rendering
+	void repeat();
+};
+
+// Decodes any frame from its keyframe on, or from the last frame read when
+// reading forward within the same key interval
+class FrameStreamReader{
+	FILE* file = nullptr;
+	std::vector<uint64_t> offsets;
+
+	std::vector<uint8_t> current;
+	int64_t currentFrame = -1;
+
+	std::vector<uint8_t> raw;
+	std::vector<uint8_t> compressed;
+
+	bool apply(uint32_t frame);
+public:
+	~FrameStreamReader();
+
+	bool open(const std::string& path);
+	void close();
+
+	uint32_t frames(){ return (uint32_t)offsets.size(); }
+
+	// indices holds 256x240 bytes
+	bool read(uint32_t frame, uint8_t* indices);
+};
+
+// LZ77 byte codec of the stream records. lzCompress needs lzBound(size) bytes
+// of output, lzDecompress returns false on corrupt input.
+size_t lzBound(size_t size);
+size_t lzCompress(const uint8_t* in, size_t size, uint8_t* out);
+bool lzDecompress(const uint8_t* in, size_t size, uint8_t* out, size_t outSize);
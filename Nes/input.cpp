@@ -0,0 +1,90 @@
+#include "input.h"
+
+using namespace std;
+
+bool InputQueue::push(const InputEvent& event){
+	uint32_t next = tail.load(memory_order_relaxed);
+
+	if(next - head.load(memory_order_acquire) == capacity){
+		dropped++;
+		return false;
+	}
+
+	events[next % capacity] = event;
+	tail.store(next + 1, memory_order_release);
+	return true;
+}
+
+bool InputQueue::press(uint8_t port, uint8_t buttons){
+	InputEvent event;
+	event.type = InputEvent::Press;
+	event.port = port;
+	event.buttons = buttons;
+	event.time = InputEvent::now();
+
+	return push(event);
+}
+
+bool InputQueue::release(uint8_t port, uint8_t buttons){
+	InputEvent event;
+	event.type = InputEvent::Release;
+	event.port = port;
+	event.buttons = buttons;
+	event.time = InputEvent::now();
+
+	return push(event);
+}
+
+bool InputQueue::set(uint8_t port, uint8_t buttons, uint32_t frame){
+	InputEvent event;
+	event.type = InputEvent::Set;
+	event.port = port;
+	event.buttons = buttons;
+	event.frame = frame;
+	event.time = InputEvent::now();
+
+	return push(event);
+}
+
+uint64_t InputQueue::drain(uint32_t frame, uint8_t ports[2]){
+	uint32_t first = head.load(memory_order_relaxed);
+	uint32_t last = tail.load(memory_order_acquire);
+
+	// Buttons that went down in this drain
+	uint8_t pressed[2] = { 0, 0 };
+	uint64_t time = 0;
+
+	for(; first != last; first++){
+		const InputEvent& event = events[first % capacity];
+
+		if(event.frame > frame)
+			break;
+
+		int port = event.port & 1;
+		uint8_t state = ports[port];
+
+		if(event.type == InputEvent::Press){
+			state |= event.buttons;
+		} else if(event.type == InputEvent::Release){
+			state &= ~event.buttons;
+		} else {
+			state = event.buttons;
+		}
+
+		if(ports[port] & ~state & pressed[port])
+			break;
+
+		pressed[port] |= state & ~ports[port];
+		ports[port] = state;
+
+		if(time == 0)
+			time = event.time;
+	}
+
+	head.store(first, memory_order_release);
+	return time;
+}
+
+void InputQueue::clear(){
+	head.store(tail.load(memory_order_acquire), memory_order_release);
+}
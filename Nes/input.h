@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+
+struct InputEvent{
+	enum button{
+		Right = 0x01,
+		Left = 0x02,
+		Down = 0x04,
+		Up = 0x08,
+		Start = 0x10,
+		Select = 0x20,
+		B = 0x40,
+		A = 0x80
+	};
+
+	enum kind{
+		Press = 0, 		// buttons go down
+		Release = 1, 	// buttons go up
+		Set = 2 		// buttons are the whole state of the port
+	};
+
+	uint8_t type = Set;
+	uint8_t port = 0;
+	uint8_t buttons = 0;
+
+	// Applies at the first drain in this ppu frame or later, 0 for the next one
+	uint32_t frame = 0;
+
+	// Host time the event happened, in steady clock nanoseconds
+	uint64_t time = 0;
+
+	static uint64_t now(){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+};
+
+// Lock-free queue from one producer thread (a window, a frontend) to the
+// emulation thread. The bus drains it at one defined point, the start of each
+// frame or each controller strobe, so input always lands on the same emulated
+// cycle for the same events.
+class InputQueue{
+	static const uint32_t capacity = 256;
+
+	InputEvent events[capacity];
+	std::atomic<uint32_t> head{0}; 		// next to drain, owned by the consumer
+	std::atomic<uint32_t> tail{0}; 		// next to fill, owned by the producer
+public:
+	// Events lost to a full queue
+	std::atomic<uint64_t> dropped{0};
+
+	// Producer side, false when full
+	bool push(const InputEvent& event);
+
+	bool press(uint8_t port, uint8_t buttons);
+	bool release(uint8_t port, uint8_t buttons);
+	bool set(uint8_t port, uint8_t buttons, uint32_t frame = 0);
+
+	// Consumer side. Applies events due by frame to the port states, in order.
+	// A press and a release of the same button never take effect in one drain:
+	// draining stops at the release so the press is seen for at least a frame.
+	// Returns the host time of the first event applied, 0 for none.
+	uint64_t drain(uint32_t frame, uint8_t ports[2]);
+
+	void clear();
+};
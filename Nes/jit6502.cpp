@@ -0,0 +1,842 @@
+#include "jit6502.h"
+#include "codecache.h"
+#include "cpu6502.h"
+#include "bus.h"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X64 1
+#endif
+
+using namespace std;
+
+// Accesses the page maps can't serve directly, called from native code
+static uint8_t busRead(Bus* bus, uint16_t address){
+	return bus->cpuRead(address);
+}
+
+static void busWrite(Bus* bus, uint16_t address, uint8_t value){
+	bus->cpuWrite(address, value);
+}
+
+static void invalidateCode(CodeCache* cache, uint16_t address){
+	cache->invalidate(address);
+}
+
+JIT6502::JIT6502(){
+}
+
+JIT6502::~JIT6502(){
+	if(code == nullptr)
+		return;
+
+#if defined(_WIN32)
+	VirtualFree(code, 0, MEM_RELEASE);
+#else
+	munmap(code, codeSize);
+#endif
+}
+
+bool JIT6502::available(){
+#ifdef JIT_X64
+	return true;
+#else
+	return false;
+#endif
+}
+
+void JIT6502::emit(uint8_t byte){
+	buffer.push_back(byte);
+}
+
+void JIT6502::emit16(uint16_t value){
+	emit(value & 0xFF);
+	emit(value >> 8);
+}
+
+void JIT6502::emit32(uint32_t value){
+	emit16(value & 0xFFFF);
+	emit16(value >> 16);
+}
+
+void JIT6502::emit64(uint64_t value){
+	emit32(value & 0xFFFFFFFF);
+	emit32(value >> 32);
+}
+
+// condition is the second byte of a 0F 8x jcc, 0 for jmp. Returns where the
+// displacement goes.
+size_t JIT6502::emitJump(uint8_t condition){
+	if(condition == 0){
+		emit(0xE9);
+	} else {
+		emit(0x0F); emit(condition);
+	}
+
+	size_t jump = buffer.size();
+	emit32(0);
+	return jump;
+}
+
+void JIT6502::land(size_t jump){
+	uint32_t displacement = (uint32_t)(buffer.size() - (jump + 4));
+	memcpy(&buffer[jump], &displacement, 4);
+}
+
+int32_t JIT6502::offset(void* member){
+	return (int32_t)((uint8_t*)member - (uint8_t*)cpu);
+}
+
+// movzx eax, byte [rbx + reg]
+void JIT6502::emitLoadRegister(void* reg){
+	emit(0x0F); emit(0xB6); emit(0x83); emit32(offset(reg));
+}
+
+// mov byte [rbx + reg], al
+void JIT6502::emitStoreRegister(void* reg){
+	emit(0x88); emit(0x83); emit32(offset(reg));
+}
+
+// Status keeps the bits in keep and takes the rest from cl
+void JIT6502::emitUpdateFlags(uint8_t keep){
+	int32_t p = offset(&cpu->p);
+	emit(0x80); emit(0xA3); emit32(p); emit(keep); 		// and byte [rbx + p], keep
+	emit(0x08); emit(0x8B); emit32(p); 					// or byte [rbx + p], cl
+}
+
+// Z and N from al
+void JIT6502::emitZeroNegative(){
+	emit(0x84); emit(0xC0); 								// test al, al
+	emit(0x0F); emit(0x94); emit(0xC1); 					// sete cl
+	emit(0x00); emit(0xC9); 								// add cl, cl
+	emit(0x88); emit(0xC2); 								// mov dl, al
+	emit(0x80); emit(0xE2); emit(0x80); 					// and dl, 0x80
+	emit(0x08); emit(0xD1); 								// or cl, dl
+	emitUpdateFlags(0x7D);
+}
+
+// C from the host carry, inverted for subtraction borrows, Z and N from al
+void JIT6502::emitCarryZeroNegative(bool inverted){
+	emit(0x0F); emit(inverted ? 0x93 : 0x92); emit(0xC1); // setnc cl / setc cl
+	emit(0x84); emit(0xC0); 								// test al, al
+	emit(0x0F); emit(0x94); emit(0xC2); 					// sete dl
+	emit(0x00); emit(0xD2); 								// add dl, dl
+	emit(0x08); emit(0xD1); 								// or cl, dl
+	emit(0x88); emit(0xC2); 								// mov dl, al
+	emit(0x80); emit(0xE2); emit(0x80); 					// and dl, 0x80
+	emit(0x08); emit(0xD1); 								// or cl, dl
+	emitUpdateFlags(0x7C);
+}
+
+// add byte [rbx + waitCycle], count
+void JIT6502::emitAddCycles(uint8_t count){
+	emit(0x80); emit(0x83); emit32(offset(&cpu->waitCycle)); emit(count);
+}
+
+// helper(object, edx, al), the result comes back in al
+void JIT6502::emitHelperCall(void* helper, void* object){
+#if defined(_WIN32)
+	emit(0x41); emit(0x89); emit(0xC0); 					// mov r8d, eax
+	emit(0x48); emit(0xB9); emit64((uint64_t)(uintptr_t)object); 	// mov rcx, object
+#else
+	emit(0x89); emit(0xD6); 								// mov esi, edx
+	emit(0x89); emit(0xC2); 								// mov edx, eax
+	emit(0x48); emit(0xBF); emit64((uint64_t)(uintptr_t)object); 	// mov rdi, object
+#endif
+	emit(0x48); emit(0xB8); emit64((uint64_t)(uintptr_t)helper); 	// mov rax, helper
+	emit(0xFF); emit(0xD0); 								// call rax
+}
+
+// Where an indexed access can land, decides how it reaches memory
+enum addressRange{
+	ZeroPageRange, 		// zero page, straight into ram
+	RamRange, 			// ram or its mirrors
+	AnyRange 			// anything, through the page maps
+};
+
+static addressRange rangeOf(const DecodedInstruction& instruction){
+	switch(instruction.mode){
+		case CPU6502::ZeroPage:
+		case CPU6502::ZeroPageX:
+		case CPU6502::ZeroPageY:
+			return ZeroPageRange;
+
+		case CPU6502::Absolute:
+			return instruction.operand <= 0x1FFF ? RamRange : AnyRange;
+
+		case CPU6502::AbsoluteX:
+		case CPU6502::AbsoluteY:
+			return instruction.operand + 0xFF <= 0x1FFF ? RamRange : AnyRange;
+	}
+
+	return AnyRange;
+}
+
+static bool constantAddress(const DecodedInstruction& instruction){
+	return instruction.mode == CPU6502::ZeroPage || instruction.mode == CPU6502::Absolute;
+}
+
+// edx = effective address of the indexed and indirect modes, plus the page
+// crossing cycle for the instructions that take it
+void JIT6502::emitAddress(const DecodedInstruction& instruction){
+	uint16_t operand = instruction.operand;
+	bool pageCross = (instruction.flags & CodeCache::PageCross) && instruction.pageCrossPossible;
+	int32_t waitCycle = offset(&cpu->waitCycle);
+	uint8_t* ram = bus->ram();
+
+	switch(instruction.mode){
+		case CPU6502::ZeroPageX:
+		case CPU6502::ZeroPageY:
+			emit(0x0F); emit(0xB6); emit(0x93); 			// movzx edx, byte [rbx + index]
+			emit32(offset(instruction.mode == CPU6502::ZeroPageX ? &cpu->x : &cpu->y));
+			emit(0x80); emit(0xC2); emit(operand & 0xFF); 	// add dl, operand
+			emit(0x0F); emit(0xB6); emit(0xD2); 			// movzx edx, dl
+			break;
+
+		case CPU6502::AbsoluteX:
+		case CPU6502::AbsoluteY:
+			emit(0x0F); emit(0xB6); emit(0x93); 			// movzx edx, byte [rbx + index]
+			emit32(offset(instruction.mode == CPU6502::AbsoluteX ? &cpu->x : &cpu->y));
+			emit(0x81); emit(0xC2); emit32(operand); 		// add edx, operand
+
+			if(pageCross){
+				emit(0x81); emit(0xFA); emit32(operand | 0xFF); 	// cmp edx, operand | 0xFF
+				emit(0x76); emit(0x06); 							// jbe +6
+				emit(0xFE); emit(0x83); emit32(waitCycle); 		// inc byte [rbx + waitCycle]
+			}
+
+			emit(0x0F); emit(0xB7); emit(0xD2); 			// movzx edx, dx
+			break;
+
+		case CPU6502::IndexedIndirect:
+			emitLoadRegister(&cpu->x);
+			emit(0x04); emit(operand & 0xFF); 				// add al, operand
+			emit(0x48); emit(0xB9); emit64((uint64_t)(uintptr_t)ram); 	// mov rcx, ram
+			emit(0x0F); emit(0xB6); emit(0x14); emit(0x01); // movzx edx, byte [rcx + rax]
+			emit(0xFE); emit(0xC0); 						// inc al
+			emit(0x0F); emit(0xB6); emit(0x04); emit(0x01); // movzx eax, byte [rcx + rax]
+			emit(0xC1); emit(0xE0); emit(0x08); 			// shl eax, 8
+			emit(0x09); emit(0xC2); 						// or edx, eax
+			break;
+
+		case CPU6502::IndirectIndexed:
+			emit(0x48); emit(0xB9); emit64((uint64_t)(uintptr_t)ram); 	// mov rcx, ram
+			emit(0x0F); emit(0xB6); emit(0x91); emit32(operand & 0xFF); 			// movzx edx, byte [rcx + pointer]
+			emit(0x0F); emit(0xB6); emit(0x81); emit32((operand + 1) & 0xFF); 	// movzx eax, byte [rcx + pointer + 1]
+			emit(0xC1); emit(0xE0); emit(0x08); 			// shl eax, 8
+			emit(0x09); emit(0xC2); 						// or edx, eax
+			emit(0x0F); emit(0xB6); emit(0x8B); emit32(offset(&cpu->y)); 	// movzx ecx, byte [rbx + y]
+			emit(0x89); emit(0xD0); 						// mov eax, edx
+			emit(0x01); emit(0xCA); 						// add edx, ecx
+
+			if(pageCross){
+				emit(0x31); emit(0xD0); 					// xor eax, edx
+				emit(0xA9); emit32(0x1FF00); 				// test eax, 0x1FF00
+				emit(0x74); emit(0x06); 					// jz +6
+				emit(0xFE); emit(0x83); emit32(waitCycle); // inc byte [rbx + waitCycle]
+			}
+
+			emit(0x0F); emit(0xB7); emit(0xD2); 			// movzx edx, dx
+			break;
+	}
+}
+
+// eax = operand value, memory operands at the constant address or edx
+void JIT6502::emitRead(const DecodedInstruction& instruction){
+	uint16_t address = instruction.operand;
+	uint8_t* ram = bus->ram();
+
+	if(instruction.mode == CPU6502::Immediate){
+		emit(0xB8); emit32(address & 0xFF); 				// mov eax, operand
+		return;
+	}
+
+	addressRange range = rangeOf(instruction);
+
+	if(constantAddress(instruction)){
+		if(range != AnyRange){
+			emit(0xA0); emit64((uint64_t)(uintptr_t)(ram + (address & 0x7FF))); 	// mov al, [ram + address]
+			emit(0x0F); emit(0xB6); emit(0xC0); 			// movzx eax, al
+			return;
+		}
+
+		emit(0xBA); emit32(address); 						// mov edx, address
+
+		// Registers are only reached through the handlers
+		if(address < 0x6000){
+			emitHelperCall((void*)&busRead, bus);
+			emit(0x0F); emit(0xB6); emit(0xC0); 			// movzx eax, al
+			return;
+		}
+	} else if(range != AnyRange){
+		if(range == RamRange){
+			emit(0x81); emit(0xE2); emit32(0x7FF); 			// and edx, 0x7FF
+		}
+
+		emit(0x48); emit(0xB9); emit64((uint64_t)(uintptr_t)ram); 	// mov rcx, ram
+		emit(0x0F); emit(0xB6); emit(0x04); emit(0x11); 	// movzx eax, byte [rcx + rdx]
+		return;
+	}
+
+	// Pages the bus maps to memory are read in place, the rest goes to the handler
+	emit(0x0F); emit(0xB6); emit(0xCE); 					// movzx ecx, dh
+	emit(0x49); emit(0xB8); emit64((uint64_t)(uintptr_t)bus->readMap); 	// mov r8, readMap
+	emit(0x49); emit(0x8B); emit(0x0C); emit(0xC8); 		// mov rcx, [r8 + rcx * 8]
+	emit(0x48); emit(0x85); emit(0xC9); 					// test rcx, rcx
+	size_t unmapped = emitJump(0x84); 						// jz unmapped
+	emit(0x44); emit(0x0F); emit(0xB6); emit(0xC2); 		// movzx r8d, dl
+	emit(0x42); emit(0x0F); emit(0xB6); emit(0x04); emit(0x01); 	// movzx eax, byte [rcx + r8]
+	size_t done = emitJump(0);
+	land(unmapped);
+	emitHelperCall((void*)&busRead, bus);
+	emit(0x0F); emit(0xB6); emit(0xC0); 					// movzx eax, al
+	land(done);
+}
+
+// Writes al to the constant address or edx
+void JIT6502::emitWrite(const DecodedInstruction& instruction){
+	uint16_t address = instruction.operand;
+	uint8_t* ram = bus->ram();
+	CodeCache* cache = &cpu->codeCache;
+
+	addressRange range = rangeOf(instruction);
+
+	if(constantAddress(instruction)){
+		if(range != AnyRange){
+			emit(0xA2); emit64((uint64_t)(uintptr_t)(ram + (address & 0x7FF))); 	// mov [ram + address], al
+
+			// Ram above the stack may hold decoded code
+			if(CodeCache::isCodeAddress(address)){
+				emit(0x48); emit(0xB9); emit64((uint64_t)(uintptr_t)&cache->codePages[CodeCache::codePage(address)]); 	// mov rcx, &codePages[page]
+				emit(0x80); emit(0x39); emit(0x00); 		// cmp byte [rcx], 0
+				size_t clean = emitJump(0x84); 				// je clean
+				emit(0xBA); emit32(address); 				// mov edx, address
+				emitHelperCall((void*)&invalidateCode, cache);
+				land(clean);
+			}
+			return;
+		}
+
+		emit(0xBA); emit32(address); 						// mov edx, address
+
+		if(address < 0x6000){
+			emitHelperCall((void*)&busWrite, bus);
+			return;
+		}
+	} else if(range != AnyRange){
+		if(range == ZeroPageRange){
+			emit(0x48); emit(0xB9); emit64((uint64_t)(uintptr_t)ram); 	// mov rcx, ram
+			emit(0x88); emit(0x04); emit(0x11); 			// mov [rcx + rdx], al
+			return;
+		}
+
+		emit(0x81); emit(0xE2); emit32(0x7FF); 				// and edx, 0x7FF
+		emit(0x48); emit(0xB9); emit64((uint64_t)(uintptr_t)ram); 	// mov rcx, ram
+		emit(0x88); emit(0x04); emit(0x11); 				// mov [rcx + rdx], al
+		emit(0x0F); emit(0xB6); emit(0xCE); 				// movzx ecx, dh
+		emit(0x49); emit(0xB8); emit64((uint64_t)(uintptr_t)cache->codePages); 	// mov r8, codePages
+		emit(0x41); emit(0x80); emit(0x3C); emit(0x08); emit(0x00); 	// cmp byte [r8 + rcx], 0
+		size_t clean = emitJump(0x84); 						// je clean
+		emitHelperCall((void*)&invalidateCode, cache);
+		land(clean);
+		return;
+	}
+
+	// Writes to pages code can be decoded from go to the handler too, it
+	// invalidates the code cache
+	emit(0x0F); emit(0xB6); emit(0xCE); 					// movzx ecx, dh
+	emit(0x49); emit(0xB8); emit64((uint64_t)(uintptr_t)bus->writeMap); 	// mov r8, writeMap
+	emit(0x49); emit(0x8B); emit(0x0C); emit(0xC8); 		// mov rcx, [r8 + rcx * 8]
+	emit(0x48); emit(0x85); emit(0xC9); 					// test rcx, rcx
+	size_t unmapped = emitJump(0x84); 						// jz unmapped
+	emit(0x44); emit(0x0F); emit(0xB6); emit(0xC2); 		// movzx r8d, dl
+	emit(0x42); emit(0x88); emit(0x04); emit(0x01); 		// mov [rcx + r8], al
+	size_t done = emitJump(0);
+	land(unmapped);
+	emitHelperCall((void*)&busWrite, bus);
+	land(done);
+}
+
+// Pushes al, the stack page is plain ram
+void JIT6502::emitPush(){
+	int32_t s = offset(&cpu->s);
+	emit(0x0F); emit(0xB6); emit(0x8B); emit32(s); 		// movzx ecx, byte [rbx + s]
+	emit(0x48); emit(0xBA); emit64((uint64_t)(uintptr_t)(bus->ram() + 0x100)); 	// mov rdx, stack
+	emit(0x88); emit(0x04); emit(0x0A); 					// mov [rdx + rcx], al
+	emit(0xFE); emit(0x8B); emit32(s); 					// dec byte [rbx + s]
+}
+
+// Pulls into eax
+void JIT6502::emitPull(){
+	int32_t s = offset(&cpu->s);
+	emit(0xFE); emit(0x83); emit32(s); 					// inc byte [rbx + s]
+	emit(0x0F); emit(0xB6); emit(0x8B); emit32(s); 		// movzx ecx, byte [rbx + s]
+	emit(0x48); emit(0xBA); emit64((uint64_t)(uintptr_t)(bus->ram() + 0x100)); 	// mov rdx, stack
+	emit(0x0F); emit(0xB6); emit(0x04); emit(0x0A); 		// movzx eax, byte [rdx + rcx]
+}
+
+// Emits the instruction without calling back into the cpu, false when it has
+// no native translation. Cycles past the base count are added here, pc only
+// by the jumps and branches, which set setsPc.
+bool JIT6502::emitNative(const DecodedInstruction& instruction, bool& setsPc){
+	DecodedHandler handler = instruction.handler;
+	uint8_t mode = instruction.mode;
+	uint16_t operand = instruction.operand;
+	bool memory = mode != CPU6502::Immediate && mode != CPU6502::Implied;
+
+	setsPc = false;
+
+	uint8_t* a = &cpu->a;
+	uint8_t* x = &cpu->x;
+	uint8_t* y = &cpu->y;
+	uint8_t* s = &cpu->s;
+	uint8_t* p = &cpu->p;
+
+	// Indirect jumps and the register pages are left to the handlers
+	if(mode == CPU6502::Indirect)
+		return false;
+
+	auto operandValue = [&](){
+		if(memory && !constantAddress(instruction))
+			emitAddress(instruction);
+
+		emitRead(instruction);
+	};
+
+	auto load = [&](uint8_t* reg){
+		operandValue();
+		emitStoreRegister(reg);
+		emitZeroNegative();
+	};
+
+	auto store = [&](uint8_t* reg){
+		if(!constantAddress(instruction))
+			emitAddress(instruction);
+
+		emitLoadRegister(reg);
+		emitWrite(instruction);
+	};
+
+	auto transfer = [&](uint8_t* from, uint8_t* to, bool flags){
+		emitLoadRegister(from);
+		emitStoreRegister(to);
+		if(flags)
+			emitZeroNegative();
+	};
+
+	auto setFlag = [&](uint8_t bit, bool value){
+		if(value){
+			emit(0x80); emit(0x8B); emit32(offset(p)); emit(1 << bit); 			// or byte [rbx + p], bit
+		} else {
+			emit(0x80); emit(0xA3); emit32(offset(p)); emit(~(1 << bit) & 0xFF); // and byte [rbx + p], ~bit
+		}
+	};
+
+	// Carry into the host carry flag
+	auto carryIn = [&](){
+		emit(0x8A); emit(0x93); emit32(offset(p)); 			// mov dl, [rbx + p]
+		emit(0xD0); emit(0xEA); 							// shr dl, 1
+	};
+
+	// op al, cl then a = al
+	auto logical = [&](uint8_t opcode){
+		operandValue();
+		emit(0x89); emit(0xC1); 							// mov ecx, eax
+		emitLoadRegister(a);
+		emit(opcode); emit(0xC8); 							// or / and / xor al, cl
+		emitStoreRegister(a);
+		emitZeroNegative();
+	};
+
+	// adc / sbb al, cl with N, V, Z and C
+	auto arithmetic = [&](bool subtract){
+		operandValue();
+		emit(0x89); emit(0xC1); 							// mov ecx, eax
+		emitLoadRegister(a);
+		carryIn();
+
+		if(subtract){
+			emit(0xF5); 									// cmc, the host borrows on a clear carry
+			emit(0x18); emit(0xC8); 						// sbb al, cl
+		} else {
+			emit(0x10); emit(0xC8); 						// adc al, cl
+		}
+
+		emitStoreRegister(a);
+		emit(0x0F); emit(subtract ? 0x93 : 0x92); emit(0xC1); 	// setnc cl / setc cl
+		emit(0x0F); emit(0x90); emit(0xC2); 				// seto dl
+		emit(0xC0); emit(0xE2); emit(0x06); 				// shl dl, 6
+		emit(0x08); emit(0xD1); 							// or cl, dl
+		emit(0x84); emit(0xC0); 							// test al, al
+		emit(0x0F); emit(0x94); emit(0xC2); 				// sete dl
+		emit(0x00); emit(0xD2); 							// add dl, dl
+		emit(0x08); emit(0xD1); 							// or cl, dl
+		emit(0x88); emit(0xC2); 							// mov dl, al
+		emit(0x80); emit(0xE2); emit(0x80); 				// and dl, 0x80
+		emit(0x08); emit(0xD1); 							// or cl, dl
+		emitUpdateFlags(0x3C);
+	};
+
+	auto compare = [&](uint8_t* reg){
+		operandValue();
+		emit(0x89); emit(0xC1); 							// mov ecx, eax
+		emitLoadRegister(reg);
+		emit(0x38); emit(0xC8); 							// cmp al, cl
+		emit(0x0F); emit(0x93); emit(0xC1); 				// setnc cl
+		emit(0x0F); emit(0x94); emit(0xC2); 				// setz dl
+		emit(0x0F); emit(0x98); emit(0xC0); 				// sets al
+		emit(0xC0); emit(0xE0); emit(0x07); 				// shl al, 7
+		emit(0x00); emit(0xD2); 							// add dl, dl
+		emit(0x08); emit(0xD1); 							// or cl, dl
+		emit(0x08); emit(0xC1); 							// or cl, al
+		emitUpdateFlags(0x7C);
+	};
+
+	// Read, modify and write back the accumulator or memory
+	auto modify = [&](uint8_t op0, uint8_t op1, bool rotate, bool carry){
+		bool accumulator = mode == CPU6502::Implied;
+
+		if(accumulator){
+			emitLoadRegister(a);
+		} else {
+			if(!constantAddress(instruction)){
+				emitAddress(instruction);
+				emit(0x41); emit(0x89); emit(0xD4); 		// mov r12d, edx
+			}
+			emitRead(instruction);
+		}
+
+		if(rotate)
+			carryIn();
+
+		emit(op0); emit(op1);
+
+		if(carry){
+			emitCarryZeroNegative(false);
+		} else {
+			emitZeroNegative();
+		}
+
+		if(accumulator){
+			emitStoreRegister(a);
+		} else {
+			if(!constantAddress(instruction)){
+				emit(0x44); emit(0x89); emit(0xE2); 		// mov edx, r12d
+			}
+			emitWrite(instruction);
+		}
+	};
+
+	auto step = [&](uint8_t* reg, bool increment){
+		emitLoadRegister(reg);
+		emit(0xFE); emit(increment ? 0xC0 : 0xC8); 		// inc al / dec al
+		emitStoreRegister(reg);
+		emitZeroNegative();
+	};
+
+	auto setPc = [&](uint16_t value){
+		emit(0x66); emit(0xC7); emit(0x83); emit32(offset(&cpu->pc)); emit16(value); 	// mov word [rbx + pc], value
+	};
+
+	// Taken when the flag equals set, one more cycle and another across a page
+	auto branch = [&](uint8_t bit, bool set){
+		uint16_t next = instruction.pc + 2;
+		uint16_t target = next + (int8_t)(operand & 0xFF);
+
+		// The interpreter compares against the operand byte's page
+		uint16_t from = instruction.pc + 1;
+		uint16_t to = from + (int8_t)(operand & 0xFF);
+		uint8_t extra = (from & 0xFF00) != (to & 0xFF00) ? 2 : 1;
+
+		emit(0xF6); emit(0x83); emit32(offset(p)); emit(1 << bit); 	// test byte [rbx + p], bit
+		size_t taken = emitJump(set ? 0x85 : 0x84); 		// jnz / jz taken
+		setPc(next);
+		size_t done = emitJump(0);
+		land(taken);
+		setPc(target);
+		emitAddCycles(extra);
+		land(done);
+
+		setsPc = true;
+	};
+
+	// Loads and stores
+	if(handler == &CPU6502::decodedLda){ load(a); return true; }
+	if(handler == &CPU6502::decodedLdx){ load(x); return true; }
+	if(handler == &CPU6502::decodedLdy){ load(y); return true; }
+
+	if(handler == &CPU6502::decodedLax){
+		operandValue();
+		emitStoreRegister(a);
+		emitStoreRegister(x);
+		emitZeroNegative();
+		return true;
+	}
+
+	if(handler == &CPU6502::decodedSta){ store(a); return true; }
+	if(handler == &CPU6502::decodedStx){ store(x); return true; }
+	if(handler == &CPU6502::decodedSty){ store(y); return true; }
+
+	if(handler == &CPU6502::decodedSax){
+		if(!constantAddress(instruction))
+			emitAddress(instruction);
+
+		emitLoadRegister(a);
+		emit(0x22); emit(0x83); emit32(offset(x)); 		// and al, [rbx + x]
+		emitWrite(instruction);
+		return true;
+	}
+
+	// Register transfers
+	if(handler == &CPU6502::decodedTax){ transfer(a, x, true); return true; }
+	if(handler == &CPU6502::decodedTay){ transfer(a, y, true); return true; }
+	if(handler == &CPU6502::decodedTxa){ transfer(x, a, true); return true; }
+	if(handler == &CPU6502::decodedTya){ transfer(y, a, true); return true; }
+	if(handler == &CPU6502::decodedTsx){ transfer(s, x, true); return true; }
+	if(handler == &CPU6502::decodedTxs){ transfer(x, s, false); return true; }
+
+	// Stack, the pushed status has B and U set and B is cleared after
+	if(handler == &CPU6502::decodedPha){
+		emitLoadRegister(a);
+		emitPush();
+		return true;
+	}
+
+	if(handler == &CPU6502::decodedPhp){
+		emitLoadRegister(p);
+		emit(0x0C); emit(0x30); 							// or al, B | U
+		emitPush();
+		setFlag(CPU6502::Break, false);
+		return true;
+	}
+
+	if(handler == &CPU6502::decodedPla){
+		emitPull();
+		emitStoreRegister(a);
+		emitZeroNegative();
+		return true;
+	}
+
+	if(handler == &CPU6502::decodedPlp){
+		emitPull();
+		emit(0x0C); emit(0x20); 							// or al, U
+		emitStoreRegister(p);
+		return true;
+	}
+
+	// Logical and arithmetic
+	if(handler == &CPU6502::decodedOra){ logical(0x08); return true; }
+	if(handler == &CPU6502::decodedAnd){ logical(0x20); return true; }
+	if(handler == &CPU6502::decodedEor){ logical(0x30); return true; }
+	if(handler == &CPU6502::decodedAdc){ arithmetic(false); return true; }
+	if(handler == &CPU6502::decodedSbc){ arithmetic(true); return true; }
+	if(handler == &CPU6502::decodedCmp){ compare(a); return true; }
+	if(handler == &CPU6502::decodedCpx){ compare(x); return true; }
+	if(handler == &CPU6502::decodedCpy){ compare(y); return true; }
+
+	// N and V come from the operand, Z from a & operand
+	if(handler == &CPU6502::decodedBit){
+		operandValue();
+		emit(0x89); emit(0xC1); 							// mov ecx, eax
+		emit(0x24); emit(0xC0); 							// and al, N | V
+		emit(0x84); emit(0x8B); emit32(offset(a)); 		// test [rbx + a], cl
+		emit(0x0F); emit(0x94); emit(0xC2); 				// sete dl
+		emit(0x00); emit(0xD2); 							// add dl, dl
+		emit(0x08); emit(0xD0); 							// or al, dl
+		emit(0x88); emit(0xC1); 							// mov cl, al
+		emitUpdateFlags(0x3D);
+		return true;
+	}
+
+	// Increments, decrements and shifts
+	if(handler == &CPU6502::decodedInc){ modify(0xFE, 0xC0, false, false); return true; } 	// inc al
+	if(handler == &CPU6502::decodedDec){ modify(0xFE, 0xC8, false, false); return true; } 	// dec al
+	if(handler == &CPU6502::decodedAsl){ modify(0xD0, 0xE0, false, true); return true; } 	// shl al, 1
+	if(handler == &CPU6502::decodedLsr){ modify(0xD0, 0xE8, false, true); return true; } 	// shr al, 1
+	if(handler == &CPU6502::decodedRol){ modify(0xD0, 0xD0, true, true); return true; } 	// rcl al, 1
+	if(handler == &CPU6502::decodedRor){ modify(0xD0, 0xD8, true, true); return true; } 	// rcr al, 1
+
+	if(handler == &CPU6502::decodedInx){ step(x, true); return true; }
+	if(handler == &CPU6502::decodedIny){ step(y, true); return true; }
+	if(handler == &CPU6502::decodedDex){ step(x, false); return true; }
+	if(handler == &CPU6502::decodedDey){ step(y, false); return true; }
+
+	// Status flags
+	if(handler == &CPU6502::decodedClc){ setFlag(CPU6502::Carry, false); return true; }
+	if(handler == &CPU6502::decodedSec){ setFlag(CPU6502::Carry, true); return true; }
+	if(handler == &CPU6502::decodedCli){ setFlag(CPU6502::Interrupt, false); return true; }
+	if(handler == &CPU6502::decodedSei){ setFlag(CPU6502::Interrupt, true); return true; }
+	if(handler == &CPU6502::decodedCld){ setFlag(CPU6502::Decimal, false); return true; }
+	if(handler == &CPU6502::decodedSed){ setFlag(CPU6502::Decimal, true); return true; }
+	if(handler == &CPU6502::decodedClv){ setFlag(CPU6502::Overflow, false); return true; }
+
+	// Unofficial NOPs only take their page crossing cycle
+	if(handler == &CPU6502::decodedNop){
+		if(mode == CPU6502::AbsoluteX)
+			emitAddress(instruction);
+		return true;
+	}
+
+	// Jumps and calls
+	if(handler == &CPU6502::decodedJmp){
+		setPc(operand);
+		setsPc = true;
+		return true;
+	}
+
+	if(handler == &CPU6502::decodedJsr){
+		uint16_t back = instruction.pc + 2;
+		emit(0xB0); emit(back >> 8); 						// mov al, high
+		emitPush();
+		emit(0xB0); emit(back & 0xFF); 						// mov al, low
+		emitPush();
+		setPc(operand);
+		setsPc = true;
+		return true;
+	}
+
+	if(handler == &CPU6502::decodedRts){
+		int32_t pc = offset(&cpu->pc);
+		emitPull();
+		emit(0x88); emit(0x83); emit32(pc); 				// mov [rbx + pc], al
+		emitPull();
+		emit(0x88); emit(0x83); emit32(pc + 1); 			// mov [rbx + pc + 1], al
+		emit(0x66); emit(0xFF); emit(0x83); emit32(pc); 	// inc word [rbx + pc]
+		setsPc = true;
+		return true;
+	}
+
+	// Branches
+	if(handler == &CPU6502::decodedBcc){ branch(CPU6502::Carry, false); return true; }
+	if(handler == &CPU6502::decodedBcs){ branch(CPU6502::Carry, true); return true; }
+	if(handler == &CPU6502::decodedBne){ branch(CPU6502::Zero, false); return true; }
+	if(handler == &CPU6502::decodedBeq){ branch(CPU6502::Zero, true); return true; }
+	if(handler == &CPU6502::decodedBpl){ branch(CPU6502::Negative, false); return true; }
+	if(handler == &CPU6502::decodedBmi){ branch(CPU6502::Negative, true); return true; }
+	if(handler == &CPU6502::decodedBvc){ branch(CPU6502::Overflow, false); return true; }
+	if(handler == &CPU6502::decodedBvs){ branch(CPU6502::Overflow, true); return true; }
+
+	return false;
+}
+
+// Instructions without a native translation call their cached interpreter handler
+void JIT6502::emitCall(const DecodedInstruction& instruction){
+#if defined(_WIN32)
+	emit(0x48); emit(0x89); emit(0xD9); 					// mov rcx, rbx
+	emit(0x48); emit(0xBA); emit64((uint64_t)(uintptr_t)&instruction); 	// mov rdx, instruction
+#else
+	emit(0x48); emit(0x89); emit(0xDF); 					// mov rdi, rbx
+	emit(0x48); emit(0xBE); emit64((uint64_t)(uintptr_t)&instruction); 	// mov rsi, instruction
+#endif
+	emit(0x48); emit(0xB8); emit64((uint64_t)(uintptr_t)instruction.handler); 	// mov rax, handler
+	emit(0xFF); emit(0xD0); 								// call rax
+}
+
+bool JIT6502::compile(CPU6502* target, Bus* targetBus, CodeBlock* block){
+#ifdef JIT_X64
+	if(code == nullptr){
+#if defined(_WIN32)
+		code = (uint8_t*)VirtualAlloc(NULL, codeSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+		void* memory = mmap(NULL, codeSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		code = memory == MAP_FAILED ? nullptr : (uint8_t*)memory;
+#endif
+		if(code == nullptr)
+			return false;
+	}
+
+	cpu = target;
+	bus = targetBus;
+	buffer.clear();
+
+	emit(0x53); 											// push rbx
+	emit(0x41); emit(0x54); 								// push r12
+	emit(0x48); emit(0x83); emit(0xEC); emit(0x28); 		// sub rsp, 40
+#if defined(_WIN32)
+	emit(0x48); emit(0x89); emit(0xCB); 					// mov rbx, rcx
+#else
+	emit(0x48); emit(0x89); emit(0xFB); 					// mov rbx, rdi
+#endif
+
+	// A write through the bus may rewrite code further down the block, the
+	// generation it starts in tells when to leave
+	uint32_t* generation = &cpu->codeCache.generation;
+	emit(0x48); emit(0xB8); emit64((uint64_t)(uintptr_t)generation); 	// mov rax, &generation
+	emit(0x8B); emit(0x00); 								// mov eax, [rax]
+	emit(0x89); emit(0x44); emit(0x24); emit(0x20); 		// mov [rsp + 32], eax
+
+	struct blockExit{
+		size_t jump;
+		uint8_t nativeCycles;
+		bool storePc; 				// an interpreted instruction already set it
+		uint16_t pc;
+	};
+	vector<blockExit> exits;
+
+	uint8_t nativeCycles = 0;
+	bool lastNative = false;
+	bool setsPc = false;
+
+	for(const DecodedInstruction& instruction : block->instructions){
+		lastNative = emitNative(instruction, setsPc);
+
+		if(lastNative){
+			nativeCycles += instruction.cycles;
+		} else {
+			emitCall(instruction);
+		}
+
+		bool last = &instruction == &block->instructions.back();
+		bool busWrite = (instruction.flags & CodeCache::Writes) && (!lastNative || rangeOf(instruction) == AnyRange);
+
+		if(busWrite && !last && !setsPc){
+			emit(0x48); emit(0xB8); emit64((uint64_t)(uintptr_t)generation); 	// mov rax, &generation
+			emit(0x8B); emit(0x00); 						// mov eax, [rax]
+			emit(0x3B); emit(0x44); emit(0x24); emit(0x20); // cmp eax, [rsp + 32]
+			exits.push_back({emitJump(0x85), nativeCycles, lastNative, (uint16_t)(instruction.pc + instruction.length)}); 	// jne exit
+		}
+	}
+
+	auto epilogue = [&](uint8_t cycles, bool storePc, uint16_t pc){
+		if(cycles > 0){
+			emitAddCycles(cycles);
+		}
+
+		if(storePc){
+			emit(0x66); emit(0xC7); emit(0x83); emit32(offset(&cpu->pc)); emit16(pc); 	// mov word [rbx + pc], pc
+		}
+
+		emit(0x48); emit(0x83); emit(0xC4); emit(0x28); 	// add rsp, 40
+		emit(0x41); emit(0x5C); 							// pop r12
+		emit(0x5B); 										// pop rbx
+		emit(0xC3); 										// ret
+	};
+
+	// Interpreted instructions leave pc behind them, native ones other than
+	// jumps and branches never touch it
+	epilogue(nativeCycles, lastNative && !setsPc, block->end);
+
+	for(const blockExit& exit : exits){
+		land(exit.jump);
+		epilogue(exit.nativeCycles, exit.storePc, exit.pc);
+	}
+
+	if(codeUsed + buffer.size() > codeSize)
+		return false;
+
+	memcpy(code + codeUsed, buffer.data(), buffer.size());
+	block->native = code + codeUsed;
+	codeUsed += (buffer.size() + 15) & ~(size_t)15;
+
+	return true;
+#else
+	return false;
+#endif
+}
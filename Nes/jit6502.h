@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class Bus;
+class CPU6502;
+struct CodeBlock;
+struct DecodedInstruction;
+
+// Translates cached basic blocks into x86-64 code. Loads, stores, arithmetic,
+// shifts, stack operations, jumps and branches are emitted natively and keep
+// the 6502 registers in the CPU6502 object. Memory goes straight to ram and
+// through the bus page maps otherwise, with the bus handlers as the slow path.
+// BRK, RTI, indirect jumps and the odd unofficial opcodes call their cached
+// interpreter handler. Blocks run as void block(CPU6502*).
+class JIT6502{
+	uint8_t* code = nullptr;
+	size_t codeUsed = 0;
+
+	std::vector<uint8_t> buffer;
+
+	// Machine the block being compiled runs on
+	CPU6502* cpu = nullptr;
+	Bus* bus = nullptr;
+
+	void emit(uint8_t byte);
+	void emit16(uint16_t value);
+	void emit32(uint32_t value);
+	void emit64(uint64_t value);
+
+	// Forward jumps, patched once the target is emitted
+	size_t emitJump(uint8_t condition);
+	void land(size_t jump);
+
+	int32_t offset(void* member);
+
+	void emitLoadRegister(void* reg);
+	void emitStoreRegister(void* reg);
+	void emitUpdateFlags(uint8_t mask);
+	void emitZeroNegative();
+	void emitCarryZeroNegative(bool inverted);
+	void emitAddCycles(uint8_t count);
+	void emitHelperCall(void* helper, void* object);
+
+	void emitAddress(const DecodedInstruction& instruction);
+	void emitRead(const DecodedInstruction& instruction);
+	void emitWrite(const DecodedInstruction& instruction);
+	void emitPush();
+	void emitPull();
+
+	bool emitNative(const DecodedInstruction& instruction, bool& setsPc);
+	void emitCall(const DecodedInstruction& instruction);
+public:
+	JIT6502();
+	~JIT6502();
+
+	static const size_t codeSize = 1 << 20;
+
+	static bool available();
+
+	// Returns false when the code buffer is full; flush the cache and reset
+	bool compile(CPU6502* cpu, Bus* bus, CodeBlock* block);
+
+	void reset(){ codeUsed = 0; }
+};
@@ -0,0 +1,156 @@
+#include "latency.h"
+#include "input.h"
+
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+void LatencyHistogram::add(uint64_t ns){
+	double us = ns / 1000.0;
+	int bucket = us < 1 ? 0 : (int)(4 * log2(us));
+	if(bucket >= buckets)
+		bucket = buckets - 1;
+
+	counts[bucket]++;
+
+	if(count == 0 || ns < minimum)
+		minimum = ns;
+	if(ns > maximum)
+		maximum = ns;
+
+	count++;
+	total += ns;
+}
+
+double LatencyHistogram::mean() const {
+	return count == 0 ? 0 : total / 1e6 / count;
+}
+
+double LatencyHistogram::percentile(double p) const {
+	if(count == 0)
+		return 0;
+
+	uint64_t rank = (uint64_t)ceil(p / 100 * count);
+	if(rank < 1)
+		rank = 1;
+
+	uint64_t seen = 0;
+	for(int i = 0; i < buckets; i++){
+		seen += counts[i];
+
+		if(seen >= rank)
+			return pow(2.0, (i + 1) / 4.0) / 1000;
+	}
+
+	return maximum / 1e6;
+}
+
+void LatencyMonitor::inputApplied(uint64_t eventTime){
+	lock_guard<mutex> lock(monitorMutex);
+
+	if(sampling)
+		return;
+
+	current = Sample();
+	current.event = eventTime;
+	sampling = true;
+}
+
+void LatencyMonitor::latched(uint32_t frame){
+	lock_guard<mutex> lock(monitorMutex);
+
+	if(sampling && current.latch == 0){
+		current.latch = InputEvent::now();
+		current.latchFrame = frame;
+	}
+}
+
+void LatencyMonitor::frameDone(uint32_t frame){
+	uint64_t now = InputEvent::now();
+	bool logNow = false;
+
+	{
+		lock_guard<mutex> lock(monitorMutex);
+
+		// The frame ending at latchFrame + 1 was rendering before the latch
+		if(sampling && current.latch != 0 && frame > current.latchFrame + 1){
+			current.frame = now;
+
+			histograms[EventToLatch].add(current.latch - current.event);
+			histograms[LatchToFrame].add(current.frame - current.latch);
+			histograms[EventToFrame].add(current.frame - current.event);
+
+			// Without presents the oldest waiting samples make room
+			if(waitingCount == waitingSize){
+				for(int i = 1; i < waitingSize; i++){
+					waiting[i - 1] = waiting[i];
+				}
+				waitingCount--;
+			}
+
+			waiting[waitingCount++] = current;
+			sampling = false;
+		}
+
+		if(log != nullptr){
+			if(lastLog == 0)
+				lastLog = now;
+
+			if(now - lastLog >= logInterval * 1e9){
+				lastLog = now;
+				logNow = true;
+			}
+		}
+	}
+
+	if(logNow)
+		*log << summary() << endl;
+}
+
+void LatencyMonitor::presented(){
+	uint64_t now = InputEvent::now();
+	lock_guard<mutex> lock(monitorMutex);
+
+	for(int i = 0; i < waitingCount; i++){
+		histograms[FrameToPresent].add(now - waiting[i].frame);
+		histograms[EventToPresent].add(now - waiting[i].event);
+	}
+
+	waitingCount = 0;
+}
+
+LatencyHistogram LatencyMonitor::histogram(stage s) const {
+	lock_guard<mutex> lock(monitorMutex);
+	return histograms[s];
+}
+
+string LatencyMonitor::summary() const {
+	static const char* names[stages] = { "event-latch", "latch-frame", "frame-present", "event-frame", "event-present" };
+
+	lock_guard<mutex> lock(monitorMutex);
+
+	ostringstream line;
+	line << fixed << setprecision(2) << "latency ms mean/p50/p99:";
+
+	for(int s = 0; s < stages; s++){
+		const LatencyHistogram& h = histograms[s];
+		line << " " << names[s] << " " << h.mean() << "/" << h.percentile(50) << "/" << h.percentile(99);
+	}
+
+	line << " samples " << histograms[EventToFrame].count;
+	return line.str();
+}
+
+void LatencyMonitor::reset(){
+	lock_guard<mutex> lock(monitorMutex);
+
+	for(LatencyHistogram& h : histograms){
+		h = LatencyHistogram();
+	}
+
+	sampling = false;
+	waitingCount = 0;
+	lastLog = 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// Durations in quarter octave buckets from 1 us up to about 16 s
+class LatencyHistogram{
+public:
+	static const int buckets = 96;
+
+	uint64_t counts[buckets] = {};
+	uint64_t count = 0;
+	uint64_t total = 0; 	// ns
+	uint64_t minimum = 0;
+	uint64_t maximum = 0;
+
+	void add(uint64_t ns);
+
+	// Milliseconds, percentiles are the upper edge of their bucket
+	double mean() const;
+	double percentile(double p) const;
+};
+
+// Input to photon latency of a session, in stages:
+//   event     the OS key event (InputEvent::time)
+//   latch     the next $4016 strobe after the bus applied the event
+//   frame     the end of the first frame the ppu starts rendering after that
+//             latch, frames already under way when it latched show old input
+//   present   the next present of the window or frontend after that frame
+// The bus reports the first three, whoever presents calls presented. A new
+// sample starts with the first input applied once the last one reached its
+// frame.
+class LatencyMonitor{
+public:
+	enum stage{
+		EventToLatch = 0,
+		LatchToFrame = 1,
+		FrameToPresent = 2,
+		EventToFrame = 3,
+		EventToPresent = 4,
+		stages = 5
+	};
+
+private:
+	struct Sample{
+		uint64_t event = 0;
+		uint64_t latch = 0;
+		uint64_t frame = 0;
+		uint32_t latchFrame = 0; 	// ppu frame count at the latch
+	};
+
+	mutable std::mutex monitorMutex;
+	LatencyHistogram histograms[stages];
+
+	bool sampling = false;
+	Sample current;
+
+	// Samples that reached their frame, waiting for a present
+	static const int waitingSize = 8;
+	Sample waiting[waitingSize];
+	int waitingCount = 0;
+
+	uint64_t lastLog = 0;
+public:
+	// Every logInterval seconds the frame stage writes summary() to log
+	std::ostream* log = nullptr;
+	double logInterval = 5;
+
+	// Bus side, on the emulation thread
+	void inputApplied(uint64_t eventTime);
+	// With the ppu frame count, which goes up as the ppu starts each frame
+	void latched(uint32_t frame);
+	void frameDone(uint32_t frame);
+
+	// Any thread
+	void presented();
+
+	LatencyHistogram histogram(stage s) const;
+	std::string summary() const;
+	void reset();
+};
@@ -0,0 +1,86 @@
+#include "nesapi.h"
+#include "bus.h"
+
+#include <cstring>
+
+using namespace std;
+
+struct NesInstance{
+	Bus bus{true};
+};
+
+uint32_t nes_api_version(void){
+	return NES_API_VERSION;
+}
+
+NesInstance* nes_create(const uint8_t* rom, size_t size){
+	NesInstance* nes = new NesInstance;
+
+	if(rom == nullptr || !nes->bus.loadCartridge(rom, size)){
+		delete nes;
+		return nullptr;
+	}
+
+	nes->bus.reset();
+	return nes;
+}
+
+void nes_destroy(NesInstance* nes){
+	delete nes;
+}
+
+void nes_reset(NesInstance* nes){
+	nes->bus.reset();
+}
+
+uint32_t nes_step(NesInstance* nes, uint32_t frames, uint8_t port0, uint8_t port1){
+	Bus& bus = nes->bus;
+
+	// The ram views are written around the bus, drop the code decoded from ram
+	// and wake a cpu skipping a loop that may wait on what was written
+	bus.cpu.codeCache.invalidateRam();
+	bus.cpu.wake();
+
+	bus.controllers[0] = port0;
+	bus.controllers[1] = port1;
+
+	uint32_t last = bus.ppu.frame + frames;
+	while(bus.ppu.frame != last){
+		bus.clock();
+	}
+
+	return bus.ppu.frame;
+}
+
+uint32_t nes_frame(NesInstance* nes){
+	return nes->bus.ppu.frame;
+}
+
+const uint32_t* nes_framebuffer(NesInstance* nes){
+	return nes->bus.ppu.screen;
+}
+
+uint8_t* nes_ram(NesInstance* nes){
+	return nes->bus.ram();
+}
+
+uint8_t* nes_sram(NesInstance* nes){
+	return nes->bus.sram();
+}
+
+uint8_t* nes_oam(NesInstance* nes){
+	return nes->bus.ppu.pOAM;
+}
+
+size_t nes_save_state(NesInstance* nes, uint8_t* buffer, size_t capacity){
+	vector<uint8_t> state = nes->bus.saveState();
+
+	if(buffer != nullptr && capacity >= state.size())
+		memcpy(buffer, state.data(), state.size());
+
+	return state.size();
+}
+
+int nes_load_state(NesInstance* nes, const uint8_t* state, size_t size){
+	return nes->bus.loadState(state, size) ? 1 : 0;
+}
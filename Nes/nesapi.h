@@ -0,0 +1,69 @@
+#pragma once
+
+// Stable C interface around a headless Bus, for bindings and other languages.
+// Every call on one instance must come from one thread at a time, separate
+// instances run on separate threads freely. Pointers stay valid for the life
+// of the instance and always show the current contents, nothing is copied.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(_WIN32)
+#define NES_API __declspec(dllexport)
+#else
+#define NES_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_API_VERSION 1
+
+#define NES_SCREEN_WIDTH 256
+#define NES_SCREEN_HEIGHT 240
+#define NES_RAM_SIZE 2048
+#define NES_SRAM_SIZE 8192
+#define NES_OAM_SIZE 256
+
+// Controller buttons, one byte per port
+#define NES_BUTTON_RIGHT 0x01
+#define NES_BUTTON_LEFT 0x02
+#define NES_BUTTON_DOWN 0x04
+#define NES_BUTTON_UP 0x08
+#define NES_BUTTON_START 0x10
+#define NES_BUTTON_SELECT 0x20
+#define NES_BUTTON_B 0x40
+#define NES_BUTTON_A 0x80
+
+typedef struct NesInstance NesInstance;
+
+NES_API uint32_t nes_api_version(void);
+
+// iNES image in memory, null when it isn't one the emulator runs
+NES_API NesInstance* nes_create(const uint8_t* rom, size_t size);
+NES_API void nes_destroy(NesInstance* nes);
+
+NES_API void nes_reset(NesInstance* nes);
+
+// Runs whole frames with the buttons held on both ports, returns the frame count
+NES_API uint32_t nes_step(NesInstance* nes, uint32_t frames, uint8_t port0, uint8_t port1);
+NES_API uint32_t nes_frame(NesInstance* nes);
+
+// 256x240 pixels of 0x00RRGGBB, complete after each step
+NES_API const uint32_t* nes_framebuffer(NesInstance* nes);
+
+// Writable views of the cpu ram, cartridge SRAM and sprite memory. Writes
+// are seen by the next nes_step, which drops any code decoded from ram.
+NES_API uint8_t* nes_ram(NesInstance* nes);
+NES_API uint8_t* nes_sram(NesInstance* nes);
+NES_API uint8_t* nes_oam(NesInstance* nes);
+
+// States load into an instance of the same ROM. nes_save_state returns the
+// size of the state, and writes it only when capacity is enough.
+NES_API size_t nes_save_state(NesInstance* nes, uint8_t* buffer, size_t capacity);
+NES_API int nes_load_state(NesInstance* nes, const uint8_t* state, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,328 @@
+// Python module "nes" over the C interface in nesapi.h. Build it as a shared
+// library named nes from the emulator sources without the program mains, with
+// the platform window (instances are headless but the ppu links against it):
+//   g++ -O2 -shared -fPIC $(python3-config --includes) nespython.cpp nesapi.cpp bus.cpp ... x11window.cpp -lX11 -lXext -o nes$(python3-config --extension-suffix)
+//
+//   emulator = nes.Emulator(open("game.nes", "rb").read())
+//   screen = numpy.asarray(emulator.screen)    # (240, 256, 4) BGRX, no copy
+//   ram = numpy.asarray(emulator.ram)          # live view of the 2K cpu ram
+//   emulator.step(4, nes.A | nes.RIGHT)
+//
+// Memory views are buffers over the emulator itself, they see every step
+// without copying. Writes to ram, sram and oam are seen by the next step,
+// which drops any code the cpu decoded from ram. step releases the GIL, so instances on separate threads
+// run in parallel. One instance steps on one thread at a time.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "nesapi.h"
+
+// Buffer over memory of an Emulator, which it keeps alive
+struct View{
+	PyObject_HEAD
+	PyObject* owner;
+	void* data;
+	int ndim;
+	Py_ssize_t shape[3];
+	Py_ssize_t strides[3];
+	int readonly;
+};
+
+static int viewGetBuffer(PyObject* object, Py_buffer* buffer, int flags){
+	View* view = (View*)object;
+
+	if((flags & PyBUF_WRITABLE) && view->readonly){
+		PyErr_SetString(PyExc_BufferError, "view is read only");
+		buffer->obj = nullptr;
+		return -1;
+	}
+
+	Py_ssize_t length = 1;
+	for(int i = 0; i < view->ndim; i++){
+		length *= view->shape[i];
+	}
+
+	buffer->buf = view->data;
+	buffer->obj = object;
+	Py_INCREF(object);
+	buffer->len = length;
+	buffer->readonly = view->readonly;
+	buffer->itemsize = 1;
+	buffer->format = (flags & PyBUF_FORMAT) ? (char*)"B" : nullptr;
+	buffer->ndim = view->ndim;
+	buffer->shape = (flags & PyBUF_ND) ? view->shape : nullptr;
+	buffer->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? view->strides : nullptr;
+	buffer->suboffsets = nullptr;
+	buffer->internal = nullptr;
+	return 0;
+}
+
+static void viewDealloc(PyObject* object){
+	Py_XDECREF(((View*)object)->owner);
+	Py_TYPE(object)->tp_free(object);
+}
+
+static PyBufferProcs viewBuffer = { viewGetBuffer, nullptr };
+
+// Filled in by PyInit_nes
+static PyTypeObject ViewType = {};
+
+// Row major bytes in up to three dimensions
+static PyObject* newView(PyObject* owner, void* data, int ndim, const Py_ssize_t* shape, bool readonly){
+	View* view = PyObject_New(View, &ViewType);
+	if(view == nullptr)
+		return nullptr;
+
+	Py_INCREF(owner);
+	view->owner = owner;
+	view->data = data;
+	view->ndim = ndim;
+	view->readonly = readonly;
+
+	Py_ssize_t stride = 1;
+	for(int i = ndim - 1; i >= 0; i--){
+		view->shape[i] = shape[i];
+		view->strides[i] = stride;
+		stride *= shape[i];
+	}
+
+	return (PyObject*)view;
+}
+
+struct Emulator{
+	PyObject_HEAD
+	NesInstance* nes;
+	bool busy; 		// stepping with the GIL released
+};
+
+static bool ready(Emulator* emulator){
+	if(emulator->nes == nullptr){
+		PyErr_SetString(PyExc_RuntimeError, "emulator has no ROM loaded");
+		return false;
+	}
+
+	if(emulator->busy){
+		PyErr_SetString(PyExc_RuntimeError, "emulator is stepping on another thread");
+		return false;
+	}
+
+	return true;
+}
+
+static int emulatorInit(PyObject* object, PyObject* args, PyObject* kwargs){
+	Emulator* emulator = (Emulator*)object;
+	static const char* keywords[] = { "rom", nullptr };
+	Py_buffer rom;
+
+	// Views and other threads hold on to the instance, it lives as long as the object
+	if(emulator->nes != nullptr){
+		PyErr_SetString(PyExc_RuntimeError, "emulator already has a ROM loaded");
+		return -1;
+	}
+
+	if(!PyArg_ParseTupleAndKeywords(args, kwargs, "y*", (char**)keywords, &rom))
+		return -1;
+
+	emulator->nes = nes_create((const uint8_t*)rom.buf, (size_t)rom.len);
+	PyBuffer_Release(&rom);
+
+	if(emulator->nes == nullptr){
+		PyErr_SetString(PyExc_ValueError, "not an iNES image the emulator runs");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void emulatorDealloc(PyObject* object){
+	Emulator* emulator = (Emulator*)object;
+
+	if(emulator->nes != nullptr)
+		nes_destroy(emulator->nes);
+
+	Py_TYPE(object)->tp_free(object);
+}
+
+static PyObject* emulatorStep(PyObject* object, PyObject* args, PyObject* kwargs){
+	Emulator* emulator = (Emulator*)object;
+	static const char* keywords[] = { "frames", "port0", "port1", nullptr };
+	unsigned int frames = 1;
+	unsigned char port0 = 0;
+	unsigned char port1 = 0;
+
+	if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|Ibb", (char**)keywords, &frames, &port0, &port1))
+		return nullptr;
+
+	if(!ready(emulator))
+		return nullptr;
+
+	uint32_t frame;
+	emulator->busy = true;
+
+	Py_BEGIN_ALLOW_THREADS
+	frame = nes_step(emulator->nes, frames, port0, port1);
+	Py_END_ALLOW_THREADS
+
+	emulator->busy = false;
+	return PyLong_FromUnsignedLong(frame);
+}
+
+static PyObject* emulatorReset(PyObject* object, PyObject*){
+	Emulator* emulator = (Emulator*)object;
+
+	if(!ready(emulator))
+		return nullptr;
+
+	nes_reset(emulator->nes);
+	Py_RETURN_NONE;
+}
+
+static PyObject* emulatorSaveState(PyObject* object, PyObject*){
+	Emulator* emulator = (Emulator*)object;
+
+	if(!ready(emulator))
+		return nullptr;
+
+	size_t size = nes_save_state(emulator->nes, nullptr, 0);
+	PyObject* state = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t)size);
+	if(state == nullptr)
+		return nullptr;
+
+	nes_save_state(emulator->nes, (uint8_t*)PyBytes_AS_STRING(state), size);
+	return state;
+}
+
+static PyObject* emulatorLoadState(PyObject* object, PyObject* args){
+	Emulator* emulator = (Emulator*)object;
+	Py_buffer state;
+
+	if(!PyArg_ParseTuple(args, "y*", &state))
+		return nullptr;
+
+	if(!ready(emulator)){
+		PyBuffer_Release(&state);
+		return nullptr;
+	}
+
+	int loaded = nes_load_state(emulator->nes, (const uint8_t*)state.buf, (size_t)state.len);
+	PyBuffer_Release(&state);
+
+	if(!loaded){
+		PyErr_SetString(PyExc_ValueError, "not a state of this emulator version");
+		return nullptr;
+	}
+
+	Py_RETURN_NONE;
+}
+
+static PyObject* emulatorFrame(PyObject* object, void*){
+	Emulator* emulator = (Emulator*)object;
+
+	if(emulator->nes == nullptr)
+		return PyLong_FromLong(0);
+
+	return PyLong_FromUnsignedLong(nes_frame(emulator->nes));
+}
+
+enum viewKind{ ScreenView, RamView, SramView, OamView };
+
+static PyObject* emulatorView(PyObject* object, void* closure){
+	Emulator* emulator = (Emulator*)object;
+
+	if(emulator->nes == nullptr){
+		PyErr_SetString(PyExc_RuntimeError, "emulator has no ROM loaded");
+		return nullptr;
+	}
+
+	switch((viewKind)(intptr_t)closure){
+		case ScreenView: {
+			Py_ssize_t shape[3] = { NES_SCREEN_HEIGHT, NES_SCREEN_WIDTH, 4 };
+			return newView(object, (void*)nes_framebuffer(emulator->nes), 3, shape, true);
+		}
+
+		case RamView: {
+			Py_ssize_t shape[1] = { NES_RAM_SIZE };
+			return newView(object, nes_ram(emulator->nes), 1, shape, false);
+		}
+
+		case SramView: {
+			Py_ssize_t shape[1] = { NES_SRAM_SIZE };
+			return newView(object, nes_sram(emulator->nes), 1, shape, false);
+		}
+
+		default: {
+			Py_ssize_t shape[1] = { NES_OAM_SIZE };
+			return newView(object, nes_oam(emulator->nes), 1, shape, false);
+		}
+	}
+}
+
+static PyMethodDef emulatorMethods[] = {
+	{ "step", (PyCFunction)(void(*)(void))emulatorStep, METH_VARARGS | METH_KEYWORDS, "step(frames=1, port0=0, port1=0) runs whole frames with the buttons held, returns the frame count" },
+	{ "reset", emulatorReset, METH_NOARGS, "reset()" },
+	{ "save_state", emulatorSaveState, METH_NOARGS, "save_state() -> bytes" },
+	{ "load_state", emulatorLoadState, METH_VARARGS, "load_state(state) loads a state saved with the same ROM" },
+	{ nullptr, nullptr, 0, nullptr }
+};
+
+static PyGetSetDef emulatorGetSet[] = {
+	{ "frame", emulatorFrame, nullptr, "frames completed", nullptr },
+	{ "screen", emulatorView, nullptr, "(240, 256, 4) BGRX pixels, read only", (void*)ScreenView },
+	{ "ram", emulatorView, nullptr, "2048 bytes of cpu ram", (void*)RamView },
+	{ "sram", emulatorView, nullptr, "8192 bytes of cartridge SRAM", (void*)SramView },
+	{ "oam", emulatorView, nullptr, "256 bytes of sprite memory", (void*)OamView },
+	{ nullptr, nullptr, nullptr, nullptr, nullptr }
+};
+
+static PyTypeObject EmulatorType = {};
+
+static PyModuleDef module = { PyModuleDef_HEAD_INIT, "nes", "NES emulator instances with zero copy memory views", -1, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+PyMODINIT_FUNC PyInit_nes(void){
+	// What PyVarObject_HEAD_INIT would set, PyType_Ready fills in the type
+	Py_SET_REFCNT((PyObject*)&ViewType, 1);
+	Py_SET_REFCNT((PyObject*)&EmulatorType, 1);
+
+	ViewType.tp_name = "nes.View";
+	ViewType.tp_basicsize = sizeof(View);
+	ViewType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ViewType.tp_dealloc = viewDealloc;
+	ViewType.tp_as_buffer = &viewBuffer;
+	ViewType.tp_doc = "Live buffer over emulator memory, for memoryview() or numpy.asarray()";
+
+	EmulatorType.tp_name = "nes.Emulator";
+	EmulatorType.tp_basicsize = sizeof(Emulator);
+	EmulatorType.tp_flags = Py_TPFLAGS_DEFAULT;
+	EmulatorType.tp_new = PyType_GenericNew;
+	EmulatorType.tp_init = emulatorInit;
+	EmulatorType.tp_dealloc = emulatorDealloc;
+	EmulatorType.tp_methods = emulatorMethods;
+	EmulatorType.tp_getset = emulatorGetSet;
+	EmulatorType.tp_doc = "Emulator(rom) runs an iNES image given as bytes";
+
+	if(PyType_Ready(&ViewType) < 0 || PyType_Ready(&EmulatorType) < 0)
+		return nullptr;
+
+	PyObject* nes = PyModule_Create(&module);
+	if(nes == nullptr)
+		return nullptr;
+
+	Py_INCREF(&EmulatorType);
+	if(PyModule_AddObject(nes, "Emulator", (PyObject*)&EmulatorType) < 0){
+		Py_DECREF(&EmulatorType);
+		Py_DECREF(nes);
+		return nullptr;
+	}
+
+	static const struct { const char* name; int value; } buttons[] = {
+		{ "RIGHT", NES_BUTTON_RIGHT }, { "LEFT", NES_BUTTON_LEFT }, { "DOWN", NES_BUTTON_DOWN }, { "UP", NES_BUTTON_UP },
+		{ "START", NES_BUTTON_START }, { "SELECT", NES_BUTTON_SELECT }, { "B", NES_BUTTON_B }, { "A", NES_BUTTON_A }
+	};
+
+	for(const auto& button : buttons){
+		PyModule_AddIntConstant(nes, button.name, button.value);
+	}
+
+	return nes;
+}
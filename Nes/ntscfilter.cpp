@@ -0,0 +1,238 @@
+#include "ntscfilter.h"
+
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+NtscFilter::NtscFilter(){
+	setup();
+}
+
+NtscFilter::~NtscFilter(){
+	stop();
+}
+
+void NtscFilter::setup(){
+	// Voltages relative to sync, from the nesdev wiki
+	static const float black = .518f;
+	static const float white = 1.962f;
+	static const float attenuation = .746f;
+	static const float levels[8] = {
+		.350f, .518f, .962f, 1.550f, 	// signal low
+		1.094f, 1.506f, 1.962f, 1.962f 	// signal high
+	};
+
+	const float pi = 3.14159265f;
+
+	kernels.assign(3 * 512 * 16, 0);
+
+	for(int phase = 0; phase < 3; phase++){
+		for(int value = 0; value < 512; value++){
+			int color = value & 0x0F;
+			int level = (value >> 4) & 0x3;
+			int emphasis = value >> 6;
+
+			if(color > 13)
+				level = 1;
+
+			float low = levels[level];
+			float high = levels[4 + level];
+
+			if(color == 0)
+				low = high;
+
+			if(color > 12)
+				high = low;
+
+			float yiq[4][3] = {};
+
+			for(int p = 0; p < 8; p++){
+				int samplePhase = (phase * 4 + p) % 12;
+
+				auto inColorPhase = [&](int c){ return (c + samplePhase) % 12 < 6; };
+
+				float signal = inColorPhase(color) ? high : low;
+
+				// Colors 14 and 15 are not affected by emphasis
+				if(color < 14 && (((emphasis & 1) && inColorPhase(0xC))
+						|| ((emphasis & 2) && inColorPhase(0x4))
+						|| ((emphasis & 4) && inColorPhase(0x8)))){
+					signal *= attenuation;
+				}
+
+				float sample = (signal - black) / (white - black) / 12;
+
+				// 3.9 samples is the usual decoder hue fix, chroma is demodulated
+				// at twice the sample level
+				float angle = pi * (samplePhase + 3.9f) / 6 + hue * pi / 180;
+
+				// Output pixel j of this pixel decodes the 12 samples centered
+				// on sample 4 * j - 2 of it
+				for(int j = 0; j < 4; j++){
+					int center = 4 * j - 2;
+
+					if(center - 6 <= p && p < center + 6){
+						yiq[j][0] += sample;
+						yiq[j][1] += 2 * sample * cos(angle);
+						yiq[j][2] += 2 * sample * sin(angle);
+					}
+				}
+			}
+
+			int16_t* kernel = &kernels[(phase * 512 + value) * 16];
+
+			for(int j = 0; j < 4; j++){
+				float y = yiq[j][0] * brightness;
+				float i = yiq[j][1] * saturation;
+				float q = yiq[j][2] * saturation;
+
+				float r = y + 0.946882f * i + 0.623557f * q;
+				float g = y - 0.274788f * i - 0.635691f * q;
+				float b = y - 1.108545f * i + 1.709007f * q;
+
+				kernel[j * 4 + 0] = (int16_t)lround(b * 255 * 16);
+				kernel[j * 4 + 1] = (int16_t)lround(g * 255 * 16);
+				kernel[j * 4 + 2] = (int16_t)lround(r * 255 * 16);
+			}
+		}
+	}
+}
+
+// Pixel i starts 8 samples after pixel i - 1, so its phase is 2 further on.
+// Output pixels 2i and 2i + 1 are the first half of the kernel of pixel i
+// plus the second half of the kernel of pixel i - 1.
+void NtscFilter::filterLine(const uint16_t* indices, int phase, uint32_t* rgb){
+	const int16_t* table[3] = { &kernels[0], &kernels[512 * 16], &kernels[2 * 512 * 16] };
+	static const int next[3] = { 2, 0, 1 };
+
+#if defined(__AVX2__)
+	const __m256i round = _mm256_set1_epi16(8);
+	__m256i previous = _mm256_setzero_si256();
+
+	for(int i = 0; i < inputWidth; i += 2){
+		__m256i a = _mm256_loadu_si256((const __m256i*)(table[phase] + (indices[i] & 0x1FF) * 16));
+		phase = next[phase];
+		__m256i b = _mm256_loadu_si256((const __m256i*)(table[phase] + (indices[i + 1] & 0x1FF) * 16));
+		phase = next[phase];
+
+		__m256i sum = _mm256_adds_epi16(_mm256_permute2x128_si256(a, b, 0x20), _mm256_permute2x128_si256(previous, a, 0x31));
+		previous = b;
+
+		sum = _mm256_srai_epi16(_mm256_adds_epi16(sum, round), 4);
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0x08);
+
+		_mm_storeu_si128((__m128i*)(rgb + 2 * i), _mm256_castsi256_si128(packed));
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	const __m128i round = _mm_set1_epi16(8);
+	__m128i previous = _mm_setzero_si128();
+
+	for(int i = 0; i < inputWidth; i++){
+		const int16_t* kernel = table[phase] + (indices[i] & 0x1FF) * 16;
+		phase = next[phase];
+
+		__m128i sum = _mm_adds_epi16(_mm_loadu_si128((const __m128i*)kernel), previous);
+		previous = _mm_loadu_si128((const __m128i*)(kernel + 8));
+
+		sum = _mm_srai_epi16(_mm_adds_epi16(sum, round), 4);
+		_mm_storel_epi64((__m128i*)(rgb + 2 * i), _mm_packus_epi16(sum, sum));
+	}
+#else
+	const int16_t* previous = nullptr;
+
+	for(int i = 0; i < inputWidth; i++){
+		const int16_t* kernel = table[phase] + (indices[i] & 0x1FF) * 16;
+		phase = next[phase];
+
+		uint8_t* out = (uint8_t*)(rgb + 2 * i);
+
+		for(int c = 0; c < 8; c++){
+			int value = (kernel[c] + (previous != nullptr ? previous[8 + c] : 0) + 8) >> 4;
+			out[c] = value < 0 ? 0 : (value > 255 ? 255 : value);
+		}
+
+		previous = kernel;
+	}
+#endif
+}
+
+void NtscFilter::filter(const uint16_t* indices, uint32_t frame, uint32_t* rgb){
+	// A frame is 89341 dots, a scanline 341, and every dot 8 samples out of
+	// a 12 sample subcarrier cycle
+	for(int y = 0; y < height; y++){
+		filterLine(indices + y * inputWidth, (frame * 2 + y) % 3, rgb + y * outputWidth);
+	}
+}
+
+void NtscFilter::start(){
+	if(running)
+		return;
+
+	pending.assign(inputWidth * height, 0);
+	filtered.assign(outputWidth * height, 0);
+	hasPending = false;
+	running = true;
+
+	worker = thread(&NtscFilter::run, this);
+}
+
+void NtscFilter::stop(){
+	{
+		lock_guard<mutex> lock(pendingMutex);
+		running = false;
+	}
+
+	pendingReady.notify_one();
+
+	if(worker.joinable())
+		worker.join();
+}
+
+void NtscFilter::submit(const uint16_t* indices, uint32_t frame){
+	{
+		lock_guard<mutex> lock(pendingMutex);
+
+		if(!running)
+			return;
+
+		if(hasPending)
+			dropped++;
+
+		copy(indices, indices + inputWidth * height, pending.begin());
+		pendingFrame = frame;
+		hasPending = true;
+	}
+
+	pendingReady.notify_one();
+}
+
+void NtscFilter::run(){
+	vector<uint16_t> input(inputWidth * height);
+
+	while(true){
+		uint32_t frame;
+
+		{
+			unique_lock<mutex> lock(pendingMutex);
+			pendingReady.wait(lock, [&](){ return hasPending || !running; });
+
+			if(!running)
+				return;
+
+			input.swap(pending);
+			frame = pendingFrame;
+			hasPending = false;
+		}
+
+		filter(input.data(), frame, filtered.data());
+
+		if(onFrame)
+			onFrame(filtered.data(), frame);
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// NTSC composite video filter for Indexed16 frames (palette index plus
+// emphasis bits). Every pixel is turned into its 8 samples of composite
+// signal and decoded back with a 12 sample window, as on the nesdev wiki.
+// Decoding is linear, so the contribution of one pixel to the 4 output pixels
+// it touches is precomputed for each of the 512 pixel values and the 3
+// subcarrier phases a pixel can start at. Filtering is then one kernel add
+// per input pixel, 256x240 in, 512x240 RGB out.
+class NtscFilter{
+	// [phase][pixel value][output pixel][b, g, r, unused], 4 fraction bits
+	std::vector<int16_t> kernels;
+
+	void filterLine(const uint16_t* indices, int phase, uint32_t* rgb);
+
+	// Background thread
+	std::thread worker;
+	std::mutex pendingMutex;
+	std::condition_variable pendingReady;
+	std::vector<uint16_t> pending;
+	std::vector<uint32_t> filtered;
+	uint32_t pendingFrame = 0;
+	bool hasPending = false;
+	bool running = false;
+
+	void run();
+public:
+	static const int inputWidth = 256;
+	static const int outputWidth = 512;
+	static const int height = 240;
+
+	NtscFilter();
+	~NtscFilter();
+
+	// Picture controls, setup() has to run after changing them
+	float hue = 0; 					// degrees
+	float saturation = 1;
+	float brightness = 1;
+
+	void setup();
+
+	// Frame counts of the ppu shift the subcarrier phase every frame, which
+	// is what makes the dot crawl move
+	void filter(const uint16_t* indices, uint32_t frame, uint32_t* rgb);
+
+	// With the thread started, submit copies the frame and returns at once.
+	// onFrame gets each filtered frame on the filter thread. A frame submitted
+	// while the previous one is still waiting replaces it and counts as dropped.
+	std::function<void(const uint32_t* rgb, uint32_t frame)> onFrame;
+	uint64_t dropped = 0;
+
+	void start();
+	void stop();
+	void submit(const uint16_t* indices, uint32_t frame);
+};
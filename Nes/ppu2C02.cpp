@@ -5,10 +5,21 @@
 
 #include "ppu2C02.h"
 #include "window.h"
+#include "script.h"
+#include "state.h"
 
 using namespace std;
 
-PPU2C02::PPU2C02(){
+PPU2C02::PPU2C02(bool headless) : headless(headless){
+	if(headless){
+		headlessScreen.resize(windowWidth * windowHeight);
+		screen = headlessScreen.data();
+	} else {
+		screen = openWindow();
+	}
+
+	lineCache.resize(240);
+
 	color[0]  = 0x626262;
 	color[1]  = 0x001FB2;
 	color[2]  = 0x2404C8;
@@ -73,6 +84,12 @@ PPU2C02::PPU2C02(){
 	color[61] = 0xB8B8B8;
 	color[62] = 0x000000;
 	color[63] = 0x000000;
+
+	for(int i = 0; i < 8; i++){
+		vramMap[i] = patternTable[i >> 2] + (i & 3) * 1024;
+	}
+
+	setMirroring(Horizontal);
 }
 
 void PPU2C02::reset(){
@@ -94,99 +111,219 @@ void PPU2C02::reset(){
 	ppuctrl.reg = 0;
 	v.reg = 0;
 	t.reg = 0;
-}
+	skipDots = 0;
+	blankPending = false;
+	lineReplay = false;
+	lineRecording = false;
 
-uint8_t PPU2C02::ppuRead(uint16_t address){
-	address &= 0x3FFF;
-
-	if(0x000 <= address && address <= 0xFFF){
-		return patternTable[0][address];
-
-	}else if(0x1000 <= address && address <= 0x1FFF){
-		return patternTable[1][address & 0xFFF];
-
-	}else if(0x2000 <= address && address <= 0x3EFF){
-		address &= 0x0FFF;
-	
-		// Horizontal Mirror
-		if (0x000 <= address && address <= 0x3FF){
-			return nameTable[0][address & 0x3FF];
+	predictStatusEvent();
+}
 
-		}else if(0x400 <= address && address <= 0x7FF){
-			return nameTable[0][address & 0x3FF];
+void PPU2C02::saveState(StateWriter& state){
+	// Skipped and replayed dots are run out, so the fields hold the real state
+	catchUpBlank(cycle);
+	leaveCachedLine();
+
+	state.write(patternTable, sizeof(patternTable));
+	state.write(nameTable, sizeof(nameTable));
+	state.write(paletteTable, sizeof(paletteTable));
+	state.put((uint8_t)nametableMirroring);
+
+	state.put(ppuGenLatch);
+	state.put(v.reg);
+	state.put(t.reg);
+	state.put((uint8_t)x);
+	state.put((uint8_t)w);
+	state.put(ppuDataBuffer);
+
+	state.put(bgNextTileId);
+	state.put(bgNextTileAttribute);
+	state.put(bgNextTileLs);
+	state.put(bgNextTileMs);
+	state.put(bgShifterPatternLs);
+	state.put(bgShifterPatternMs);
+	state.put(bgShifterAttributeLs);
+	state.put(bgShifterAttributeMs);
+	state.write(spriteShifterPatternLs, sizeof(spriteShifterPatternLs));
+	state.write(spriteShifterPatternMs, sizeof(spriteShifterPatternMs));
+	state.put(bSpriteZeroHitPossible);
+	state.put(bSpriteZeroBeingRendered);
+
+	state.put(scanline);
+	state.put(cycle);
+	state.put(oddFrame);
+	state.put(frame);
+	state.put(skipRender);
+	state.put(renderSkipped);
+
+	state.put(skipDots);
+	state.put(blankPending);
+	state.put(blankScanline);
+	state.put(blankCycle);
+
+	state.put(ppuctrl.reg);
+	state.put(ppumask.reg);
+	state.put(ppustatus.reg);
+
+	state.write(oam, sizeof(oam));
+	state.write(spriteScanline, sizeof(spriteScanline));
+	state.put(spriteCount);
+	state.put(oamAddr);
+	state.put(oamData);
+	state.put(ppuScroll);
+	state.put(ppuAddr);
+	state.put(ppuData);
+	state.put(oamDma);
+
+	state.put(statusEventFirst);
+	state.put(statusEventLast);
+	state.put(nmi);
+}
 
-		}else if(0x800 <= address && address <= 0xBFF){
-			return nameTable[1][address & 0x3FF];
+void PPU2C02::loadState(StateReader& state){
+	// Nothing owed from before the load, no cached line is valid for it
+	blankPending = false;
+	lineReplay = false;
+	lineRecording = false;
 
-		}else if(0xC00 <= address && address <= 0xFFF){
-			return nameTable[1][address & 0x3FF];
-		}
-	} else if(0x3F00 <= address && address <= 0x3FFF){
-		address &= 0x1F;
-		if(address == 0x10) 
-			address = 0x0;
+	for(CachedLine& line : lineCache){
+		line.valid = false;
+	}
 
-		if(address == 0x14)
-			address = 0x4;
+	uint8_t value;
+
+	state.read(patternTable, sizeof(patternTable));
+	state.read(nameTable, sizeof(nameTable));
+	state.read(paletteTable, sizeof(paletteTable));
+	state.get(value);
+	setMirroring(value <= FourScreen ? (mirroring)value : Horizontal);
+
+	state.get(ppuGenLatch);
+	state.get(v.reg);
+	state.get(t.reg);
+	state.get(value);
+	x = value;
+	state.get(value);
+	w = value;
+	state.get(ppuDataBuffer);
+
+	state.get(bgNextTileId);
+	state.get(bgNextTileAttribute);
+	state.get(bgNextTileLs);
+	state.get(bgNextTileMs);
+	state.get(bgShifterPatternLs);
+	state.get(bgShifterPatternMs);
+	state.get(bgShifterAttributeLs);
+	state.get(bgShifterAttributeMs);
+	state.read(spriteShifterPatternLs, sizeof(spriteShifterPatternLs));
+	state.read(spriteShifterPatternMs, sizeof(spriteShifterPatternMs));
+	state.get(bSpriteZeroHitPossible);
+	state.get(bSpriteZeroBeingRendered);
+
+	state.get(scanline);
+	state.get(cycle);
+	state.get(oddFrame);
+	state.get(frame);
+	state.get(skipRender);
+	state.get(renderSkipped);
+
+	state.get(skipDots);
+	state.get(blankPending);
+	state.get(blankScanline);
+	state.get(blankCycle);
+
+	state.get(ppuctrl.reg);
+	state.get(ppumask.reg);
+	state.get(ppustatus.reg);
+
+	state.read(oam, sizeof(oam));
+	state.read(spriteScanline, sizeof(spriteScanline));
+	state.get(spriteCount);
+	state.get(oamAddr);
+	state.get(oamData);
+	state.get(ppuScroll);
+	state.get(ppuAddr);
+	state.get(ppuData);
+	state.get(oamDma);
+
+	state.get(statusEventFirst);
+	state.get(statusEventLast);
+	state.get(nmi);
+}
 
-		if(address == 0x18)
-			address = 0x8;
+void PPU2C02::setMirroring(mirroring mode){
+	// Nametable used by each of $2000, $2400, $2800 and $2C00
+	static const uint8_t layouts[5][4] = {
+		{0, 0, 1, 1}, 	// Horizontal
+		{0, 1, 0, 1}, 	// Vertical
+		{0, 0, 0, 0}, 	// SingleScreenLow
+		{1, 1, 1, 1}, 	// SingleScreenHigh
+		{0, 1, 2, 3} 	// FourScreen
+	};
 
-		if(address == 0x1C)
-			address = 0xC;
+	catchUpBlank(cycle);
+	leaveCachedLine();
+	chrVersion++;
+	nametableMirroring = mode;
 
-		return paletteTable[address] & (ppumask.greyscale ? 0x30 : 0x3F);
+	// $3000-$3EFF mirrors $2000-$2EFF
+	for(int i = 0; i < 8; i++){
+		vramMap[8 + i] = nameTable[layouts[mode][i & 3]];
 	}
+}
 
-	return 0;
+void PPU2C02::mapChr(uint8_t page, uint8_t* memory){
+	catchUpBlank(cycle);
+	leaveCachedLine();
+	chrVersion++;
+	vramMap[page & 0x7] = memory;
 }
 
-void PPU2C02::ppuWrite(uint16_t address, uint8_t value){
+uint8_t PPU2C02::ppuRead(uint16_t address){
 	address &= 0x3FFF;
 
-	if(0x000 <= address && address <= 0xFFF){
-		patternTable[0][address] = value;
-
-	}else if(0x1000 <= address && address <= 0x1FFF){
-		patternTable[1][address & 0xFFF] = value;
+	if(address < 0x3F00){
+		return vramMap[address >> 10][address & 0x3FF];
+	}
 
-	}else if(0x2000 <= address && address <= 0x3EFF){
-		address &= 0xFFF;
+	address &= 0x1F;
 
-		// horizontal mirroring
-		if(0x000 <= address && address <= 0x3FF){
-			nameTable[0][address & 0x3FF] = value;
+	// $3F10, $3F14, $3F18 and $3F1C mirror the backdrop entries
+	if((address & 0x13) == 0x10)
+		address &= 0x0F;
 
-		}else if(0x400 <= address && address <= 0x7FF){
-			nameTable[0][address & 0x3FF] = value;
+	return paletteTable[address] & (ppumask.greyscale ? 0x30 : 0x3F);
+}
 
-		}else if(0x800 <= address && address <= 0xBFF){
-			nameTable[1][address & 0x3FF] = value;
+void PPU2C02::ppuWrite(uint16_t address, uint8_t value){
+	address &= 0x3FFF;
 
-		}else if(0xC00 <= address && address <= 0xFFF){
-			nameTable[1][address & 0x3FF] = value;
+	if(address < 0x3F00){
+		if(address < 0x2000){
+			chrVersion++;
+		} else {
+			rowVersion[nametableRow(address)]++;
 		}
-	} else if(0x3F00 <= address && address <= 0x3FFF){
-		address &= 0x1F;
-		if(address == 0x10) 
-			address = 0x0;
 
-		if(address == 0x14)
-			address = 0x4;
+		vramMap[address >> 10][address & 0x3FF] = value;
+		return;
+	}
 
-		if(address == 0x18)
-			address = 0x8;
+	address &= 0x1F;
 
-		if(address == 0x1C)
-			address = 0xC;
-
-		paletteTable[address] = value;
-	}
+	if((address & 0x13) == 0x10)
+		address &= 0x0F;
 
+	paletteTable[address] = value;
 }
 
 // communication used by cpu
 uint8_t PPU2C02::cpuRead(uint16_t address){
+	if(address == 0x7){
+		catchUpBlank(cycle);
+		leaveCachedLine();
+	}
+
 	ppuGenLatch = 0;
 	if(address == 0x2){
 		ppuGenLatch = (ppustatus.reg & 0xE0) | (ppuDataBuffer & 0x1F);
@@ -213,6 +350,9 @@ uint8_t PPU2C02::cpuRead(uint16_t address){
 
 // communication used by cpu
 void PPU2C02::cpuWrite(uint16_t address, uint8_t value){
+	catchUpBlank(cycle);
+	leaveCachedLine();
+
 	if(address == 0x0){
 		ppuctrl.reg = value;
 		t.nametableX = ppuctrl.nametableX;
@@ -221,6 +361,9 @@ void PPU2C02::cpuWrite(uint16_t address, uint8_t value){
 
 	if(address == 0x1){
 		ppumask.reg = value;
+
+		if(ppumask.bgRender || ppumask.spriteRender)
+			skipDots = 0;
 	}
 
 	if(address == 0x3){
@@ -260,11 +403,315 @@ void PPU2C02::cpuWrite(uint16_t address, uint8_t value){
 	}
 }
 
+void PPU2C02::setOutputFormat(outputFormat format){
+	output = format;
+
+	indexed8.assign(format == Indexed8 ? windowWidth * windowHeight : 0, 0);
+	indexed16.assign(format == Indexed16 ? windowWidth * windowHeight : 0, 0);
+}
+
+// RGB post-pass of the indexed frame, does nothing in RGB output
+void PPU2C02::convertFrame(uint32_t* rgb){
+	if(output == Indexed8){
+		indexedToRgb(indexed8.data(), rgb, indexed8.size(), color);
+	} else if(output == Indexed16){
+		indexedToRgb(indexed16.data(), rgb, indexed16.size(), color);
+	}
+}
+
+bool PPU2C02::setObservation(uint8_t* buffer, int width, int height, int cropTop, int cropBottom, bool areaAverage){
+	if(!observation.configure(width, height, cropTop, cropBottom, areaAverage)){
+		observationBuffer = nullptr;
+		return false;
+	}
+
+	observationBuffer = buffer;
+	observation.setPalette(color);
+	return true;
+}
+
+void PPU2C02::observe(uint8_t* buffer){
+	if(output == Indexed8){
+		observation.fromIndexed(indexed8.data(), buffer);
+	} else if(output == Indexed16){
+		observation.fromIndexed(indexed16.data(), buffer);
+	} else {
+		observation.fromRgb(screen, buffer);
+	}
+}
+
 uint32_t PPU2C02::getColor(uint8_t palette, uint8_t pixel){
 	return color[ppuRead(0x3F00 + (palette << 2) + pixel) & 0x3F];
 };
 
 void PPU2C02::clock(){
+	// Nothing the cpu can see happens before the next event, because rendering
+	// is off or the scanline is replayed from the background cache
+	if(skipDots > 0){
+		skipDots--;
+		cycle++;
+		return;
+	}
+
+	if(!(ppumask.bgRender || ppumask.spriteRender)){
+		clockBlank();
+		return;
+	}
+
+	if(blankPending)
+		catchUpBlank(cycle);
+
+	if(scanline == 0 && cycle == 0)
+		cycle = 1;
+
+	if(cycle == 1 && 0 <= scanline && scanline <= 239 && backgroundCache)
+		startCachedLine();
+
+	if(lineReplay){
+		clockCachedLine();
+		return;
+	}
+
+	if(-1 <= scanline && scanline <= 239){
+		if(scanline == -1 && cycle == 1){
+			ppustatus.vBlank = 0;
+			ppustatus.spriteZeroHit = 0;
+			ppustatus.spriteOverflow = 0;
+
+			for(int i = 0; i < 8; ++i){
+				spriteShifterPatternLs[i] = 0;
+				spriteShifterPatternMs[i] = 0;
+			}	
+		}
+
+		clockBackground();
+
+		if(ppumask.spriteRender && 2 <= cycle && cycle < 258){
+			for(int i = 0; i < spriteCount; ++i){
+				if(spriteScanline[i].x > 0){
+					spriteScanline[i].x--;
+				} else {
+					spriteShifterPatternLs[i] <<= 1;
+					spriteShifterPatternMs[i] <<= 1;
+				}
+			}
+		}
+
+		if(cycle == 257 && 0 <= scanline){
+			evaluateSprites();
+		}
+		
+		if(cycle == 340){
+			loadSprites();
+		}
+
+		if(lineRecording){
+			if(cycle == 257){
+				lineCache[scanline].after257 = getBgState();
+			} else if(cycle == 340){
+				finishCachedLine();
+			}
+		}
+	}
+
+	if(241 <= scanline && scanline <= 260){
+		if(scanline == 241 && cycle == 1){
+			ppustatus.vBlank = 1;
+
+			if(ppuctrl.nmiEnable)
+				nmi = true;
+		}
+	}
+
+	if(renderSkipped){
+		// Only sprite zero hit still needs the pixels of a skipped frame
+		if(bSpriteZeroHitPossible && !ppustatus.spriteZeroHit && spriteScanline[0].x == 0
+			&& ppumask.bgRender && ppumask.spriteRender){
+			uint16_t bit_mux = 0x8000 >> x;
+
+			bool bgOpaque = ((bgShifterPatternLs | bgShifterPatternMs) & bit_mux) != 0;
+			bool spriteOpaque = ((spriteShifterPatternLs[0] | spriteShifterPatternMs[0]) & 0x80) != 0;
+
+			if(bgOpaque && spriteOpaque){
+				if(!(ppumask.bgLeftmost | ppumask.spriteLeftmost)){
+					if(9 <= cycle && cycle < 258){
+						ppustatus.spriteZeroHit = 1;
+					}
+				} else {
+					if(1 <= cycle && cycle < 258){
+						ppustatus.spriteZeroHit = 1;
+					}
+				}
+			}
+		}
+	} else {
+		uint8_t bgPixel = 0;
+		uint8_t bgPalette = 0;
+
+		if(ppumask.bgRender){
+			uint16_t bit_mux = 0x8000 >> x;
+
+			uint8_t pixelLs = (bgShifterPatternLs & bit_mux) != 0;
+			uint8_t pixelMs = (bgShifterPatternMs & bit_mux) != 0;
+			bgPixel = (pixelMs << 1) | pixelLs;
+
+			uint8_t palLs = (bgShifterAttributeLs & bit_mux) != 0;
+			uint8_t palMs = (bgShifterAttributeMs & bit_mux) != 0;
+			bgPalette = (palMs << 1) | palLs;
+		}
+
+		if(lineRecording && cycle < 257)
+			lineCache[scanline].bg[cycle - 1] = (bgPalette << 2) | bgPixel;
+
+		uint8_t fgPixel = 0;
+		uint8_t fgPalette = 0;
+		uint8_t fgPriority = 0;
+
+		if(ppumask.spriteRender){
+			bSpriteZeroBeingRendered = false;
+			for(int i = 0; i < spriteCount; ++i){
+				if(spriteScanline[i].x == 0){
+					uint8_t fgPixelLs = (spriteShifterPatternLs[i] & 0x80) > 0;
+					uint8_t fgPixelMs = (spriteShifterPatternMs[i] & 0x80) > 0;
+					fgPixel = (fgPixelMs << 1) | fgPixelLs;
+
+					fgPalette = (spriteScanline[i].attribute & 0x03) + 0x04;
+					fgPriority = (spriteScanline[i].attribute & 0x20) == 0;
+			
+					if(fgPixel != 0){
+						if(i == 0){
+							bSpriteZeroBeingRendered = true;
+						}
+						break;
+					}
+				}
+			}
+		}
+
+		uint8_t pixel = 0;
+		uint8_t palette = 0;
+
+		if(bgPixel == 0 && fgPixel == 0){
+			pixel = 0;
+			palette = 0;
+		} else if(bgPixel == 0 && fgPixel > 0){
+			pixel = fgPixel;
+			palette = fgPalette;
+		} else if(bgPixel > 0 && fgPixel == 0){
+			pixel = bgPixel;
+			palette = bgPalette;
+		} else if(bgPixel > 0 && fgPixel > 0){
+			if(fgPriority){
+				pixel = fgPixel;
+				palette = fgPalette;
+			} else {
+				pixel = bgPixel;
+				palette = bgPalette;
+			}
+
+			if(bSpriteZeroHitPossible && bSpriteZeroBeingRendered){
+				if(ppumask.bgRender & ppumask.spriteRender){
+					if(!(ppumask.bgLeftmost | ppumask.spriteLeftmost)){
+						if(9 <= cycle && cycle < 258){
+							ppustatus.spriteZeroHit = 1;
+						}
+					} else {
+						if(1 <= cycle && cycle < 258){
+							ppustatus.spriteZeroHit = 1;
+						}
+					}
+				}
+			}
+		}
+
+		if(0 < scanline && scanline < 240 && 0 < (cycle - 1) && (cycle - 1) < 256){
+			if(output == RGB){
+				uint32_t pixelColor = getColor(palette, pixel);
+				if(screen[scanline * 256 + (cycle - 1)] != pixelColor){
+					screen[(scanline % 240) * 256 + (cycle - 1)] = pixelColor;
+
+					if(!headless)
+						updateScreen();
+				}
+			} else {
+				uint8_t index = ppuRead(0x3F00 + (palette << 2) + pixel) & 0x3F;
+
+				if(output == Indexed8){
+					indexed8[scanline * 256 + (cycle - 1)] = index;
+				} else {
+					indexed16[scanline * 256 + (cycle - 1)] = index | ((ppumask.reg & 0xE0) << 1);
+				}
+			}
+		}
+	}
+
+	cycle++;
+	if(341 <= cycle){
+		nextScanline();
+	}
+}
+
+void PPU2C02::nextScanline(){
+	cycle = 0;
+	scanline++;
+		
+	if(261 <= scanline){
+		scanline = -1;
+		frame++;
+
+		if(!renderSkipped){
+			if(output != RGB && !headless){
+				convertFrame(screen);
+				updateScreen();
+			}
+
+			if(observationBuffer != nullptr)
+				observe(observationBuffer);
+
+			if(ntsc != nullptr && output == Indexed16)
+				ntsc->submit(indexed16.data(), frame);
+		}
+
+		if(recorder != nullptr){
+			if(renderSkipped){
+				recorder->repeat();
+			} else if(output == RGB){
+				recorder->push(screen);
+			} else if(output == Indexed8){
+				recorder->push(indexed8.data(), color);
+			} else {
+				recorder->push(indexed16.data(), color);
+			}
+		}
+
+		if(frameStream != nullptr && output != RGB){
+			if(renderSkipped){
+				frameStream->repeat();
+			} else if(output == Indexed8){
+				frameStream->push(indexed8.data());
+			} else {
+				frameStream->push(indexed16.data());
+			}
+		}
+
+		if(autoFrameSkip.enabled)
+			skipRender = autoFrameSkip.skipNext();
+
+		renderSkipped = skipRender;
+
+		if(script != nullptr)
+			script->frame();
+	}
+
+	if(script != nullptr)
+		script->scanline(scanline);
+
+	predictStatusEvent();
+}
+
+// Background half of a dot on the pre-render and visible scanlines: shifters,
+// tile fetches and scrolling
+void PPU2C02::clockBackground(){
 	auto incrementScrollX = [&](){
 		if(ppumask.bgRender || ppumask.spriteRender){
 			if(v.coarseX == 31){
@@ -310,15 +757,7 @@ void PPU2C02::clock(){
 		}
 	};
 	
-	auto loadBgShifters = [&](){
-		bgShifterPatternLs = (bgShifterPatternLs & 0xFF00) | bgNextTileLs;
-		bgShifterPatternMs = (bgShifterPatternMs & 0xFF00) | bgNextTileMs;
-
-		bgShifterAttributeLs = (bgShifterAttributeLs & 0xFF00) | ((bgNextTileAttribute & 0b01) ? 0xFF : 0x00);
-		bgShifterAttributeMs = (bgShifterAttributeMs & 0xFF00) | ((bgNextTileAttribute & 0b10) ? 0xFF : 0x00);
-	};
-	
-	auto updateShifters = [&](){
+	if((2 <= cycle && cycle < 258) || (321 <= cycle && cycle < 338)){
 		if(ppumask.bgRender){
 			bgShifterPatternLs <<= 1;
 			bgShifterPatternMs <<= 1;
@@ -327,281 +766,596 @@ void PPU2C02::clock(){
 			bgShifterAttributeMs <<= 1;
 		}
 
-		if(ppumask.spriteRender && 1 <= cycle && cycle < 258){
-			for(int i = 0; i < spriteCount; ++i){
-				if(spriteScanline[i].x > 0){
-					spriteScanline[i].x--;
-				} else {
-					spriteShifterPatternLs[i] <<= 1;
-					spriteShifterPatternMs[i] <<= 1;
-				}
-			}
+		if((cycle - 1) % 8 == 0){
+			loadBgShifters();
+			fetchTileId();
+		}
+		
+		if((cycle - 1) % 8 == 2){
+			fetchTileAttribute();
+		}
+		
+		if((cycle - 1) % 8 == 4){
+			fetchTileLs();
+		}
+		
+		if((cycle - 1) % 8 == 6){
+			fetchTileMs();
 		}
-	};
-
-	if(-1 <= scanline && scanline <= 239){
-		if(scanline == -1 && cycle == 1){
-			ppustatus.vBlank = 0;
-			ppustatus.spriteZeroHit = 0;
-			ppustatus.spriteOverflow = 0;
 
-			for(int i = 0; i < 8; ++i){
-				spriteShifterPatternLs[i] = 0;
-				spriteShifterPatternMs[i] = 0;
-			}	
+		if((cycle - 1) % 8 == 7){
+			incrementScrollX();
 		}
+	}
 
-		if(scanline == 0 && cycle == 0)
-			cycle = 1;
+	if(cycle == 256){
+		incrementScrollY();
+	}
 
-		if((2 <= cycle && cycle < 258) || (321 <= cycle && cycle < 338)){
-			updateShifters();
+	if(cycle == 257){
+		loadBgShifters();
+		transferAddressX();
+	}
 
-			if((cycle - 1) % 8 == 0){
-				loadBgShifters();
-				bgNextTileId = ppuRead(0x2000 | (v.reg & 0xFFF));
-			}
-			
-			if((cycle - 1) % 8 == 2){
-				bgNextTileAttribute = ppuRead(0x23C0 | (v.nametableY << 11) 
-													| (v.nametableX << 10) 
-													| ((v.coarseY >> 2) << 3)
-													| (v.coarseX >> 2));
-
-				if(v.coarseY & 0x2) bgNextTileAttribute >>= 4;
-				if(v.coarseX & 0x2) bgNextTileAttribute >>= 2;
-				bgNextTileAttribute &= 0x03;
-			}
-			
-			if((cycle - 1) % 8 == 4){
-				bgNextTileLs = ppuRead((ppuctrl.bgTile << 12) 
-										+ ((uint16_t)bgNextTileId << 4)
-										+ v.fineY);
-			}
-			
-			if((cycle - 1) % 8 == 6){
-				bgNextTileMs = ppuRead((ppuctrl.bgTile << 12)
-										+ ((uint16_t)bgNextTileId << 4) 
-										+ (v.fineY) + 8);
-			}
+	if(cycle == 338 || cycle == 340){
+		fetchTileId();
+	}
+
+	if(scanline == -1 && 280 <= cycle && cycle < 305){
+		transferAddressY();
+	}
+}
+
+void PPU2C02::loadBgShifters(){
+	bgShifterPatternLs = (bgShifterPatternLs & 0xFF00) | bgNextTileLs;
+	bgShifterPatternMs = (bgShifterPatternMs & 0xFF00) | bgNextTileMs;
+
+	bgShifterAttributeLs = (bgShifterAttributeLs & 0xFF00) | ((bgNextTileAttribute & 0b01) ? 0xFF : 0x00);
+	bgShifterAttributeMs = (bgShifterAttributeMs & 0xFF00) | ((bgNextTileAttribute & 0b10) ? 0xFF : 0x00);
+}
+
+void PPU2C02::fetchTileId(){
+	uint16_t address = 0x2000 | (v.reg & 0xFFF);
+
+	if(lineRecording)
+		addDependency(address);
+
+	bgNextTileId = ppuRead(address);
+}
+
+void PPU2C02::fetchTileAttribute(){
+	uint16_t address = 0x23C0 | (v.nametableY << 11) 
+								| (v.nametableX << 10) 
+								| ((v.coarseY >> 2) << 3)
+								| (v.coarseX >> 2);
+
+	if(lineRecording)
+		addDependency(address);
+
+	bgNextTileAttribute = ppuRead(address);
+
+	if(v.coarseY & 0x2) bgNextTileAttribute >>= 4;
+	if(v.coarseX & 0x2) bgNextTileAttribute >>= 2;
+	bgNextTileAttribute &= 0x03;
+}
+
+void PPU2C02::fetchTileLs(){
+	bgNextTileLs = ppuRead((ppuctrl.bgTile << 12) 
+							+ ((uint16_t)bgNextTileId << 4)
+							+ v.fineY);
+}
+
+void PPU2C02::fetchTileMs(){
+	bgNextTileMs = ppuRead((ppuctrl.bgTile << 12)
+							+ ((uint16_t)bgNextTileId << 4) 
+							+ (v.fineY) + 8);
+}
+
+// Index into rowVersion of the 32 byte nametable row holding a $2000-$3EFF address
+uint16_t PPU2C02::nametableRow(uint16_t address){
+	uint16_t table = (vramMap[(address >> 10) & 0xF] - nameTable[0]) >> 10;
+	return (table << 5) | ((address & 0x3FF) >> 5);
+}
+
+PPU2C02::BgState PPU2C02::getBgState(){
+	BgState state;
+
+	state.v = v.reg;
+	state.t = t.reg;
+	state.patternLs = bgShifterPatternLs;
+	state.patternMs = bgShifterPatternMs;
+	state.attributeLs = bgShifterAttributeLs;
+	state.attributeMs = bgShifterAttributeMs;
+	state.nextId = bgNextTileId;
+	state.nextAttribute = bgNextTileAttribute;
+	state.nextLs = bgNextTileLs;
+	state.nextMs = bgNextTileMs;
+	state.fineX = x;
+	state.bgTile = ppuctrl.bgTile;
+
+	return state;
+}
+
+// t, fine x and the pattern table never change inside a cached scanline
+void PPU2C02::setBgState(const BgState& state){
+	v.reg = state.v;
+	bgShifterPatternLs = state.patternLs;
+	bgShifterPatternMs = state.patternMs;
+	bgShifterAttributeLs = state.attributeLs;
+	bgShifterAttributeMs = state.attributeMs;
+	bgNextTileId = state.nextId;
+	bgNextTileAttribute = state.nextAttribute;
+	bgNextTileLs = state.nextLs;
+	bgNextTileMs = state.nextMs;
+}
+
+void PPU2C02::addDependency(uint16_t address){
+	CachedLine& line = lineCache[scanline];
+	uint16_t row = nametableRow(address);
+
+	for(int i = 0; i < line.dependencyCount; i++){
+		if(line.dependencies[i] == row)
+			return;
+	}
+
+	if(line.dependencyCount == CachedLine::maxDependencies){
+		lineRecording = false;
+		return;
+	}
+
+	line.dependencies[line.dependencyCount] = row;
+	line.dependencyVersions[line.dependencyCount] = rowVersion[row];
+	line.dependencyCount++;
+}
+
+// Dot 1 of a visible scanline. A scanline starting from the same background
+// state as last time, with none of the nametable rows or pattern memory it
+// read written since, fetches and draws exactly the same background again.
+// Without sprites to mix in it is replayed from the cache, otherwise it is
+// recorded while it runs.
+void PPU2C02::startCachedLine(){
+	lineRecording = false;
+
+	if(!ppumask.bgRender)
+		return;
+
+	CachedLine& line = lineCache[scanline];
+	BgState state = getBgState();
+
+	bool hit = line.valid && line.chrVersion == chrVersion && memcmp(&line.before, &state, sizeof(BgState)) == 0;
+
+	for(int i = 0; hit && i < line.dependencyCount; i++){
+		hit = rowVersion[line.dependencies[i]] == line.dependencyVersions[i];
+	}
+
+	if(!hit){
+		if(renderSkipped)
+			return;
+
+		line.valid = false;
+		line.before = state;
+		line.chrVersion = chrVersion;
+		line.dependencyCount = 0;
+		lineRecording = true;
+		return;
+	}
+
+	if(ppumask.spriteRender && spriteCount > 0)
+		return;
+
+	lineReplay = true;
+	linePixels = 2;
+
+	if(ppumask.spriteRender)
+		bSpriteZeroBeingRendered = false;
+}
+
+// Dot 340 of a recorded scanline
+void PPU2C02::finishCachedLine(){
+	CachedLine& line = lineCache[scanline];
+
+	line.after340 = getBgState();
+	line.valid = true;
+	lineRecording = false;
+}
+
+// Event dots of a replayed scanline, the ones between are skipped
+void PPU2C02::clockCachedLine(){
+	CachedLine& line = lineCache[scanline];
+
+	if(cycle == 257){
+		drawCachedLine(257);
+		evaluateSprites();
+		setBgState(line.after257);
+	} else if(cycle == 340){
+		loadSprites();
+		setBgState(line.after340);
+		lineReplay = false;
+	}
+
+	cycle++;
+	if(341 <= cycle){
+		nextScanline();
+	}
+
+	if(lineReplay)
+		skipDots = (cycle <= 257 ? 257 : 340) - cycle;
+}
+
+// Pixels of a replayed scanline up to toCycle
+void PPU2C02::drawCachedLine(int16_t toCycle){
+	CachedLine& line = lineCache[scanline];
+
+	int16_t from = linePixels;
+	int16_t to = toCycle > 257 ? 257 : toCycle;
+	linePixels = to;
 
-			if((cycle - 1) % 8 == 7){
-				incrementScrollX();
+	if(scanline == 0 || renderSkipped || from >= to)
+		return;
+
+	// Palette index of each palette / pixel pair, pixel 0 is always the backdrop
+	uint8_t index[16];
+	for(int i = 0; i < 16; i++){
+		index[i] = ppuRead(0x3F00 + ((i & 0x3) ? i : 0)) & 0x3F;
+	}
+
+	if(output == RGB){
+		uint32_t* row = &screen[scanline * 256 - 1];
+		bool changed = false;
+
+		for(int16_t c = from; c < to; c++){
+			uint32_t pixelColor = color[index[line.bg[c - 1]]];
+
+			if(row[c] != pixelColor){
+				row[c] = pixelColor;
+				changed = true;
 			}
 		}
 
-		if(cycle == 256){
-			incrementScrollY();
-		}
+		if(changed && !headless)
+			updateScreen();
+	} else if(output == Indexed8){
+		uint8_t* row = &indexed8[scanline * 256 - 1];
 
-		if(cycle == 257){
-			loadBgShifters();
-			transferAddressX();
+		for(int16_t c = from; c < to; c++){
+			row[c] = index[line.bg[c - 1]];
 		}
+	} else {
+		uint16_t* row = &indexed16[scanline * 256 - 1];
+		uint16_t emphasis = (ppumask.reg & 0xE0) << 1;
 
-		if(cycle == 338 || cycle == 340){
-			bgNextTileId = ppuRead(0x2000 | (v.reg & 0xFFF));
+		for(int16_t c = from; c < to; c++){
+			row[c] = index[line.bg[c - 1]] | emphasis;
 		}
+	}
+}
 
-		if(scanline == -1 && 280 <= cycle && cycle < 305){
-			transferAddressY();
-		}
+// The cpu is about to touch the ppu mid scanline. A recording is dropped, a
+// replay draws what it skipped and runs the background dots it skipped for
+// real, so the scanline carries on exactly as if it was never cached.
+void PPU2C02::leaveCachedLine(){
+	lineRecording = false;
 
-		if(cycle == 257 && 0 <= scanline){
-			std::memset(spriteScanline, 0xFF, 8 * sizeof(spriteObject));
-			spriteCount = 0;
+	if(!lineReplay)
+		return;
 
-			for(int i = 0; i < 8; ++i){
-				spriteShifterPatternLs[i] = 0;
-				spriteShifterPatternMs[i] = 0;
-			}
+	lineReplay = false;
+	skipDots = 0;
 
-			uint8_t nOAMEntry = 0;
+	drawCachedLine(cycle);
 
-			bSpriteZeroHitPossible = false;
+	CachedLine& line = lineCache[scanline];
+	int16_t current = cycle;
 
-			while(nOAMEntry < 64 && spriteCount < 9){
-				int16_t diff = ((int16_t)scanline - (int16_t)oam[nOAMEntry].y);
+	if(current > 257){
+		setBgState(line.after257);
+		cycle = 258;
+	} else {
+		setBgState(line.before);
+		cycle = 1;
+	}
 
-				if(0 <= diff && diff < (ppuctrl.spriteHeight ? 16 : 8)){
-					if(spriteCount < 8){
-						if(nOAMEntry == 0){
-							bSpriteZeroHitPossible = true;
-						}
+	for(; cycle < current; cycle++){
+		clockBackground();
+	}
+}
 
-						memcpy(&spriteScanline[spriteCount], &oam[nOAMEntry], sizeof(spriteObject));
-						spriteCount++;
-					}
+// Sprites on this scanline, at cycle 257
+void PPU2C02::evaluateSprites(){
+	std::memset(spriteScanline, 0xFF, 8 * sizeof(spriteObject));
+	spriteCount = 0;
+
+	for(int i = 0; i < 8; ++i){
+		spriteShifterPatternLs[i] = 0;
+		spriteShifterPatternMs[i] = 0;
+	}
+
+	uint8_t nOAMEntry = 0;
+
+	bSpriteZeroHitPossible = false;
+
+	while(nOAMEntry < 64 && spriteCount < 9){
+		int16_t diff = ((int16_t)scanline - (int16_t)oam[nOAMEntry].y);
+
+		if(0 <= diff && diff < (ppuctrl.spriteHeight ? 16 : 8)){
+			if(spriteCount < 8){
+				if(nOAMEntry == 0){
+					bSpriteZeroHitPossible = true;
 				}
 
-				nOAMEntry++;
+				memcpy(&spriteScanline[spriteCount], &oam[nOAMEntry], sizeof(spriteObject));
+				spriteCount++;
 			}
-
-			ppustatus.spriteOverflow = (spriteCount > 8);
 		}
-		
-		if(cycle == 340){
-			for(int i = 0; i < spriteCount; ++i){
-				uint8_t spritePatternBitsLs, spritePatternBitsMs;
-				uint16_t spritePatternAddrLs, spritePatternAddrMs;
-
-				if(!ppuctrl.spriteHeight){
-					if(!(spriteScanline[i].attribute & 0x80)){
-						spritePatternAddrLs = (ppuctrl.spriteTile << 12) 
-							| (spriteScanline[i].index << 4) 
-							| (scanline - spriteScanline[i].y);
-					} else {
-						spritePatternAddrLs = (ppuctrl.spriteTile << 12)
-							| (spriteScanline[i].index << 4)
-							| (7 - (scanline - spriteScanline[i].y));
-					}
+
+		nOAMEntry++;
+	}
+
+	ppustatus.spriteOverflow = (spriteCount > 8);
+}
+
+// Pattern bits of the evaluated sprites, at cycle 340
+void PPU2C02::loadSprites(){
+	for(int i = 0; i < spriteCount; ++i){
+		uint8_t spritePatternBitsLs, spritePatternBitsMs;
+		uint16_t spritePatternAddrLs, spritePatternAddrMs;
+
+		if(!ppuctrl.spriteHeight){
+			if(!(spriteScanline[i].attribute & 0x80)){
+				spritePatternAddrLs = (ppuctrl.spriteTile << 12) 
+					| (spriteScanline[i].index << 4) 
+					| (scanline - spriteScanline[i].y);
+			} else {
+				spritePatternAddrLs = (ppuctrl.spriteTile << 12)
+					| (spriteScanline[i].index << 4)
+					| (7 - (scanline - spriteScanline[i].y));
+			}
+		} else {
+			if(!(spriteScanline[i].attribute & 0x80)){
+				if(scanline - spriteScanline[i].y < 8){
+					spritePatternAddrLs = ((spriteScanline[i].index & 0x1) << 12)
+						| ((spriteScanline[i].index & 0xFE) << 4)
+						| ((scanline - spriteScanline[i].y) & 0x7);
 				} else {
-					if(!(spriteScanline[i].attribute & 0x80)){
-						if(scanline - spriteScanline[i].y < 8){
-							spritePatternAddrLs = ((spriteScanline[i].index & 0x1) << 12)
-								| ((spriteScanline[i].index & 0xFE) << 4)
-								| ((scanline - spriteScanline[i].y) & 0x7);
-						} else {
-							spritePatternAddrLs = ((spriteScanline[i].index & 0x1) << 12)
-								| (((spriteScanline[i].index & 0xFE) + 1) << 4)
-								| ((scanline - spriteScanline[i].y) & 0x7);
-						}
-					} else {
-						if(scanline - spriteScanline[i].y < 8){
-							spritePatternAddrLs = ((spriteScanline[i].index & 0x1) << 12)
-								| (((spriteScanline[i].index & 0xFE) + 1) << 4)
-								| (7 - (scanline - spriteScanline[i].y) & 0x7);
-						} else {
-							spritePatternAddrLs = ((spriteScanline[i].index & 0x1) << 12)
-								| ((spriteScanline[i].index & 0xFE) << 4)
-								| (7 - (scanline - spriteScanline[i].y) & 0x7);
-						}
-					}
+					spritePatternAddrLs = ((spriteScanline[i].index & 0x1) << 12)
+						| (((spriteScanline[i].index & 0xFE) + 1) << 4)
+						| ((scanline - spriteScanline[i].y) & 0x7);
 				}
+			} else {
+				if(scanline - spriteScanline[i].y < 8){
+					spritePatternAddrLs = ((spriteScanline[i].index & 0x1) << 12)
+						| (((spriteScanline[i].index & 0xFE) + 1) << 4)
+						| (7 - (scanline - spriteScanline[i].y) & 0x7);
+				} else {
+					spritePatternAddrLs = ((spriteScanline[i].index & 0x1) << 12)
+						| ((spriteScanline[i].index & 0xFE) << 4)
+						| (7 - (scanline - spriteScanline[i].y) & 0x7);
+				}
+			}
+		}
 
-				spritePatternAddrMs = spritePatternAddrLs + 8;
-
-				spritePatternBitsLs = ppuRead(spritePatternAddrLs);
-				spritePatternBitsMs = ppuRead(spritePatternAddrMs);
+		spritePatternAddrMs = spritePatternAddrLs + 8;
 
-				if(spriteScanline[i].attribute & 0x40){
-					auto flipbyte = [](uint8_t b){
-						b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
-						b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
-						b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
-						return b;
-					};
+		spritePatternBitsLs = ppuRead(spritePatternAddrLs);
+		spritePatternBitsMs = ppuRead(spritePatternAddrMs);
 
-					spritePatternBitsLs = flipbyte(spritePatternBitsLs);
-					spritePatternBitsMs = flipbyte(spritePatternBitsMs);
-				}
+		if(spriteScanline[i].attribute & 0x40){
+			auto flipbyte = [](uint8_t b){
+				b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+				b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+				b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+				return b;
+			};
 
-				spriteShifterPatternLs[i] = spritePatternBitsLs;
-				spriteShifterPatternMs[i] = spritePatternBitsMs;
-			}
+			spritePatternBitsLs = flipbyte(spritePatternBitsLs);
+			spritePatternBitsMs = flipbyte(spritePatternBitsMs);
 		}
+
+		spriteShifterPatternLs[i] = spritePatternBitsLs;
+		spriteShifterPatternMs[i] = spritePatternBitsMs;
 	}
+}
 
-	if(241 <= scanline && scanline <= 260){
-		if(scanline == 241 && cycle == 1){
-			ppustatus.vBlank = 1;
+// A dot with bg and sprite rendering both off. Only vblank, the pre-render
+// clear and sprite evaluation run here, the dots between them are counted
+// down by skipDots. Background fetches and backdrop pixels are left to
+// catchUpBlank, which runs before the cpu changes anything they read.
+void PPU2C02::clockBlank(){
+	if(scanline == 0 && cycle == 0)
+		cycle = 1;
+
+	if(!blankPending){
+		blankPending = true;
+		blankScanline = scanline;
+		blankCycle = cycle;
+	}
 
-			if(ppuctrl.nmiEnable)
-				nmi = true;
+	if(scanline == -1 && cycle == 1){
+		ppustatus.vBlank = 0;
+		ppustatus.spriteZeroHit = 0;
+		ppustatus.spriteOverflow = 0;
+
+		for(int i = 0; i < 8; ++i){
+			spriteShifterPatternLs[i] = 0;
+			spriteShifterPatternMs[i] = 0;
 		}
 	}
 
-	uint8_t bgPixel = 0;
-	uint8_t bgPalette = 0;
+	if(scanline == 241 && cycle == 1){
+		ppustatus.vBlank = 1;
 
-	if(ppumask.bgRender){
-		uint16_t bit_mux = 0x8000 >> x;
+		if(ppuctrl.nmiEnable)
+			nmi = true;
+	}
 
-		uint8_t pixelLs = (bgShifterPatternLs & bit_mux) != 0;
-		uint8_t pixelMs = (bgShifterPatternMs & bit_mux) != 0;
-		bgPixel = (pixelMs << 1) | pixelLs;
+	if(0 <= scanline && scanline <= 239){
+		if(cycle == 257)
+			evaluateSprites();
 
-		uint8_t palLs = (bgShifterAttributeLs & bit_mux) != 0;
-		uint8_t palMs = (bgShifterAttributeMs & bit_mux) != 0;
-		bgPalette = (palMs << 1) | palLs;
+		if(cycle == 340)
+			loadSprites();
 	}
 
-	uint8_t fgPixel = 0;
-	uint8_t fgPalette = 0;
-	uint8_t fgPriority = 0;
+	if(cycle == 340)
+		catchUpBlank(341);
 
-	if(ppumask.spriteRender){
-		bSpriteZeroBeingRendered = false;
-		for(int i = 0; i < spriteCount; ++i){
-			if(spriteScanline[i].x == 0){
-				uint8_t fgPixelLs = (spriteShifterPatternLs[i] & 0x80) > 0;
-				uint8_t fgPixelMs = (spriteShifterPatternMs[i] & 0x80) > 0;
-				fgPixel = (fgPixelMs << 1) | fgPixelLs;
-
-				fgPalette = (spriteScanline[i].attribute & 0x03) + 0x04;
-				fgPriority = (spriteScanline[i].attribute & 0x20) == 0;
-			
-				if(fgPixel != 0){
-					if(i == 0){
-						bSpriteZeroBeingRendered = true;
+	cycle++;
+	if(341 <= cycle){
+		nextScanline();
+
+		blankScanline = scanline;
+		blankCycle = 0;
+	}
+
+	// Next dot with an event, the last dot of a scanline always has one
+	int16_t next = 340;
+
+	if(scanline == -1 || scanline == 241){
+		if(cycle <= 1)
+			next = 1;
+	} else if(0 <= scanline && scanline <= 239){
+		if(cycle <= 257)
+			next = 257;
+	}
+
+	// The first dot of scanline 0 is skipped, clockBlank handles it
+	if(scanline == 0 && cycle == 0)
+		next = 0;
+
+	skipDots = next - cycle;
+}
+
+// Background fetches and backdrop pixels of the blank dots from blankCycle up
+// to toCycle. Everything they read is unchanged over those dots, so once each
+// fetch has run after a tile id fetch and the shifters were loaded again the
+// rest would only repeat the same values.
+void PPU2C02::catchUpBlank(int16_t toCycle){
+	if(!blankPending)
+		return;
+
+	int16_t line = blankScanline;
+	int16_t first = blankCycle;
+	int16_t last = line == scanline ? toCycle : 341;
+
+	// Still blank from here on unless rendering was just turned on
+	blankPending = !(ppumask.bgRender || ppumask.spriteRender);
+	blankScanline = scanline;
+	blankCycle = toCycle;
+
+	if(0 < line && line < 240 && !renderSkipped){
+		int16_t from = first < 2 ? 2 : first;
+		int16_t to = last > 257 ? 257 : last;
+
+		if(from < to){
+			uint8_t index = ppuRead(0x3F00) & 0x3F;
+
+			if(output == RGB){
+				uint32_t pixelColor = color[index];
+				bool changed = false;
+
+				for(int16_t c = from; c < to; c++){
+					if(screen[line * 256 + (c - 1)] != pixelColor){
+						screen[line * 256 + (c - 1)] = pixelColor;
+						changed = true;
 					}
-					break;
 				}
+
+				if(changed && !headless)
+					updateScreen();
+			} else if(output == Indexed8){
+				std::memset(&indexed8[line * 256 + (from - 1)], index, to - from);
+			} else {
+				uint16_t value = index | ((ppumask.reg & 0xE0) << 1);
+				std::fill(&indexed16[line * 256 + (from - 1)], &indexed16[line * 256 + (to - 1)], value);
 			}
 		}
 	}
 
-	uint8_t pixel = 0;
-	uint8_t palette = 0;
+	if(line < -1 || 239 < line)
+		return;
 
-	if(bgPixel == 0 && fgPixel == 0){
-		pixel = 0;
-		palette = 0;
-	} else if(bgPixel == 0 && fgPixel > 0){
-		pixel = fgPixel;
-		palette = fgPalette;
-	} else if(bgPixel > 0 && fgPixel == 0){
-		pixel = bgPixel;
-		palette = bgPalette;
-	} else if(bgPixel > 0 && fgPixel > 0){
-		if(fgPriority){
-			pixel = fgPixel;
-			palette = fgPalette;
-		} else {
-			pixel = bgPixel;
-			palette = bgPalette;
-		}
+	enum { Id = 1, Attribute = 2, Ls = 4, Ms = 8, All = 15 };
+	uint8_t fetched = 0;
 
-		if(bSpriteZeroHitPossible && bSpriteZeroBeingRendered){
-			if(ppumask.bgRender & ppumask.spriteRender){
-				if(!(ppumask.bgLeftmost | ppumask.spriteLeftmost)){
-					if(9 <= cycle && cycle < 258){
-						ppustatus.spriteZeroHit = 1;
-					}
-				} else {
-					if(1 <= cycle && cycle < 258){
-						ppustatus.spriteZeroHit = 1;
-					}
-				}
+	for(int16_t c = first; c < last; c++){
+		if((2 <= c && c < 258) || (321 <= c && c < 338)){
+			switch((c - 1) % 8){
+			case 0:
+				loadBgShifters();
+
+				if(fetched == All)
+					return;
+
+				fetchTileId();
+				fetched |= Id;
+				break;
+			case 2:
+				fetchTileAttribute();
+				fetched |= Attribute;
+				break;
+			case 4:
+				fetchTileLs();
+				fetched |= (fetched & Id) ? Ls : 0;
+				break;
+			case 6:
+				fetchTileMs();
+				fetched |= (fetched & Id) ? Ms : 0;
+				break;
 			}
 		}
-	}
 
-	if(0 < scanline && scanline < 240 && 0 < (cycle - 1) && (cycle - 1) < 256){
-		uint32_t pixelColor = getColor(palette, pixel);
-		if(windowPixelColor[scanline * 256 + (cycle - 1)] != pixelColor){
-			windowPixelColor[(scanline % 240) * 256 + (cycle - 1)] = pixelColor;
-			updateScreen();
+		if(c == 257){
+			loadBgShifters();
+
+			if(fetched == All)
+				return;
 		}
-	}
 
-	cycle++;
-	if(341 <= cycle){
-		cycle = 0;
-		scanline++;
-			
-		if(261 <= scanline){
-			scanline = -1;
+		if(c == 338 || c == 340){
+			fetchTileId();
+			fetched |= Id;
 		}
 	}
 }
+
+int32_t PPU2C02::dotsUntilCpuEvent(){
+	if(nmi)
+		return 0;
+
+	const int32_t frameDots = 262 * 341;
+	const int32_t vblankDot = (241 + 1) * 341 + 1;
+
+	// The next clock runs the dot at position
+	int32_t position = (scanline + 1) * 341 + cycle;
+	int32_t dots = frameDots - position;
+
+	if(ppuctrl.nmiEnable){
+		int32_t untilNmi = vblankDot - position + 1;
+		if(untilNmi <= 0)
+			untilNmi += frameDots;
+
+		if(untilNmi < dots)
+			dots = untilNmi;
+	}
+
+	return dots;
+}
+
+// Called at the start of every scanline
+void PPU2C02::predictStatusEvent(){
+	statusEventFirst = 1;
+	statusEventLast = 0;
+
+	// vblank set, and vblank / sprite zero / overflow cleared
+	if(scanline == 241 || scanline == -1){
+		statusEventLast = 1;
+		return;
+	}
+
+	// Sprite evaluation stops at 8 sprites, so it never sets the overflow flag.
+	// Sprite zero can hit from the dot its x counter runs out until cycle 257.
+	if(0 <= scanline && scanline <= 239 && bSpriteZeroHitPossible && !ppustatus.spriteZeroHit){
+		statusEventFirst = spriteScanline[0].x + 1;
+		statusEventLast = 257;
+	}
+}
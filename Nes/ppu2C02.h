@@ -5,8 +5,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <cstring>
+#include <vector>
 
 #include "window.h"
+#include "framebuffer.h"
+#include "frameskip.h"
+#include "ntscfilter.h"
+#include "recorder.h"
+#include "framestream.h"
+
+class Script;
+class StateWriter;
+class StateReader;
 
 class PPU2C02{	
 	uint32_t color[64];
@@ -15,6 +25,9 @@ class PPU2C02{
 	uint8_t nameTable[4][1024];
 	uint8_t paletteTable[32];
 
+	// 1K pages of $0000-$3EFF: pattern tables in 0-7, nametables in 8-15
+	uint8_t* vramMap[16];
+
 	uint8_t ppuGenLatch = 0;
 
 	union loopyRegister{
@@ -54,9 +67,135 @@ class PPU2C02{
 	int16_t cycle = 0;
 	bool oddFrame = false;
 
-	HANDLE thread = CreateThread(NULL, 0, ep, NULL, 0, NULL);
+	// Rendering off: dots left before the next one with an event, and the
+	// first dot whose background fetches and pixels catchUpBlank still owes
+	int16_t skipDots = 0;
+	bool blankPending = false;
+	int16_t blankScanline = 0;
+	int16_t blankCycle = 0;
+
+	void clockBlank();
+	void catchUpBlank(int16_t toCycle);
+	void nextScanline();
+
+	void loadBgShifters();
+	void fetchTileId();
+	void fetchTileAttribute();
+	void fetchTileLs();
+	void fetchTileMs();
+
+	void evaluateSprites();
+	void loadSprites();
+	void clockBackground();
+
+	// Everything the background of a scanline depends on besides memory
+	struct BgState{
+		uint16_t v, t;
+		uint16_t patternLs, patternMs, attributeLs, attributeMs;
+		uint8_t nextId, nextAttribute, nextLs, nextMs;
+		uint8_t fineX, bgTile;
+	};
+
+	// Background of one visible scanline: the state it started from, the
+	// state after dots 257 and 340, the nametable rows it read and the
+	// palette / pixel pair of dots 2-256
+	struct CachedLine{
+		static const int maxDependencies = 12;
+
+		bool valid = false;
+		BgState before, after257, after340;
+		uint32_t chrVersion;
+		uint8_t dependencyCount;
+		uint16_t dependencies[maxDependencies];
+		uint32_t dependencyVersions[maxDependencies];
+		uint8_t bg[256];
+	};
+
+	std::vector<CachedLine> lineCache;
+
+	// Bumped by writes to a 32 byte nametable row, and to pattern memory,
+	// CHR banks or mirroring
+	uint32_t rowVersion[4 * 32] = {};
+	uint32_t chrVersion = 0;
+
+	bool lineRecording = false;
+	bool lineReplay = false;
+	int16_t linePixels = 0; 			// first replayed dot not drawn yet
+
+	uint16_t nametableRow(uint16_t address);
+	BgState getBgState();
+	void setBgState(const BgState& state);
+	void addDependency(uint16_t address);
+
+	void startCachedLine();
+	void finishCachedLine();
+	void clockCachedLine();
+	void drawCachedLine(int16_t toCycle);
+	void leaveCachedLine();
+
+	std::vector<uint32_t> headlessScreen;
 public:
-	PPU2C02();
+	PPU2C02(bool headless = false);
+
+	// A headless ppu draws into its own buffer instead of the window
+	bool headless;
+
+	// Finished pixels, 256x240 RGB
+	uint32_t* screen = windowPixelColor;
+
+	enum outputFormat{
+		RGB = 0, 			// screen only
+		Indexed8 = 1, 		// palette index per pixel
+		Indexed16 = 2 		// palette index, PPUMASK emphasis bits in bits 6-8
+	};
+
+	// Indexed formats skip the RGB lookup while rendering. A windowed ppu
+	// converts into screen once per frame, headless callers use convertFrame.
+	outputFormat output = RGB;
+	std::vector<uint8_t> indexed8;
+	std::vector<uint16_t> indexed16;
+
+	void setOutputFormat(outputFormat format);
+	void convertFrame(uint32_t* rgb);
+
+	const uint32_t* getPalette(){ return color; }
+
+	// When set, every finished frame is also written to this buffer as a
+	// downsampled greyscale observation. setObservation leaves the buffer
+	// unset and returns false for settings Observation::configure rejects.
+	Observation observation;
+	uint8_t* observationBuffer = nullptr;
+
+	bool setObservation(uint8_t* buffer, int width, int height, int cropTop = 8, int cropBottom = 8, bool areaAverage = true);
+	void observe(uint8_t* buffer);
+
+	// Gets every finished Indexed16 frame, on its own thread once started
+	NtscFilter* ntsc = nullptr;
+
+	// Gets every finished frame in the output format, skipped frames as repeats
+	FrameRecorder* recorder = nullptr;
+
+	// Gets every finished frame of an indexed output format
+	FrameStreamWriter* frameStream = nullptr;
+
+	// Runs its frame callbacks as each frame finishes and its scanline
+	// callbacks as each scanline starts
+	Script* script = nullptr;
+
+	// Frames completed since power on
+	uint32_t frame = 0;
+
+	// Frames started with skipRender set keep all timing, vblank, NMI and
+	// sprite zero hit but produce no pixels, observation or window update
+	bool skipRender = false;
+	bool renderSkipped = false;
+
+	// Sets skipRender for every frame while enabled
+	AutoFrameSkip autoFrameSkip;
+
+	// Reuse the background of scanlines that would be drawn the same as in
+	// the last frame. Output is identical either way.
+	bool backgroundCache = true;
 	
 	union PPUCTRL{
 		struct {
@@ -117,6 +256,22 @@ public:
 	uint8_t ppuData = 0;
 	uint8_t oamDma = 0;
 	
+	enum mirroring{
+		Horizontal = 0, 		// $2000 = $2400, $2800 = $2C00
+		Vertical = 1, 			// $2000 = $2800, $2400 = $2C00
+		SingleScreenLow = 2,
+		SingleScreenHigh = 3,
+		FourScreen = 4
+	};
+
+	mirroring nametableMirroring = Horizontal;
+
+	// Set by the cartridge, or by a mapper that switches mirroring
+	void setMirroring(mirroring mode);
+
+	// Points a 1K pattern table page at CHR memory, for mappers that bank CHR
+	void mapChr(uint8_t page, uint8_t* memory);
+
 	uint32_t getColor(uint8_t palette, uint8_t pixel);
 
 	uint8_t ppuRead(uint16_t address);
@@ -127,6 +282,26 @@ public:
 
 	void clock();
 	void reset();
+
+	// Memory, registers and the dot position. Pixels already drawn are not
+	// part of it, a state loaded mid frame shows the old ones until redrawn.
+	void saveState(StateWriter& state);
+	void loadState(StateReader& state);
+
+	int16_t getScanline(){ return scanline; }
+	int16_t getCycle(){ return cycle; }
+
+	// Cycles of the current scanline at which ppustatus may change. The bus
+	// only has to wake a cpu that is spinning on $2002 inside this range.
+	int16_t statusEventFirst = 1;
+	int16_t statusEventLast = 0;
+
+	void predictStatusEvent();
+	bool atStatusEvent(){ return statusEventFirst <= cycle && cycle <= statusEventLast; }
+
+	// Clocks until the ppu raises an NMI or starts the next frame, the only
+	// things it does that a cpu between register accesses can see
+	int32_t dotsUntilCpuEvent();
 	
 	bool nmi = false;
 };
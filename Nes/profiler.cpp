@@ -0,0 +1,218 @@
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "profiler.h"
+
+using namespace std;
+
+void Profiler::instruction(uint16_t pc, uint16_t bank, uint8_t opcode, uint8_t cycles, uint16_t nextPc, uint16_t nextBank){
+	opcodes[opcode].count++;
+	opcodes[opcode].cycles += cycles;
+
+	if(currentBank == nullptr || bank != currentBankId){
+		currentBank = &banks[bank];
+		currentBankId = bank;
+
+		if(currentBank->empty())
+			currentBank->resize(65536);
+	}
+
+	(*currentBank)[pc].count++;
+	(*currentBank)[pc].cycles += cycles;
+
+	if(nmiDepth > 0){
+		nmiCycles += cycles;
+	} else {
+		mainCycles += cycles;
+	}
+
+	uint32_t current = callStack.empty() ? MainRoutine : callStack.back().routine;
+	Routine& routine = routines[current];
+	routine.instructions++;
+	routine.cycles += cycles;
+
+	// JSR
+	if(opcode == 0x20){
+		enter((uint32_t)nextBank << 16 | nextPc, false);
+	}
+
+	// RTS, ignored when it would leave an interrupt
+	if(opcode == 0x60 && !callStack.empty() && !callStack.back().nmi){
+		callStack.pop_back();
+	}
+
+	// RTI, also drops subroutines the handler never returned from
+	if(opcode == 0x40){
+		while(!callStack.empty()){
+			Frame frame = callStack.back();
+			callStack.pop_back();
+
+			if(frame.nmi){
+				nmiDepth--;
+				break;
+			}
+		}
+	}
+}
+
+void Profiler::interrupt(uint16_t handler, uint16_t bank){
+	enter((uint32_t)bank << 16 | handler, true);
+}
+
+// A cycle of a spin loop the cpu skipped, charged to the routine spinning
+void Profiler::idle(){
+	idleCycles++;
+
+	if(nmiDepth > 0){
+		nmiCycles++;
+	} else {
+		mainCycles++;
+	}
+
+	uint32_t current = callStack.empty() ? MainRoutine : callStack.back().routine;
+	routines[current].cycles++;
+}
+
+// Games that leave subroutines through the stack would grow this forever, so
+// the oldest frame is dropped once it gets too deep
+void Profiler::enter(uint32_t routine, bool nmi){
+	if(callStack.size() == maxCallDepth){
+		if(callStack.front().nmi)
+			nmiDepth--;
+
+		callStack.erase(callStack.begin());
+	}
+
+	callStack.push_back({routine, nmi});
+	routines[routine].calls++;
+
+	if(nmi)
+		nmiDepth++;
+}
+
+void Profiler::clear(){
+	for(int i = 0; i < 256; i++){
+		opcodes[i] = Counter();
+	}
+
+	banks.clear();
+	currentBank = nullptr;
+
+	routines.clear();
+	callStack.clear();
+	nmiDepth = 0;
+
+	mainCycles = 0;
+	nmiCycles = 0;
+	idleCycles = 0;
+}
+
+static void writeAddress(ostream& out, uint32_t routine){
+	if(routine == Profiler::MainRoutine){
+		out << "main";
+		return;
+	}
+
+	out << setfill('0') << setw(3) << (routine >> 16) << ":" << setw(4) << (routine & 0xFFFF) << setfill(' ');
+}
+
+bool Profiler::dump(const char* path){
+	ofstream file(path);
+	if(!file.is_open())
+		return false;
+
+	file << "# cycles <main> <nmi> <idle>" << endl;
+	file << "# opcode <opcode> <count> <cycles>" << endl;
+	file << "# pc <bank:address> <count> <cycles>" << endl;
+	file << "# routine <bank:address> <calls> <instructions> <cycles>" << endl;
+
+	file << "cycles " << mainCycles << " " << nmiCycles << " " << idleCycles << endl;
+
+	file << uppercase;
+
+	for(int i = 0; i < 256; i++){
+		if(opcodes[i].count == 0)
+			continue;
+
+		file << "opcode " << hex << setfill('0') << setw(2) << i << setfill(' ') << dec;
+		file << " " << opcodes[i].count << " " << opcodes[i].cycles << endl;
+	}
+
+	for(auto& bank : banks){
+		for(int pc = 0; pc < 65536; pc++){
+			const Counter& counter = bank.second[pc];
+			if(counter.count == 0)
+				continue;
+
+			file << "pc " << hex;
+			writeAddress(file, (uint32_t)bank.first << 16 | pc);
+			file << dec << " " << counter.count << " " << counter.cycles << endl;
+		}
+	}
+
+	for(auto& routine : routines){
+		file << "routine " << hex;
+		writeAddress(file, routine.first);
+		file << dec << " " << routine.second.calls << " " << routine.second.instructions << " " << routine.second.cycles << endl;
+	}
+
+	return true;
+}
+
+void Profiler::report(ostream& out, int count){
+	uint64_t total = mainCycles + nmiCycles;
+	if(total == 0){
+		out << "no cycles profiled" << endl;
+		return;
+	}
+
+	auto percent = [&](uint64_t cycles){
+		return 100.0 * cycles / total;
+	};
+
+	out << fixed << setprecision(1);
+	out << "main loop " << mainCycles << " cycles (" << percent(mainCycles) << "%), ";
+	out << "nmi " << nmiCycles << " cycles (" << percent(nmiCycles) << "%), ";
+	out << "idle " << idleCycles << " cycles (" << percent(idleCycles) << "%)" << endl;
+
+	vector<pair<uint64_t, uint32_t>> hot;
+
+	for(auto& routine : routines){
+		hot.push_back({routine.second.cycles, routine.first});
+	}
+
+	sort(hot.rbegin(), hot.rend());
+
+	out << "hot routines:" << endl;
+	for(int i = 0; i < count && i < (int)hot.size(); i++){
+		const Routine& routine = routines[hot[i].second];
+
+		out << "  " << uppercase << hex;
+		writeAddress(out, hot[i].second);
+		if(hot[i].second == MainRoutine)
+			out << "    ";
+
+		out << dec << "  " << setw(5) << percent(routine.cycles) << "%  ";
+		out << routine.cycles << " cycles, " << routine.calls << " calls" << endl;
+	}
+
+	hot.clear();
+
+	for(auto& bank : banks){
+		for(int pc = 0; pc < 65536; pc++){
+			if(bank.second[pc].cycles != 0)
+				hot.push_back({bank.second[pc].cycles, (uint32_t)bank.first << 16 | pc});
+		}
+	}
+
+	count = min(count, (int)hot.size());
+	partial_sort(hot.begin(), hot.begin() + count, hot.end(), greater<pair<uint64_t, uint32_t>>());
+
+	out << "hot addresses:" << endl;
+	for(int i = 0; i < count; i++){
+		out << "  " << uppercase << hex;
+		writeAddress(out, hot[i].second);
+		out << dec << "  " << setw(5) << percent(hot[i].first) << "%  " << hot[i].first << " cycles" << endl;
+	}
+}
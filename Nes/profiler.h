@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
+
+// Guest code profiler, only built with NES_PROFILE defined. Counts executions
+// and cycles per opcode and per pc of each bank, attributes cycles to the
+// subroutine they ran in and splits them between interrupt handlers (in
+// practice NMI) and the main loop.
+class Profiler{
+	struct Counter{
+		uint64_t count = 0;
+		uint64_t cycles = 0;
+	};
+
+	struct Routine{
+		uint64_t calls = 0;
+		uint64_t instructions = 0;
+		uint64_t cycles = 0;
+	};
+
+	struct Frame{
+		uint32_t routine; 				// bank << 16 | address
+		bool nmi; 						// frame pushed by an interrupt
+	};
+
+	Counter opcodes[256];
+
+	std::unordered_map<uint16_t, std::vector<Counter>> banks;
+	std::vector<Counter>* currentBank = nullptr;
+	uint16_t currentBankId = 0;
+
+	std::unordered_map<uint32_t, Routine> routines;
+	std::vector<Frame> callStack;
+	int nmiDepth = 0;
+
+	uint64_t mainCycles = 0;
+	uint64_t nmiCycles = 0;
+	uint64_t idleCycles = 0;
+
+	void enter(uint32_t routine, bool nmi);
+public:
+	static const int maxCallDepth = 64;
+
+	// Cycles run outside any subroutine
+	static const uint32_t MainRoutine = 0xFFFFFFFF;
+
+	void instruction(uint16_t pc, uint16_t bank, uint8_t opcode, uint8_t cycles, uint16_t nextPc, uint16_t nextBank);
+	void interrupt(uint16_t handler, uint16_t bank);
+	void idle();
+
+	void clear();
+
+	// Flat text file, one counter per line
+	bool dump(const char* path);
+
+	// Hottest routines and addresses by cycles
+	void report(std::ostream& out, int count);
+};
@@ -0,0 +1,309 @@
+#include "ramsearch.h"
+#include "bus.h"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+RamSearch::RamSearch(int instances) : batch(instances < 1 ? 1 : instances){
+	reset();
+}
+
+void RamSearch::reset(){
+	for(int i = 0; i < instances(); i++){
+		reset(i);
+	}
+}
+
+void RamSearch::reset(int instance){
+	Instance& search = batch[instance];
+
+	memset(search.candidates, 0xFF, sizeof(search.candidates));
+
+	search.live.resize(chunks);
+	for(int chunk = 0; chunk < chunks; chunk++){
+		search.live[chunk] = chunk;
+	}
+
+	search.started = false;
+}
+
+void RamSearch::capture(int instance, Bus& bus){
+	capture(instance, bus.ram(), bus.sram());
+}
+
+void RamSearch::capture(int instance, const uint8_t* ram, const uint8_t* sram){
+	Instance& search = batch[instance];
+
+	for(uint16_t chunk : search.live){
+		int index = chunk * chunkSize;
+		const uint8_t* from = index < ramSize ? ram + index : sram + (index - ramSize);
+
+		memcpy(search.current + index, from, chunkSize);
+	}
+
+	// The first capture after a reset is what the first filter compares against
+	if(!search.started){
+		memcpy(search.reference, search.current, size);
+		search.started = true;
+	}
+}
+
+// One bit per byte of the chunk that passes the comparison
+template<int c>
+static inline uint32_t compareChunk(const uint8_t* now, const uint8_t* before, uint8_t value){
+#if defined(__AVX2__)
+	__m256i a = _mm256_loadu_si256((const __m256i*)now);
+	__m256i b = _mm256_loadu_si256((const __m256i*)before);
+	__m256i n = _mm256_set1_epi8((char)value);
+	__m256i equal;
+
+	switch(c){
+		case RamSearch::Equal:
+		case RamSearch::NotEqual:
+			equal = _mm256_cmpeq_epi8(a, n);
+			break;
+
+		case RamSearch::Changed:
+		case RamSearch::Unchanged:
+			equal = _mm256_cmpeq_epi8(a, b);
+			break;
+
+		// a > b exactly when min(a, b) isn't a
+		case RamSearch::Increased:
+			equal = _mm256_cmpeq_epi8(_mm256_min_epu8(a, b), a);
+			break;
+
+		case RamSearch::Decreased:
+			equal = _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a);
+			break;
+
+		case RamSearch::IncreasedBy:
+			equal = _mm256_cmpeq_epi8(_mm256_sub_epi8(a, b), n);
+			break;
+
+		default:
+			equal = _mm256_cmpeq_epi8(_mm256_sub_epi8(b, a), n);
+			break;
+	}
+
+	uint32_t bits = (uint32_t)_mm256_movemask_epi8(equal);
+#elif defined(__SSE2__) || defined(_M_X64)
+	uint32_t bits = 0;
+
+	for(int half = 0; half < 2; half++){
+		__m128i a = _mm_loadu_si128((const __m128i*)(now + 16 * half));
+		__m128i b = _mm_loadu_si128((const __m128i*)(before + 16 * half));
+		__m128i n = _mm_set1_epi8((char)value);
+		__m128i equal;
+
+		switch(c){
+			case RamSearch::Equal:
+			case RamSearch::NotEqual:
+				equal = _mm_cmpeq_epi8(a, n);
+				break;
+
+			case RamSearch::Changed:
+			case RamSearch::Unchanged:
+				equal = _mm_cmpeq_epi8(a, b);
+				break;
+
+			case RamSearch::Increased:
+				equal = _mm_cmpeq_epi8(_mm_min_epu8(a, b), a);
+				break;
+
+			case RamSearch::Decreased:
+				equal = _mm_cmpeq_epi8(_mm_max_epu8(a, b), a);
+				break;
+
+			case RamSearch::IncreasedBy:
+				equal = _mm_cmpeq_epi8(_mm_sub_epi8(a, b), n);
+				break;
+
+			default:
+				equal = _mm_cmpeq_epi8(_mm_sub_epi8(b, a), n);
+				break;
+		}
+
+		bits |= (uint32_t)_mm_movemask_epi8(equal) << (16 * half);
+	}
+#else
+	uint32_t bits = 0;
+
+	for(int i = 0; i < RamSearch::chunkSize; i++){
+		uint8_t a = now[i];
+		uint8_t b = before[i];
+		bool equal;
+
+		switch(c){
+			case RamSearch::Equal:
+			case RamSearch::NotEqual:
+				equal = a == value;
+				break;
+
+			case RamSearch::Changed:
+			case RamSearch::Unchanged:
+				equal = a == b;
+				break;
+
+			case RamSearch::Increased:
+				equal = a <= b;
+				break;
+
+			case RamSearch::Decreased:
+				equal = a >= b;
+				break;
+
+			case RamSearch::IncreasedBy:
+				equal = (uint8_t)(a - b) == value;
+				break;
+
+			default:
+				equal = (uint8_t)(b - a) == value;
+				break;
+		}
+
+		bits |= (uint32_t)equal << i;
+	}
+#endif
+
+	// These were computed as their opposite
+	switch(c){
+		case RamSearch::NotEqual:
+		case RamSearch::Changed:
+		case RamSearch::Increased:
+		case RamSearch::Decreased:
+			return ~bits;
+	}
+
+	return bits;
+}
+
+template<int c>
+void RamSearch::filterWith(Instance& search, uint8_t value){
+	size_t kept = 0;
+
+	for(uint16_t chunk : search.live){
+		int index = chunk * chunkSize;
+		uint32_t bits = search.candidates[chunk] & compareChunk<c>(search.current + index, search.reference + index, value);
+
+		// Only candidates need their reference, dead chunks are never looked at again
+		memcpy(search.reference + index, search.current + index, chunkSize);
+		search.candidates[chunk] = bits;
+
+		if(bits != 0)
+			search.live[kept++] = chunk;
+	}
+
+	search.live.resize(kept);
+}
+
+void RamSearch::filter(comparison c, uint8_t value){
+	for(int i = 0; i < instances(); i++){
+		filter(i, c, value);
+	}
+}
+
+void RamSearch::filter(int instance, comparison c, uint8_t value){
+	Instance& search = batch[instance];
+
+	if(!search.started)
+		return;
+
+	switch(c){
+		case Equal: 		filterWith<Equal>(search, value); break;
+		case NotEqual: 		filterWith<NotEqual>(search, value); break;
+		case Changed: 		filterWith<Changed>(search, value); break;
+		case Unchanged: 	filterWith<Unchanged>(search, value); break;
+		case Increased: 	filterWith<Increased>(search, value); break;
+		case Decreased: 	filterWith<Decreased>(search, value); break;
+		case IncreasedBy: 	filterWith<IncreasedBy>(search, value); break;
+		case DecreasedBy: 	filterWith<DecreasedBy>(search, value); break;
+	}
+}
+
+static inline int bitCount(uint32_t bits){
+	int count = 0;
+
+	for(; bits != 0; bits &= bits - 1){
+		count++;
+	}
+
+	return count;
+}
+
+uint32_t RamSearch::count(int instance){
+	Instance& search = batch[instance];
+	uint32_t total = 0;
+
+	for(uint16_t chunk : search.live){
+		total += bitCount(search.candidates[chunk]);
+	}
+
+	return total;
+}
+
+vector<uint16_t> RamSearch::candidates(int instance){
+	Instance& search = batch[instance];
+	vector<uint16_t> addresses;
+
+	for(uint16_t chunk : search.live){
+		for(int bit = 0; bit < chunkSize; bit++){
+			if(search.candidates[chunk] & (1u << bit))
+				addresses.push_back(addressOf(chunk * chunkSize + bit));
+		}
+	}
+
+	return addresses;
+}
+
+vector<uint16_t> RamSearch::common(){
+	vector<uint32_t> all(chunks, 0xFFFFFFFF);
+	vector<uint16_t> addresses;
+
+	for(Instance& search : batch){
+		vector<uint32_t> mask(chunks, 0);
+
+		for(uint16_t chunk : search.live){
+			mask[chunk] = search.candidates[chunk];
+		}
+
+		for(int chunk = 0; chunk < chunks; chunk++){
+			all[chunk] &= mask[chunk];
+		}
+	}
+
+	for(int chunk = 0; chunk < chunks; chunk++){
+		for(int bit = 0; bit < chunkSize; bit++){
+			if(all[chunk] & (1u << bit))
+				addresses.push_back(addressOf(chunk * chunkSize + bit));
+		}
+	}
+
+	return addresses;
+}
+
+uint8_t RamSearch::value(int instance, uint16_t address){
+	int index = indexOf(address);
+	return index < 0 ? 0 : batch[instance].current[index];
+}
+
+int RamSearch::indexOf(uint16_t address){
+	if(address < 0x2000)
+		return address & 0x7FF;
+
+	if(0x6000 <= address && address <= 0x7FFF)
+		return ramSize + (address & 0x1FFF);
+
+	return -1;
+}
+
+uint16_t RamSearch::addressOf(int index){
+	return index < ramSize ? index : 0x6000 + (index - ramSize);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class Bus;
+
+// Cheat finder over the 2K of cpu ram and the 8K of cartridge SRAM, for one
+// or a batch of instances. Every instance keeps a bitmap of the addresses
+// still in the running and the values they had at the last filter, a filter
+// compares newly captured values against those and clears the addresses that
+// fail. Work is per 32 byte chunk and chunks without candidates are dropped
+// from the instance, so a long search gets cheaper as it narrows.
+//
+//   search.reset();
+//   search.capture(0, bus);         // starting values
+//   ... run a frame ...
+//   search.capture(0, bus);
+//   search.filter(RamSearch::DecreasedBy, 1);
+class RamSearch{
+public:
+	static const int ramSize = 2048;
+	static const int sramSize = 8192;
+	static const int size = ramSize + sramSize;
+	static const int chunkSize = 32;
+	static const int chunks = size / chunkSize;
+
+	enum comparison{
+		Equal = 0, 			// value now equals N
+		NotEqual = 1,
+		Changed = 2, 		// since the last filter
+		Unchanged = 3,
+		Increased = 4, 		// by any amount
+		Decreased = 5,
+		IncreasedBy = 6, 	// by exactly N, wrapping at 256
+		DecreasedBy = 7
+	};
+
+private:
+	struct Instance{
+		uint8_t current[size];
+		uint8_t reference[size]; 	// values at the last filter
+		uint32_t candidates[chunks];
+		std::vector<uint16_t> live; 	// chunks with candidates left
+		bool started = false; 		// reference holds a capture
+	};
+
+	std::vector<Instance> batch;
+
+	template<int c>
+	void filterWith(Instance& instance, uint8_t value);
+public:
+	RamSearch(int instances = 1);
+
+	int instances(){ return (int)batch.size(); }
+
+	// Every address a candidate again, the next capture gives the starting values
+	void reset();
+	void reset(int instance);
+
+	// Copies the searched memory of an instance, before every filter. Only
+	// chunks that still hold candidates are copied.
+	void capture(int instance, Bus& bus);
+	void capture(int instance, const uint8_t* ram, const uint8_t* sram);
+
+	// Same comparison on every instance, or on one
+	void filter(comparison c, uint8_t value = 0);
+	void filter(int instance, comparison c, uint8_t value = 0);
+
+	uint32_t count(int instance);
+
+	// CPU addresses, $0000-$07FF then $6000-$7FFF
+	std::vector<uint16_t> candidates(int instance);
+
+	// Addresses still candidates in every instance
+	std::vector<uint16_t> common();
+
+	// Last captured value, only kept up to date for candidates
+	uint8_t value(int instance, uint16_t address);
+
+	static int indexOf(uint16_t address);
+	static uint16_t addressOf(int index);
+};
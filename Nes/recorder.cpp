@@ -0,0 +1,327 @@
+#include "recorder.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+#if defined(_WIN32)
+#define popen _popen
+#define pclose _pclose
+#endif
+
+// 4 independent multiply-xor lanes over 64 bit words, so the multiplies overlap
+static uint64_t frameHash(const uint8_t* data, size_t size){
+	const uint64_t prime = 0x9E3779B97F4A7C15ull;
+	uint64_t lanes[4] = { size, size ^ prime, ~size, size * prime };
+
+	size_t i = 0;
+	for(; i + 32 <= size; i += 32){
+		for(int j = 0; j < 4; j++){
+			uint64_t word;
+			memcpy(&word, data + i + 8 * j, 8);
+
+			lanes[j] = (lanes[j] ^ word) * prime;
+			lanes[j] ^= lanes[j] >> 29;
+		}
+	}
+
+	uint64_t hash = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+
+	for(; i < size; i++){
+		hash = (hash ^ data[i]) * prime;
+	}
+
+	return hash ^ (hash >> 32);
+}
+
+// BT.601 limited range
+static void toYCbCr(uint32_t rgb, uint8_t& y, uint8_t& cb, uint8_t& cr){
+	int r = (rgb >> 16) & 0xFF;
+	int g = (rgb >> 8) & 0xFF;
+	int b = rgb & 0xFF;
+
+	y = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+	cb = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+	cr = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+FrameRecorder::FrameRecorder(){
+}
+
+FrameRecorder::~FrameRecorder(){
+	close();
+}
+
+bool FrameRecorder::open(const string& path, format f){
+	close();
+
+	file = fopen(path.c_str(), "wb");
+	pipe = false;
+
+	return start(f);
+}
+
+bool FrameRecorder::openPipe(const string& command, format f){
+	close();
+
+#if defined(_WIN32)
+	file = popen(command.c_str(), "wb");
+#else
+	file = popen(command.c_str(), "w");
+#endif
+	pipe = true;
+
+	return start(f);
+}
+
+bool FrameRecorder::start(format f){
+	if(file == nullptr){
+		cerr << "Cannot open recording" << endl;
+		return false;
+	}
+
+	setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+	type = f;
+
+	// A frame is 89341 dots of 236.25 / 44 MHz
+	if(type == Y4M)
+		fprintf(file, "YUV4MPEG2 W%d H%d F8437500:140393 Ip A1:1 C444\n", width, height);
+
+	queue.assign(queueSize < 1 ? 1 : queueSize, Entry());
+	head = 0;
+	count = 0;
+	holding = false;
+
+	written = 0;
+	repeats = 0;
+	dropped = 0;
+
+	running = true;
+	writer = thread(&FrameRecorder::run, this);
+
+	return true;
+}
+
+void FrameRecorder::close(){
+	{
+		lock_guard<mutex> lock(queueMutex);
+		if(!running)
+			return;
+
+		running = false;
+	}
+
+	queueReady.notify_one();
+	writer.join();
+
+	if(pipe){
+		pclose(file);
+	} else {
+		fclose(file);
+	}
+
+	file = nullptr;
+}
+
+// Slot for the next frame, or null with the frame counted as dropped. Only the
+// emulation thread fills slots, and the writer doesn't touch one until publish.
+FrameRecorder::Entry* FrameRecorder::reserve(){
+	lock_guard<mutex> lock(queueMutex);
+
+	if(!running)
+		return nullptr;
+
+	if(count == (int)queue.size()){
+		dropped++;
+		return nullptr;
+	}
+
+	return &queue[(head + count) % queue.size()];
+}
+
+void FrameRecorder::publish(){
+	{
+		lock_guard<mutex> lock(queueMutex);
+		count++;
+	}
+
+	queueReady.notify_one();
+}
+
+void FrameRecorder::push(const uint32_t* rgb){
+	Entry* entry = reserve();
+	if(entry == nullptr)
+		return;
+
+	entry->type = Entry::Rgb;
+	entry->rgb.assign(rgb, rgb + width * height);
+	publish();
+}
+
+void FrameRecorder::push(const uint8_t* indices, const uint32_t* palette){
+	Entry* entry = reserve();
+	if(entry == nullptr)
+		return;
+
+	entry->type = Entry::Indexed;
+	entry->indices.resize(width * height);
+	for(int i = 0; i < width * height; i++){
+		entry->indices[i] = indices[i] & 0x3F;
+	}
+	entry->palette = palette;
+	publish();
+}
+
+void FrameRecorder::push(const uint16_t* indices, const uint32_t* palette){
+	Entry* entry = reserve();
+	if(entry == nullptr)
+		return;
+
+	entry->type = Entry::Indexed;
+	entry->indices.resize(width * height);
+	for(int i = 0; i < width * height; i++){
+		entry->indices[i] = indices[i] & 0x3F;
+	}
+	entry->palette = palette;
+	publish();
+}
+
+void FrameRecorder::repeat(){
+	Entry* entry = reserve();
+	if(entry == nullptr)
+		return;
+
+	entry->type = Entry::Repeat;
+	publish();
+}
+
+// Output bytes of a frame into held
+void FrameRecorder::convert(const Entry& entry){
+	int pixels = width * height;
+
+	auto colorOf = [&](int i){
+		return entry.type == Entry::Rgb ? entry.rgb[i] : entry.palette[entry.indices[i]];
+	};
+
+	if(type == Y4M){
+		held.resize(pixels * 3);
+
+		if(entry.type == Entry::Indexed){
+			uint8_t table[64][3];
+			for(int c = 0; c < 64; c++){
+				toYCbCr(entry.palette[c], table[c][0], table[c][1], table[c][2]);
+			}
+
+			for(int i = 0; i < pixels; i++){
+				const uint8_t* yuv = table[entry.indices[i]];
+				held[i] = yuv[0];
+				held[pixels + i] = yuv[1];
+				held[2 * pixels + i] = yuv[2];
+			}
+		} else {
+			for(int i = 0; i < pixels; i++){
+				toYCbCr(entry.rgb[i], held[i], held[pixels + i], held[2 * pixels + i]);
+			}
+		}
+	} else if(type == RawRgb){
+		held.resize(pixels * 3);
+
+		for(int i = 0; i < pixels; i++){
+			uint32_t color = colorOf(i);
+			held[3 * i] = (color >> 16) & 0xFF;
+			held[3 * i + 1] = (color >> 8) & 0xFF;
+			held[3 * i + 2] = color & 0xFF;
+		}
+	} else {
+		held = entry.indices;
+	}
+}
+
+void FrameRecorder::writeHeld(){
+	uint32_t repeat = markRepeats ? heldRepeats : 0;
+
+	if(type == Y4M){
+		if(repeat > 0){
+			fprintf(file, "FRAME XREPEAT=%u\n", repeat);
+		} else {
+			fputs("FRAME\n", file);
+		}
+	} else if(markRepeats){
+		uint8_t prefix[4] = { (uint8_t)repeat, (uint8_t)(repeat >> 8), (uint8_t)(repeat >> 16), (uint8_t)(repeat >> 24) };
+		fwrite(prefix, 1, 4, file);
+	}
+
+	fwrite(held.data(), 1, held.size(), file);
+	written += 1 + repeat;
+}
+
+void FrameRecorder::run(){
+	while(true){
+		Entry* entry;
+
+		{
+			unique_lock<mutex> lock(queueMutex);
+			queueReady.wait(lock, [&](){ return count > 0 || !running; });
+
+			// Closing still writes what was queued
+			if(count == 0)
+				break;
+
+			entry = &queue[head];
+		}
+
+		bool same = false;
+		uint64_t hash = 0;
+
+		if(entry->type == Entry::Repeat){
+			same = true;
+		} else if(entry->type == Entry::Indexed || type != RawIndexed){
+			hash = entry->type == Entry::Rgb
+				? frameHash((const uint8_t*)entry->rgb.data(), entry->rgb.size() * 4)
+				: frameHash(entry->indices.data(), entry->indices.size());
+			same = holding && hash == heldHash;
+		} else {
+			// Rgb frames have no indices to write
+			dropped++;
+			entry = nullptr;
+		}
+
+		if(entry != nullptr){
+			if(same){
+				if(holding){
+					repeats++;
+
+					if(markRepeats){
+						heldRepeats++;
+					} else {
+						writeHeld();
+					}
+				}
+			} else {
+				if(holding && markRepeats)
+					writeHeld();
+
+				convert(*entry);
+				heldHash = hash;
+				heldRepeats = 0;
+				holding = true;
+
+				if(!markRepeats)
+					writeHeld();
+			}
+		}
+
+		{
+			lock_guard<mutex> lock(queueMutex);
+			head = (head + 1) % queue.size();
+			count--;
+		}
+	}
+
+	if(holding && markRepeats)
+		writeHeld();
+
+	fflush(file);
+}
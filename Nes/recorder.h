@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Records finished frames to a file or a pipe into an encoder. push copies the
+// frame into a bounded queue and returns at once; a writer thread converts and
+// writes it. When the queue is full the frame is dropped and counted, so the
+// emulation thread never waits on the disk.
+//
+// Formats, all 256x240:
+//   Y4M         YCbCr 4:4:4 (BT.601, limited range) at the ppu frame rate
+//   RawRgb      3 bytes per pixel, e.g. ffmpeg -f rawvideo -pix_fmt rgb24
+//   RawIndexed  palette index byte per pixel, needs an indexed ppu output
+//
+// Frames equal to the one before (by a 64 bit hash) and frames the ppu skipped
+// rendering are repeats. With markRepeats, every written frame carries how many
+// times it repeats: an XREPEAT=n parameter on the Y4M FRAME line (left out for
+// 0), or a 4 byte little endian count before each raw frame. The writer holds
+// each frame back until the next different one shows up, or the recording
+// closes. Without markRepeats repeats are written out in full, which keeps the
+// raw streams plain.
+class FrameRecorder{
+public:
+	enum format{
+		Y4M = 0,
+		RawRgb = 1,
+		RawIndexed = 2
+	};
+
+	static const int width = 256;
+	static const int height = 240;
+
+private:
+	struct Entry{
+		enum kind{
+			Rgb,
+			Indexed,
+			Repeat 		// ppu skipped rendering, the previous frame shows again
+		};
+
+		kind type = Repeat;
+		std::vector<uint32_t> rgb;
+		std::vector<uint8_t> indices;
+		const uint32_t* palette = nullptr;
+	};
+
+	FILE* file = nullptr;
+	bool pipe = false;
+	format type = Y4M;
+
+	// Ring of queueSize entries, head is the next to write
+	std::vector<Entry> queue;
+	int head = 0;
+	int count = 0;
+
+	std::thread writer;
+	std::mutex queueMutex;
+	std::condition_variable queueReady;
+	bool running = false;
+
+	// Writer thread: the last different frame in output bytes
+	std::vector<uint8_t> held;
+	uint64_t heldHash = 0;
+	uint32_t heldRepeats = 0;
+	bool holding = false;
+
+	bool start(format f);
+	Entry* reserve();
+	void publish();
+
+	void run();
+	void convert(const Entry& entry);
+	void writeHeld();
+public:
+	FrameRecorder();
+	~FrameRecorder();
+
+	bool markRepeats = true;
+
+	// Frames the queue holds, set before opening
+	int queueSize = 8;
+
+	std::atomic<uint64_t> written{0}; 	// frames written, repeats included
+	std::atomic<uint64_t> repeats{0};
+	std::atomic<uint64_t> dropped{0};
+
+	bool open(const std::string& path, format f);
+	bool openPipe(const std::string& command, format f);
+
+	// Writes what is still queued and closes the file or pipe
+	void close();
+
+	bool isOpen(){ return running; }
+
+	void push(const uint32_t* rgb);
+	void push(const uint8_t* indices, const uint32_t* palette);
+	void push(const uint16_t* indices, const uint32_t* palette);
+	void repeat();
+};
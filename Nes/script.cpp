@@ -0,0 +1,307 @@
+#include "script.h"
+#include "bus.h"
+
+#include <vector>
+
+#if defined(NES_LUA)
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+#endif
+
+using namespace std;
+
+#if defined(NES_LUA)
+
+static Script* scriptOf(lua_State* lua){
+	return (Script*)lua_touserdata(lua, lua_upvalueindex(1));
+}
+
+// Ranges stop at the end of the address space
+static lua_Integer rangeCount(lua_State* lua, int argument, uint16_t address){
+	lua_Integer count = luaL_checkinteger(lua, argument);
+
+	if(count < 0)
+		return 0;
+
+	return count > 0x10000 - address ? 0x10000 - address : count;
+}
+
+int Script::luaRead(lua_State* lua){
+	Bus* bus = scriptOf(lua)->bus;
+
+	if(lua_istable(lua, 1)){
+		lua_Integer count = (lua_Integer)lua_rawlen(lua, 1);
+		lua_createtable(lua, (int)count, 0);
+
+		for(lua_Integer i = 1; i <= count; i++){
+			lua_rawgeti(lua, 1, i);
+			uint16_t address = (uint16_t)lua_tointeger(lua, -1);
+			lua_pop(lua, 1);
+
+			lua_pushinteger(lua, bus->peek(address));
+			lua_rawseti(lua, -2, i);
+		}
+
+		return 1;
+	}
+
+	uint16_t address = (uint16_t)luaL_checkinteger(lua, 1);
+
+	if(lua_isnoneornil(lua, 2)){
+		lua_pushinteger(lua, bus->peek(address));
+		return 1;
+	}
+
+	lua_Integer count = rangeCount(lua, 2, address);
+	lua_createtable(lua, (int)count, 0);
+
+	for(lua_Integer i = 0; i < count; i++){
+		lua_pushinteger(lua, bus->peek((uint16_t)(address + i)));
+		lua_rawseti(lua, -2, i + 1);
+	}
+
+	return 1;
+}
+
+int Script::luaReadBytes(lua_State* lua){
+	Bus* bus = scriptOf(lua)->bus;
+
+	uint16_t address = (uint16_t)luaL_checkinteger(lua, 1);
+	lua_Integer count = rangeCount(lua, 2, address);
+
+	vector<char> bytes(count);
+	for(lua_Integer i = 0; i < count; i++){
+		bytes[i] = (char)bus->peek((uint16_t)(address + i));
+	}
+
+	lua_pushlstring(lua, bytes.data(), bytes.size());
+	return 1;
+}
+
+int Script::luaWrite(lua_State* lua){
+	Bus* bus = scriptOf(lua)->bus;
+
+	bus->cpuWrite((uint16_t)luaL_checkinteger(lua, 1), (uint8_t)luaL_checkinteger(lua, 2));
+
+	// A skipped spin loop may be waiting on the value
+	bus->cpu.wake();
+	return 0;
+}
+
+int Script::luaFrame(lua_State* lua){
+	lua_pushinteger(lua, scriptOf(lua)->bus->ppu.frame);
+	return 1;
+}
+
+int Script::luaScanline(lua_State* lua){
+	lua_pushinteger(lua, scriptOf(lua)->bus->ppu.getScanline());
+	return 1;
+}
+
+int Script::luaCpu(lua_State* lua){
+	CPU6502& cpu = scriptOf(lua)->bus->cpu;
+
+	lua_createtable(lua, 0, 7);
+	lua_pushinteger(lua, cpu.a);
+	lua_setfield(lua, -2, "a");
+	lua_pushinteger(lua, cpu.x);
+	lua_setfield(lua, -2, "x");
+	lua_pushinteger(lua, cpu.y);
+	lua_setfield(lua, -2, "y");
+	lua_pushinteger(lua, cpu.s);
+	lua_setfield(lua, -2, "s");
+	lua_pushinteger(lua, cpu.p);
+	lua_setfield(lua, -2, "p");
+	lua_pushinteger(lua, cpu.pc);
+	lua_setfield(lua, -2, "pc");
+	lua_pushinteger(lua, (lua_Integer)cpu.cycles);
+	lua_setfield(lua, -2, "cycles");
+	return 1;
+}
+
+// A function replaces the handler, nil removes it
+static void setHandler(lua_State* lua, int argument, int& handler){
+	if(!lua_isnil(lua, argument))
+		luaL_checktype(lua, argument, LUA_TFUNCTION);
+
+	if(handler != 0)
+		luaL_unref(lua, LUA_REGISTRYINDEX, handler);
+
+	handler = 0;
+
+	if(lua_isfunction(lua, argument)){
+		lua_pushvalue(lua, argument);
+		handler = luaL_ref(lua, LUA_REGISTRYINDEX);
+	}
+}
+
+int Script::luaOnFrame(lua_State* lua){
+	setHandler(lua, 1, scriptOf(lua)->frameHandler);
+	return 0;
+}
+
+int Script::luaOnScanline(lua_State* lua){
+	setHandler(lua, 1, scriptOf(lua)->scanlineHandler);
+	return 0;
+}
+
+int Script::luaOnExecute(lua_State* lua){
+	Script* script = scriptOf(lua);
+	uint16_t address = Debugger::fold((uint16_t)luaL_checkinteger(lua, 1));
+
+	int handler = 0;
+	auto found = script->executeHandlers.find(address);
+	if(found != script->executeHandlers.end())
+		handler = found->second;
+
+	setHandler(lua, 2, handler);
+
+	if(handler != 0){
+		script->executeHandlers[address] = handler;
+		script->bus->debugger.addBreakpoint(address);
+	} else if(found != script->executeHandlers.end()){
+		script->executeHandlers.erase(found);
+		script->bus->debugger.removeBreakpoint(address);
+	}
+
+	return 0;
+}
+
+Script::Script(Bus* b) : bus(b){
+	lua = luaL_newstate();
+	luaL_openlibs(lua);
+
+	static const luaL_Reg functions[] = {
+		{ "read", luaRead },
+		{ "readBytes", luaReadBytes },
+		{ "write", luaWrite },
+		{ "frame", luaFrame },
+		{ "scanline", luaScanline },
+		{ "cpu", luaCpu },
+		{ "onFrame", luaOnFrame },
+		{ "onScanline", luaOnScanline },
+		{ "onExecute", luaOnExecute },
+		{ nullptr, nullptr }
+	};
+
+	lua_createtable(lua, 0, sizeof(functions) / sizeof(functions[0]) - 1);
+	lua_pushlightuserdata(lua, this);
+	luaL_setfuncs(lua, functions, 1);
+	lua_setglobal(lua, "nes");
+
+	// Execute callbacks are breakpoints that never stop the cpu
+	previousStop = bus->debugger.onStop;
+	bus->debugger.onStop = [this](const Debugger::Stop& stop){
+		// The breakpoint may have been hit on a mirror of the address
+		auto found = executeHandlers.find(Debugger::fold(stop.address));
+
+		if(stop.reason == Debugger::Breakpoint && found != executeHandlers.end()){
+			call(found->second, stop.address);
+			return false;
+		}
+
+		return previousStop ? previousStop(stop) : true;
+	};
+
+	bus->ppu.script = this;
+}
+
+Script::~Script(){
+	bus->ppu.script = nullptr;
+	bus->debugger.onStop = previousStop;
+
+	for(auto& entry : executeHandlers){
+		bus->debugger.removeBreakpoint(entry.first);
+	}
+
+	lua_close(lua);
+}
+
+bool Script::finish(int status){
+	if(status == LUA_OK)
+		return true;
+
+	const char* message = lua_tostring(lua, -1);
+	error = message != nullptr ? message : "unknown error";
+	errors++;
+
+	lua_pop(lua, 1);
+	return false;
+}
+
+bool Script::load(const string& path){
+	int status = luaL_loadfile(lua, path.c_str());
+	if(status == LUA_OK)
+		status = lua_pcall(lua, 0, 0, 0);
+
+	return finish(status);
+}
+
+bool Script::run(const string& code){
+	int status = luaL_loadstring(lua, code.c_str());
+	if(status == LUA_OK)
+		status = lua_pcall(lua, 0, 0, 0);
+
+	return finish(status);
+}
+
+bool Script::call(int handler, int64_t argument){
+	lua_rawgeti(lua, LUA_REGISTRYINDEX, handler);
+	lua_pushinteger(lua, (lua_Integer)argument);
+
+	return finish(lua_pcall(lua, 1, 0, 0));
+}
+
+bool Script::number(const char* name, double& value){
+	lua_getglobal(lua, name);
+	bool isNumber = lua_isnumber(lua, -1) != 0;
+
+	if(isNumber)
+		value = lua_tonumber(lua, -1);
+
+	lua_pop(lua, 1);
+	return isNumber;
+}
+
+void Script::frame(){
+	if(frameHandler != 0)
+		call(frameHandler, bus->ppu.frame);
+}
+
+void Script::scanline(int line){
+	if(scanlineHandler != 0)
+		call(scanlineHandler, line);
+}
+
+#else
+
+// Without Lua a script never loads and never registers anything
+Script::Script(Bus* b) : bus(b){
+	error = "built without NES_LUA";
+}
+
+Script::~Script(){
+}
+
+bool Script::load(const string&){
+	return false;
+}
+
+bool Script::run(const string&){
+	return false;
+}
+
+bool Script::number(const char*, double&){
+	return false;
+}
+
+void Script::frame(){
+}
+
+void Script::scanline(int){
+}
+
+#endif
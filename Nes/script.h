@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <map>
+#include <functional>
+
+#include "debugger.h"
+
+class Bus;
+struct lua_State;
+
+// Lua scripting inside the emulation thread, built with NES_LUA defined and
+// linked with Lua 5.3 or later. A script registers callbacks into the
+// emulation schedule and reads memory in batches, so reward or termination
+// logic costs one call per frame instead of one crossing per byte:
+//
+//   nes.onFrame(function(frame) reward = nes.read(0x75) end)
+//   nes.onScanline(function(scanline) ... end)
+//   nes.onExecute(0xC0C9, function(pc) ... end)
+//
+//   nes.read(address)                 one byte
+//   nes.read(address, count)          table of count bytes from address on
+//   nes.read({ a, b, c })             table of the bytes at a list of addresses
+//   nes.readBytes(address, count)     the same range as a binary string
+//   nes.write(address, value)         cpu write
+//   nes.frame(), nes.scanline(), nes.cpu()
+//
+// Reads have no side effects: registers read as 0 and watchpoints don't see
+// them. Execute callbacks are debugger breakpoints that never stop, so the
+// cpu interprets while any are set.
+class Script{
+	Bus *bus = nullptr;
+	lua_State* lua = nullptr;
+
+	// Registry references of the callbacks, 0 for none
+	int frameHandler = 0;
+	int scanlineHandler = 0;
+	std::map<uint16_t, int> executeHandlers; 	// by Debugger::fold address, like the breakpoints
+
+	std::function<bool(const Debugger::Stop&)> previousStop;
+
+	bool call(int handler, int64_t argument);
+	bool finish(int status);
+
+	// The nes table, the script is their first upvalue
+	static int luaRead(lua_State* lua);
+	static int luaReadBytes(lua_State* lua);
+	static int luaWrite(lua_State* lua);
+	static int luaFrame(lua_State* lua);
+	static int luaScanline(lua_State* lua);
+	static int luaCpu(lua_State* lua);
+	static int luaOnFrame(lua_State* lua);
+	static int luaOnScanline(lua_State* lua);
+	static int luaOnExecute(lua_State* lua);
+public:
+	Script(Bus* b);
+	~Script();
+
+	// Runs a file or a chunk of code, which registers the callbacks
+	bool load(const std::string& path);
+	bool run(const std::string& code);
+
+	// Last load, run or callback error, callbacks keep running after one
+	std::string error;
+	uint64_t errors = 0;
+
+	// A global number the script set, e.g. a reward, false when it isn't one
+	bool number(const char* name, double& value);
+
+	// Scheduler side, called by the ppu
+	void frame();
+	void scanline(int line);
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Flat binary save states. Every component writes its fields in a fixed
+// order and reads them back in the same order, so a state only loads into
+// the build that saved it (Bus checks a version number).
+class StateWriter{
+public:
+	std::vector<uint8_t> data;
+
+	void write(const void* bytes, size_t size){
+		const uint8_t* from = (const uint8_t*)bytes;
+		data.insert(data.end(), from, from + size);
+	}
+
+	template<typename T>
+	void put(const T& value){
+		write(&value, sizeof(T));
+	}
+};
+
+class StateReader{
+	const uint8_t* data;
+	size_t size;
+	size_t position = 0;
+public:
+	// Set once a read runs past the end, every read after that gives zeros
+	bool failed = false;
+
+	StateReader(const uint8_t* data, size_t size) : data(data), size(size){}
+
+	void read(void* bytes, size_t count){
+		if(failed || size - position < count){
+			failed = true;
+			memset(bytes, 0, count);
+			return;
+		}
+
+		memcpy(bytes, data + position, count);
+		position += count;
+	}
+
+	template<typename T>
+	void get(T& value){
+		read(&value, sizeof(T));
+	}
+
+	bool atEnd(){ return position == size; }
+};
@@ -0,0 +1,284 @@
+#include "bus.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Runs a suite of test ROMs headless, each on its own thread, and exits with 1
+// if any of them fails. The suite file has one test per line, # starts a comment:
+//
+//   status <rom> [max frames]              blargg style, result byte at $6000
+//   nestest <rom>                          automated nestest from $C000, result in $02/$03
+//   hash <rom> <frames> <expected hash>    FNV-1a of the screen after some frames
+//
+// A ROM path with spaces goes in double quotes, e.g. "donkey kong.nes".
+//
+// usage: testrunner <suite file> [--engine 0|1|2] [--threads n]
+//
+// ROM paths are relative to the working directory. tests/suite.txt is run
+// from the Nes folder with donkey kong.nes and nestest.nes in it.
+
+struct TestCase{
+	string kind;
+	string rom;
+	int frames = 0;
+	uint64_t expectedHash = 0;
+
+	bool passed = false;
+	string message;
+	double seconds = 0;
+};
+
+static void runFrame(Bus& bus){
+	uint32_t frame = bus.ppu.frame;
+	while(bus.ppu.frame == frame){
+		bus.clock();
+	}
+}
+
+static uint64_t screenHash(Bus& bus){
+	uint64_t hash = 14695981039346656037ull;
+	const uint8_t* bytes = (const uint8_t*)bus.ppu.screen;
+
+	for(size_t i = 0; i < windowWidth * windowHeight * sizeof(uint32_t); i++){
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// $6000 holds $80 while running, $81 when the ROM wants a reset and the result
+// code once done. $6001-$6003 must read DE B0 61 before any of it is valid.
+static void runStatus(Bus& bus, TestCase& test){
+	uint8_t* sram = bus.sram();
+	int resetDelay = -1;
+
+	for(int frame = 0; frame < test.frames; frame++){
+		runFrame(bus);
+
+		if(sram[1] != 0xDE || sram[2] != 0xB0 || sram[3] != 0x61)
+			continue;
+
+		uint8_t status = sram[0];
+
+		if(status == 0x80)
+			continue;
+
+		// Reset about 100ms after it was asked for
+		if(status == 0x81){
+			if(resetDelay < 0){
+				resetDelay = 6;
+			} else if(--resetDelay == 0){
+				bus.reset();
+				resetDelay = -1;
+			}
+			continue;
+		}
+
+		string text;
+		for(int i = 4; i < 0x2000 && sram[i] != 0; i++){
+			text += (char)sram[i];
+		}
+
+		test.passed = status == 0;
+		test.message = "result " + to_string(status) + (text.empty() ? "" : ": " + text);
+		return;
+	}
+
+	test.message = "timed out after " + to_string(test.frames) + " frames";
+}
+
+// The automated run ends on the RTS at $C66E after a little under 27000
+// cycles. A ROM that crashes, jams or isn't nestest never gets there.
+static void runNestest(Bus& bus, TestCase& test){
+	const uint16_t endPc = 0xC66E;
+
+	bus.cpu.pc = 0xC000;
+	bus.debugger.addBreakpoint(endPc);
+
+	while(!bus.debugger.stopped && bus.cpu.cycles < 30000){
+		bus.clock();
+	}
+
+	uint8_t official = bus.ram()[0x02];
+	uint8_t unofficial = bus.ram()[0x03];
+
+	stringstream message;
+	message << hex << uppercase << setfill('0');
+
+	if(!bus.debugger.stopped){
+		message << "never reached $" << setw(4) << endPc << ", pc $" << setw(4) << bus.cpu.pc << " after " << dec << bus.cpu.cycles << " cycles";
+		test.message = message.str();
+		return;
+	}
+
+	message << "$02=" << setw(2) << (int)official << " $03=" << setw(2) << (int)unofficial << " at cycle " << dec << bus.debugger.last.cycle;
+
+	test.passed = official == 0 && unofficial == 0;
+	test.message = message.str();
+}
+
+static void runHash(Bus& bus, TestCase& test){
+	for(int frame = 0; frame < test.frames; frame++){
+		runFrame(bus);
+	}
+
+	uint64_t hash = screenHash(bus);
+
+	stringstream message;
+	message << hex << setfill('0') << setw(16) << hash;
+
+	test.passed = hash == test.expectedHash;
+	test.message = "screen " + message.str();
+}
+
+static void runTest(TestCase& test, CPU6502::executionEngine engine){
+	auto start = chrono::steady_clock::now();
+
+	unique_ptr<Bus> bus(new Bus(true));
+
+	if(!bus->loadCartridge(test.rom.c_str())){
+		test.message = "can't load ROM";
+	} else {
+		bus->reset();
+		bus->cpu.engine = engine;
+
+		if(test.kind == "status"){
+			runStatus(*bus, test);
+		} else if(test.kind == "nestest"){
+			runNestest(*bus, test);
+		} else if(test.kind == "hash"){
+			runHash(*bus, test);
+		} else {
+			test.message = "unknown test kind " + test.kind;
+		}
+	}
+
+	test.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static bool readSuite(const char* path, vector<TestCase>& tests){
+	ifstream file(path);
+	if(!file.is_open()){
+		return false;
+	}
+
+	string line;
+	while(getline(file, line)){
+		size_t comment = line.find('#');
+		if(comment != string::npos)
+			line.erase(comment);
+
+		stringstream fields(line);
+		TestCase test;
+
+		if(!(fields >> test.kind >> quoted(test.rom)))
+			continue;
+
+		if(test.kind == "status"){
+			test.frames = 60 * 60;
+			fields >> test.frames;
+		} else if(test.kind == "hash"){
+			fields >> test.frames >> hex >> test.expectedHash;
+		}
+
+		tests.push_back(test);
+	}
+
+	return true;
+}
+
+static int usage(const char* program){
+	cerr << "usage: " << program << " <suite file> [--engine 0|1|2] [--threads n]" << endl;
+	return 2;
+}
+
+int main(int argc, char* argv[]){
+	const char* suite = nullptr;
+	CPU6502::executionEngine engine = CPU6502::Interpret;
+	unsigned threads = thread::hardware_concurrency();
+
+	// Options go before or after the suite file
+	for(int i = 1; i < argc; i++){
+		string argument = argv[i];
+
+		if(argument == "--engine" || argument == "--threads"){
+			if(i + 1 == argc){
+				cerr << argument << " needs a value" << endl;
+				return usage(argv[0]);
+			}
+
+			int value = atoi(argv[++i]);
+
+			if(argument == "--threads"){
+				threads = max(value, 1);
+			} else if(value < CPU6502::Interpret || value > CPU6502::CachedInterpret){
+				cerr << "no engine " << argv[i] << endl;
+				return usage(argv[0]);
+			} else {
+				engine = (CPU6502::executionEngine)value;
+			}
+		} else if(argument.compare(0, 2, "--") == 0){
+			cerr << "unknown option " << argument << endl;
+			return usage(argv[0]);
+		} else if(suite != nullptr){
+			return usage(argv[0]);
+		} else {
+			suite = argv[i];
+		}
+	}
+
+	if(suite == nullptr)
+		return usage(argv[0]);
+
+	if(threads == 0)
+		threads = 1;
+
+	vector<TestCase> tests;
+	if(!readSuite(suite, tests)){
+		cerr << "can't read " << suite << endl;
+		return 2;
+	}
+
+	auto start = chrono::steady_clock::now();
+
+	// Workers take the next test until none are left
+	atomic<size_t> next(0);
+	vector<thread> workers;
+
+	for(unsigned i = 0; i < threads && i < tests.size(); i++){
+		workers.emplace_back([&](){
+			for(size_t index = next++; index < tests.size(); index = next++){
+				runTest(tests[index], engine);
+			}
+		});
+	}
+
+	for(thread& worker : workers){
+		worker.join();
+	}
+
+	int passed = 0;
+
+	cout << fixed << setprecision(2);
+	for(TestCase& test : tests){
+		cout << (test.passed ? "PASS  " : "FAIL  ") << test.rom << "  " << test.message << "  (" << test.seconds << "s)" << endl;
+
+		if(test.passed)
+			passed++;
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << passed << "/" << tests.size() << " passed in " << seconds << "s" << endl;
+
+	runProgram = false;
+	return passed == (int)tests.size() ? 0 : 1;
+}
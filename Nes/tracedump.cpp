@@ -0,0 +1,410 @@
+#include "tracer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Renders a trace file written by Tracer as nestest style text:
+//   C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+// Memory contents are not traced, so the "= 00" annotations nestest adds
+// after memory operands are left out.
+//
+// usage: tracedump <trace file> [last n records]
+
+using namespace std;
+
+enum addressingMode{
+	Implied,
+	Accumulator,
+	Immediate,
+	ZeroPage,
+	ZeroPageX,
+	ZeroPageY,
+	IndexedIndirect,
+	IndirectIndexed,
+	Absolute,
+	AbsoluteX,
+	AbsoluteY,
+	Indirect,
+	Relative
+};
+
+struct Opcode{
+	const char* mnemonic;
+	addressingMode mode;
+	bool official; 			// unofficial opcodes get a * like in nestest.log
+};
+
+static const Opcode opcodes[256] = {
+	{"BRK", Implied,         true },  // 0x00
+	{"ORA", IndexedIndirect, true },  // 0x01
+	{"KIL", Implied,         false},  // 0x02
+	{"SLO", IndexedIndirect, false},  // 0x03
+	{"NOP", ZeroPage,        false},  // 0x04
+	{"ORA", ZeroPage,        true },  // 0x05
+	{"ASL", ZeroPage,        true },  // 0x06
+	{"SLO", ZeroPage,        false},  // 0x07
+	{"PHP", Implied,         true },  // 0x08
+	{"ORA", Immediate,       true },  // 0x09
+	{"ASL", Accumulator,     true },  // 0x0A
+	{"ANC", Immediate,       false},  // 0x0B
+	{"NOP", Absolute,        false},  // 0x0C
+	{"ORA", Absolute,        true },  // 0x0D
+	{"ASL", Absolute,        true },  // 0x0E
+	{"SLO", Absolute,        false},  // 0x0F
+	{"BPL", Relative,        true },  // 0x10
+	{"ORA", IndirectIndexed, true },  // 0x11
+	{"KIL", Implied,         false},  // 0x12
+	{"SLO", IndirectIndexed, false},  // 0x13
+	{"NOP", ZeroPageX,       false},  // 0x14
+	{"ORA", ZeroPageX,       true },  // 0x15
+	{"ASL", ZeroPageX,       true },  // 0x16
+	{"SLO", ZeroPageX,       false},  // 0x17
+	{"CLC", Implied,         true },  // 0x18
+	{"ORA", AbsoluteY,       true },  // 0x19
+	{"NOP", Implied,         false},  // 0x1A
+	{"SLO", AbsoluteY,       false},  // 0x1B
+	{"NOP", AbsoluteX,       false},  // 0x1C
+	{"ORA", AbsoluteX,       true },  // 0x1D
+	{"ASL", AbsoluteX,       true },  // 0x1E
+	{"SLO", AbsoluteX,       false},  // 0x1F
+	{"JSR", Absolute,        true },  // 0x20
+	{"AND", IndexedIndirect, true },  // 0x21
+	{"KIL", Implied,         false},  // 0x22
+	{"RLA", IndexedIndirect, false},  // 0x23
+	{"BIT", ZeroPage,        true },  // 0x24
+	{"AND", ZeroPage,        true },  // 0x25
+	{"ROL", ZeroPage,        true },  // 0x26
+	{"RLA", ZeroPage,        false},  // 0x27
+	{"PLP", Implied,         true },  // 0x28
+	{"AND", Immediate,       true },  // 0x29
+	{"ROL", Accumulator,     true },  // 0x2A
+	{"ANC", Immediate,       false},  // 0x2B
+	{"BIT", Absolute,        true },  // 0x2C
+	{"AND", Absolute,        true },  // 0x2D
+	{"ROL", Absolute,        true },  // 0x2E
+	{"RLA", Absolute,        false},  // 0x2F
+	{"BMI", Relative,        true },  // 0x30
+	{"AND", IndirectIndexed, true },  // 0x31
+	{"KIL", Implied,         false},  // 0x32
+	{"RLA", IndirectIndexed, false},  // 0x33
+	{"NOP", ZeroPageX,       false},  // 0x34
+	{"AND", ZeroPageX,       true },  // 0x35
+	{"ROL", ZeroPageX,       true },  // 0x36
+	{"RLA", ZeroPageX,       false},  // 0x37
+	{"SEC", Implied,         true },  // 0x38
+	{"AND", AbsoluteY,       true },  // 0x39
+	{"NOP", Implied,         false},  // 0x3A
+	{"RLA", AbsoluteY,       false},  // 0x3B
+	{"NOP", AbsoluteX,       false},  // 0x3C
+	{"AND", AbsoluteX,       true },  // 0x3D
+	{"ROL", AbsoluteX,       true },  // 0x3E
+	{"RLA", AbsoluteX,       false},  // 0x3F
+	{"RTI", Implied,         true },  // 0x40
+	{"EOR", IndexedIndirect, true },  // 0x41
+	{"KIL", Implied,         false},  // 0x42
+	{"SRE", IndexedIndirect, false},  // 0x43
+	{"NOP", ZeroPage,        false},  // 0x44
+	{"EOR", ZeroPage,        true },  // 0x45
+	{"LSR", ZeroPage,        true },  // 0x46
+	{"SRE", ZeroPage,        false},  // 0x47
+	{"PHA", Implied,         true },  // 0x48
+	{"EOR", Immediate,       true },  // 0x49
+	{"LSR", Accumulator,     true },  // 0x4A
+	{"ALR", Immediate,       false},  // 0x4B
+	{"JMP", Absolute,        true },  // 0x4C
+	{"EOR", Absolute,        true },  // 0x4D
+	{"LSR", Absolute,        true },  // 0x4E
+	{"SRE", Absolute,        false},  // 0x4F
+	{"BVC", Relative,        true },  // 0x50
+	{"EOR", IndirectIndexed, true },  // 0x51
+	{"KIL", Implied,         false},  // 0x52
+	{"SRE", IndirectIndexed, false},  // 0x53
+	{"NOP", ZeroPageX,       false},  // 0x54
+	{"EOR", ZeroPageX,       true },  // 0x55
+	{"LSR", ZeroPageX,       true },  // 0x56
+	{"SRE", ZeroPageX,       false},  // 0x57
+	{"CLI", Implied,         true },  // 0x58
+	{"EOR", AbsoluteY,       true },  // 0x59
+	{"NOP", Implied,         false},  // 0x5A
+	{"SRE", AbsoluteY,       false},  // 0x5B
+	{"NOP", AbsoluteX,       false},  // 0x5C
+	{"EOR", AbsoluteX,       true },  // 0x5D
+	{"LSR", AbsoluteX,       true },  // 0x5E
+	{"SRE", AbsoluteX,       false},  // 0x5F
+	{"RTS", Implied,         true },  // 0x60
+	{"ADC", IndexedIndirect, true },  // 0x61
+	{"KIL", Implied,         false},  // 0x62
+	{"RRA", IndexedIndirect, false},  // 0x63
+	{"NOP", ZeroPage,        false},  // 0x64
+	{"ADC", ZeroPage,        true },  // 0x65
+	{"ROR", ZeroPage,        true },  // 0x66
+	{"RRA", ZeroPage,        false},  // 0x67
+	{"PLA", Implied,         true },  // 0x68
+	{"ADC", Immediate,       true },  // 0x69
+	{"ROR", Accumulator,     true },  // 0x6A
+	{"ARR", Immediate,       false},  // 0x6B
+	{"JMP", Indirect,        true },  // 0x6C
+	{"ADC", Absolute,        true },  // 0x6D
+	{"ROR", Absolute,        true },  // 0x6E
+	{"RRA", Absolute,        false},  // 0x6F
+	{"BVS", Relative,        true },  // 0x70
+	{"ADC", IndirectIndexed, true },  // 0x71
+	{"KIL", Implied,         false},  // 0x72
+	{"RRA", IndirectIndexed, false},  // 0x73
+	{"NOP", ZeroPageX,       false},  // 0x74
+	{"ADC", ZeroPageX,       true },  // 0x75
+	{"ROR", ZeroPageX,       true },  // 0x76
+	{"RRA", ZeroPageX,       false},  // 0x77
+	{"SEI", Implied,         true },  // 0x78
+	{"ADC", AbsoluteY,       true },  // 0x79
+	{"NOP", Implied,         false},  // 0x7A
+	{"RRA", AbsoluteY,       false},  // 0x7B
+	{"NOP", AbsoluteX,       false},  // 0x7C
+	{"ADC", AbsoluteX,       true },  // 0x7D
+	{"ROR", AbsoluteX,       true },  // 0x7E
+	{"RRA", AbsoluteX,       false},  // 0x7F
+	{"NOP", Immediate,       false},  // 0x80
+	{"STA", IndexedIndirect, true },  // 0x81
+	{"NOP", Immediate,       false},  // 0x82
+	{"SAX", IndexedIndirect, false},  // 0x83
+	{"STY", ZeroPage,        true },  // 0x84
+	{"STA", ZeroPage,        true },  // 0x85
+	{"STX", ZeroPage,        true },  // 0x86
+	{"SAX", ZeroPage,        false},  // 0x87
+	{"DEY", Implied,         true },  // 0x88
+	{"NOP", Immediate,       false},  // 0x89
+	{"TXA", Implied,         true },  // 0x8A
+	{"XAA", Immediate,       false},  // 0x8B
+	{"STY", Absolute,        true },  // 0x8C
+	{"STA", Absolute,        true },  // 0x8D
+	{"STX", Absolute,        true },  // 0x8E
+	{"SAX", Absolute,        false},  // 0x8F
+	{"BCC", Relative,        true },  // 0x90
+	{"STA", IndirectIndexed, true },  // 0x91
+	{"KIL", Implied,         false},  // 0x92
+	{"AHX", IndirectIndexed, false},  // 0x93
+	{"STY", ZeroPageX,       true },  // 0x94
+	{"STA", ZeroPageX,       true },  // 0x95
+	{"STX", ZeroPageY,       true },  // 0x96
+	{"SAX", ZeroPageY,       false},  // 0x97
+	{"TYA", Implied,         true },  // 0x98
+	{"STA", AbsoluteY,       true },  // 0x99
+	{"TXS", Implied,         true },  // 0x9A
+	{"TAS", AbsoluteY,       false},  // 0x9B
+	{"SHY", AbsoluteX,       false},  // 0x9C
+	{"STA", AbsoluteX,       true },  // 0x9D
+	{"SHX", AbsoluteY,       false},  // 0x9E
+	{"AHX", AbsoluteY,       false},  // 0x9F
+	{"LDY", Immediate,       true },  // 0xA0
+	{"LDA", IndexedIndirect, true },  // 0xA1
+	{"LDX", Immediate,       true },  // 0xA2
+	{"LAX", IndexedIndirect, false},  // 0xA3
+	{"LDY", ZeroPage,        true },  // 0xA4
+	{"LDA", ZeroPage,        true },  // 0xA5
+	{"LDX", ZeroPage,        true },  // 0xA6
+	{"LAX", ZeroPage,        false},  // 0xA7
+	{"TAY", Implied,         true },  // 0xA8
+	{"LDA", Immediate,       true },  // 0xA9
+	{"TAX", Implied,         true },  // 0xAA
+	{"LAX", Immediate,       false},  // 0xAB
+	{"LDY", Absolute,        true },  // 0xAC
+	{"LDA", Absolute,        true },  // 0xAD
+	{"LDX", Absolute,        true },  // 0xAE
+	{"LAX", Absolute,        false},  // 0xAF
+	{"BCS", Relative,        true },  // 0xB0
+	{"LDA", IndirectIndexed, true },  // 0xB1
+	{"KIL", Implied,         false},  // 0xB2
+	{"LAX", IndirectIndexed, false},  // 0xB3
+	{"LDY", ZeroPageX,       true },  // 0xB4
+	{"LDA", ZeroPageX,       true },  // 0xB5
+	{"LDX", ZeroPageY,       true },  // 0xB6
+	{"LAX", ZeroPageY,       false},  // 0xB7
+	{"CLV", Implied,         true },  // 0xB8
+	{"LDA", AbsoluteY,       true },  // 0xB9
+	{"TSX", Implied,         true },  // 0xBA
+	{"LAS", AbsoluteY,       false},  // 0xBB
+	{"LDY", AbsoluteX,       true },  // 0xBC
+	{"LDA", AbsoluteX,       true },  // 0xBD
+	{"LDX", AbsoluteY,       true },  // 0xBE
+	{"LAX", AbsoluteY,       false},  // 0xBF
+	{"CPY", Immediate,       true },  // 0xC0
+	{"CMP", IndexedIndirect, true },  // 0xC1
+	{"NOP", Immediate,       false},  // 0xC2
+	{"DCP", IndexedIndirect, false},  // 0xC3
+	{"CPY", ZeroPage,        true },  // 0xC4
+	{"CMP", ZeroPage,        true },  // 0xC5
+	{"DEC", ZeroPage,        true },  // 0xC6
+	{"DCP", ZeroPage,        false},  // 0xC7
+	{"INY", Implied,         true },  // 0xC8
+	{"CMP", Immediate,       true },  // 0xC9
+	{"DEX", Implied,         true },  // 0xCA
+	{"AXS", Immediate,       false},  // 0xCB
+	{"CPY", Absolute,        true },  // 0xCC
+	{"CMP", Absolute,        true },  // 0xCD
+	{"DEC", Absolute,        true },  // 0xCE
+	{"DCP", Absolute,        false},  // 0xCF
+	{"BNE", Relative,        true },  // 0xD0
+	{"CMP", IndirectIndexed, true },  // 0xD1
+	{"KIL", Implied,         false},  // 0xD2
+	{"DCP", IndirectIndexed, false},  // 0xD3
+	{"NOP", ZeroPageX,       false},  // 0xD4
+	{"CMP", ZeroPageX,       true },  // 0xD5
+	{"DEC", ZeroPageX,       true },  // 0xD6
+	{"DCP", ZeroPageX,       false},  // 0xD7
+	{"CLD", Implied,         true },  // 0xD8
+	{"CMP", AbsoluteY,       true },  // 0xD9
+	{"NOP", Implied,         false},  // 0xDA
+	{"DCP", AbsoluteY,       false},  // 0xDB
+	{"NOP", AbsoluteX,       false},  // 0xDC
+	{"CMP", AbsoluteX,       true },  // 0xDD
+	{"DEC", AbsoluteX,       true },  // 0xDE
+	{"DCP", AbsoluteX,       false},  // 0xDF
+	{"CPX", Immediate,       true },  // 0xE0
+	{"SBC", IndexedIndirect, true },  // 0xE1
+	{"NOP", Immediate,       false},  // 0xE2
+	{"ISB", IndexedIndirect, false},  // 0xE3
+	{"CPX", ZeroPage,        true },  // 0xE4
+	{"SBC", ZeroPage,        true },  // 0xE5
+	{"INC", ZeroPage,        true },  // 0xE6
+	{"ISB", ZeroPage,        false},  // 0xE7
+	{"INX", Implied,         true },  // 0xE8
+	{"SBC", Immediate,       true },  // 0xE9
+	{"NOP", Implied,         true },  // 0xEA
+	{"SBC", Immediate,       false},  // 0xEB
+	{"CPX", Absolute,        true },  // 0xEC
+	{"SBC", Absolute,        true },  // 0xED
+	{"INC", Absolute,        true },  // 0xEE
+	{"ISB", Absolute,        false},  // 0xEF
+	{"BEQ", Relative,        true },  // 0xF0
+	{"SBC", IndirectIndexed, true },  // 0xF1
+	{"KIL", Implied,         false},  // 0xF2
+	{"ISB", IndirectIndexed, false},  // 0xF3
+	{"NOP", ZeroPageX,       false},  // 0xF4
+	{"SBC", ZeroPageX,       true },  // 0xF5
+	{"INC", ZeroPageX,       true },  // 0xF6
+	{"ISB", ZeroPageX,       false},  // 0xF7
+	{"SED", Implied,         true },  // 0xF8
+	{"SBC", AbsoluteY,       true },  // 0xF9
+	{"NOP", Implied,         false},  // 0xFA
+	{"ISB", AbsoluteY,       false},  // 0xFB
+	{"NOP", AbsoluteX,       false},  // 0xFC
+	{"SBC", AbsoluteX,       true },  // 0xFD
+	{"INC", AbsoluteX,       true },  // 0xFE
+	{"ISB", AbsoluteX,       false},  // 0xFF
+};
+
+static int instructionLength(addressingMode mode){
+	switch(mode){
+		case Implied:
+		case Accumulator:
+			return 1;
+
+		case Absolute:
+		case AbsoluteX:
+		case AbsoluteY:
+		case Indirect:
+			return 3;
+
+		default:
+			return 2;
+	}
+}
+
+static string disassemble(const TraceRecord& record){
+	const Opcode& opcode = opcodes[record.opcode];
+	uint8_t lo = record.operand[0];
+	uint16_t word = record.operand[0] | (record.operand[1] << 8);
+	char text[32];
+
+	switch(opcode.mode){
+		case Implied: 			text[0] = 0; break;
+		case Accumulator: 		snprintf(text, sizeof(text), "A"); break;
+		case Immediate: 		snprintf(text, sizeof(text), "#$%02X", lo); break;
+		case ZeroPage: 			snprintf(text, sizeof(text), "$%02X", lo); break;
+		case ZeroPageX: 		snprintf(text, sizeof(text), "$%02X,X", lo); break;
+		case ZeroPageY: 		snprintf(text, sizeof(text), "$%02X,Y", lo); break;
+		case IndexedIndirect: 	snprintf(text, sizeof(text), "($%02X,X)", lo); break;
+		case IndirectIndexed: 	snprintf(text, sizeof(text), "($%02X),Y", lo); break;
+		case Absolute: 			snprintf(text, sizeof(text), "$%04X", word); break;
+		case AbsoluteX: 		snprintf(text, sizeof(text), "$%04X,X", word); break;
+		case AbsoluteY: 		snprintf(text, sizeof(text), "$%04X,Y", word); break;
+		case Indirect: 			snprintf(text, sizeof(text), "($%04X)", word); break;
+		case Relative: 			snprintf(text, sizeof(text), "$%04X", (uint16_t)(record.pc + 2 + (int8_t)lo)); break;
+	}
+
+	string line = opcode.mnemonic;
+	if(text[0] != 0){
+		line += " ";
+		line += text;
+	}
+
+	return line;
+}
+
+static void printRecord(const TraceRecord& record){
+	const Opcode& opcode = opcodes[record.opcode];
+	int length = instructionLength(opcode.mode);
+
+	char bytes[16];
+	int used = snprintf(bytes, sizeof(bytes), "%02X", record.opcode);
+	for(int i = 1; i < length; i++){
+		used += snprintf(bytes + used, sizeof(bytes) - used, " %02X", record.operand[i - 1]);
+	}
+
+	printf("%04X  %-9s%c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%llu\n",
+		record.pc, bytes, opcode.official ? ' ' : '*', disassemble(record).c_str(),
+		record.a, record.x, record.y, record.p, record.s,
+		record.scanline, record.dot, (unsigned long long)record.cycle);
+}
+
+int main(int argc, char* argv[]){
+	if(argc < 2){
+		fprintf(stderr, "usage: %s <trace file> [last n records]\n", argv[0]);
+		return 1;
+	}
+
+	FILE* file = fopen(argv[1], "rb");
+	if(file == nullptr){
+		fprintf(stderr, "can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	TraceHeader header;
+	if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "NESTRACE", 8) != 0){
+		fprintf(stderr, "%s is not a trace file\n", argv[1]);
+		fclose(file);
+		return 1;
+	}
+
+	if(header.version != TraceHeader::currentVersion || header.recordSize != sizeof(TraceRecord)){
+		fprintf(stderr, "unsupported trace version %u\n", header.version);
+		fclose(file);
+		return 1;
+	}
+
+	// Oldest record still in the ring
+	uint64_t count = header.written < header.capacity ? header.written : header.capacity;
+	if(argc > 2){
+		uint64_t last = strtoull(argv[2], nullptr, 10);
+		if(last < count)
+			count = last;
+	}
+
+	uint64_t first = header.written - count;
+
+	for(uint64_t i = first; i < header.written; i++){
+		uint64_t slot = i & (header.capacity - 1);
+
+		TraceRecord record;
+		fseek(file, (long)(TraceHeader::recordsOffset + slot * sizeof(TraceRecord)), SEEK_SET);
+		if(fread(&record, sizeof(record), 1, file) != 1)
+			break;
+
+		printRecord(record);
+	}
+
+	fclose(file);
+	return 0;
+}
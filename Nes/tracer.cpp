@@ -0,0 +1,103 @@
+#include "tracer.h"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+Tracer::Tracer(){
+}
+
+Tracer::~Tracer(){
+	close();
+}
+
+bool Tracer::open(const char* path, uint64_t capacity){
+	close();
+
+	uint64_t size = 1;
+	while(size < capacity){
+		size <<= 1;
+	}
+
+	mappedSize = TraceHeader::recordsOffset + size * sizeof(TraceRecord);
+	void* memory = nullptr;
+
+#if defined(_WIN32)
+	file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE){
+		file = nullptr;
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)mappedSize >> 32), (DWORD)mappedSize, NULL);
+	if(mapping != nullptr){
+		memory = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, mappedSize);
+	}
+#else
+	file = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(file < 0){
+		return false;
+	}
+
+	if(ftruncate(file, mappedSize) == 0){
+		memory = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if(memory == MAP_FAILED)
+			memory = nullptr;
+	}
+#endif
+
+	if(memory == nullptr){
+		close();
+		return false;
+	}
+
+	header = (TraceHeader*)memory;
+	records = (TraceRecord*)((uint8_t*)memory + TraceHeader::recordsOffset);
+	mask = size - 1;
+
+	memset(header, 0, sizeof(TraceHeader));
+	memcpy(header->magic, "NESTRACE", 8);
+	header->version = TraceHeader::currentVersion;
+	header->recordSize = sizeof(TraceRecord);
+	header->capacity = size;
+
+	return true;
+}
+
+void Tracer::close(){
+	enabled = false;
+
+#if defined(_WIN32)
+	if(header != nullptr)
+		UnmapViewOfFile(header);
+
+	if(mapping != nullptr)
+		CloseHandle(mapping);
+
+	if(file != nullptr)
+		CloseHandle(file);
+
+	mapping = nullptr;
+	file = nullptr;
+#else
+	if(header != nullptr)
+		munmap(header, mappedSize);
+
+	if(file >= 0)
+		::close(file);
+
+	file = -1;
+#endif
+
+	header = nullptr;
+	records = nullptr;
+	mask = 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// One executed instruction, written as is into the trace file
+struct TraceRecord{
+	uint64_t cycle; 				// cpu cycles since power on
+	uint16_t pc;
+	int16_t scanline;
+	int16_t dot;
+	uint8_t opcode;
+	uint8_t operand[2]; 			// bytes following the opcode, only the used ones are valid
+	uint8_t a, x, y, s, p; 			// registers before the instruction
+	uint8_t reserved[2];
+};
+
+static_assert(sizeof(TraceRecord) == 24, "trace records are read back by tracedump");
+
+// Start of the trace file, records follow at TraceHeader::recordsOffset
+struct TraceHeader{
+	char magic[8]; 					// "NESTRACE"
+	uint32_t version;
+	uint32_t recordSize;
+	uint64_t capacity; 				// records in the ring, a power of two
+	uint64_t written; 				// records written so far, the oldest is overwritten first
+	uint8_t reserved[32];
+
+	static const uint32_t currentVersion = 1;
+	static const size_t recordsOffset = 64;
+};
+
+static_assert(sizeof(TraceHeader) == TraceHeader::recordsOffset, "records start right after the header");
+
+// Binary cpu trace into a memory mapped ring file. Recording is a 24 byte
+// copy, so tracing can stay on for whole sessions. tracedump turns the file
+// into nestest style text.
+class Tracer{
+	TraceHeader* header = nullptr;
+	TraceRecord* records = nullptr;
+	uint64_t mask = 0;
+	size_t mappedSize = 0;
+
+#if defined(_WIN32)
+	void* file = nullptr;
+	void* mapping = nullptr;
+#else
+	int file = -1;
+#endif
+public:
+	Tracer();
+	~Tracer();
+
+	// Toggled at runtime, the cpu checks it once per instruction
+	bool enabled = false;
+
+	// Creates or truncates the file, capacity is rounded up to a power of two
+	bool open(const char* path, uint64_t capacity = 1 << 20);
+	void close();
+
+	bool isOpen(){ return header != nullptr; }
+
+	void record(const TraceRecord& record){
+		records[header->written & mask] = record;
+		header->written++;
+	}
+};
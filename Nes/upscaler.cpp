@@ -0,0 +1,574 @@
+#include "upscaler.h"
+
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#define UPSCALER_SSE2
+#endif
+
+using namespace std;
+
+StripePool::StripePool(int threads){
+	for(int i = 1; i < threads; i++){
+		workers.emplace_back(&StripePool::worker, this);
+	}
+}
+
+StripePool::~StripePool(){
+	{
+		lock_guard<mutex> lock(poolMutex);
+		quit = true;
+	}
+
+	started.notify_all();
+
+	for(thread& t : workers){
+		t.join();
+	}
+}
+
+void StripePool::work(){
+	for(int index = nextJob++; index < jobs; index = nextJob++){
+		job(index);
+	}
+}
+
+void StripePool::worker(){
+	uint64_t seen = 0;
+
+	while(true){
+		{
+			unique_lock<mutex> lock(poolMutex);
+			started.wait(lock, [&](){ return quit || generation != seen; });
+
+			if(quit)
+				return;
+
+			seen = generation;
+		}
+
+		work();
+
+		{
+			lock_guard<mutex> lock(poolMutex);
+			if(--active == 0)
+				finished.notify_all();
+		}
+	}
+}
+
+void StripePool::run(int count, const function<void(int)>& stripe){
+	if(workers.empty()){
+		for(int i = 0; i < count; i++){
+			stripe(i);
+		}
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(poolMutex);
+		job = stripe;
+		jobs = count;
+		nextJob = 0;
+		active = (int)workers.size();
+		generation++;
+	}
+
+	started.notify_all();
+	work();
+
+	unique_lock<mutex> lock(poolMutex);
+	finished.wait(lock, [&](){ return active == 0; });
+}
+
+static int defaultThreads(int threads){
+	if(threads > 0)
+		return threads;
+
+	int hardware = (int)thread::hardware_concurrency();
+	return hardware < 1 ? 1 : (hardware > 4 ? 4 : hardware);
+}
+
+Upscaler::Upscaler(int threads) : pool(defaultThreads(threads)){
+}
+
+bool Upscaler::setMode(filter mode, int factor){
+	bool valid = false;
+
+	switch(mode){
+	case Nearest:
+		valid = 1 <= factor && factor <= 8;
+		break;
+	case Scale2x:
+	case XbrLite:
+		valid = factor == 2 || factor == 4;
+		break;
+	case Scale3x:
+		valid = factor == 3;
+		break;
+	}
+
+	if(valid){
+		this->mode = mode;
+		this->factor = factor;
+	}
+
+	return valid;
+}
+
+// Copy of the frame with its edge pixels repeated twice all around, so the
+// filters can read 2 pixels past any side
+void Upscaler::pad(const uint32_t* in, int width, int height){
+	int pitch = width + 4;
+	padded.resize(pitch * (height + 4));
+
+	for(int y = -2; y < height + 2; y++){
+		const uint32_t* src = in + (y < 0 ? 0 : (y >= height ? height - 1 : y)) * width;
+		uint32_t* row = &padded[(y + 2) * pitch];
+
+		row[0] = row[1] = src[0];
+		memcpy(row + 2, src, width * sizeof(uint32_t));
+		row[width + 2] = row[width + 3] = src[width - 1];
+	}
+}
+
+void Upscaler::nearest(const uint32_t* in, int width, uint32_t* out, int first, int last){
+	int outWidth = width * factor;
+
+#if defined(__AVX2__)
+	// Chunk c of the 8 * factor pixels made from 8 source pixels
+	__m256i index[8];
+	for(int c = 0; c < factor; c++){
+		int lanes[8];
+		for(int j = 0; j < 8; j++){
+			lanes[j] = (8 * c + j) / factor;
+		}
+		index[c] = _mm256_loadu_si256((const __m256i*)lanes);
+	}
+#endif
+
+	for(int y = first; y < last; y++){
+		const uint32_t* src = in + y * width;
+		uint32_t* row = out + (size_t)y * factor * outWidth;
+		int x = 0;
+
+#if defined(__AVX2__)
+		for(; x + 8 <= width; x += 8){
+			__m256i pixels = _mm256_loadu_si256((const __m256i*)(src + x));
+
+			for(int c = 0; c < factor; c++){
+				_mm256_storeu_si256((__m256i*)(row + x * factor + 8 * c), _mm256_permutevar8x32_epi32(pixels, index[c]));
+			}
+		}
+#elif defined(UPSCALER_SSE2)
+		if(factor == 2){
+			for(; x + 4 <= width; x += 4){
+				__m128i pixels = _mm_loadu_si128((const __m128i*)(src + x));
+
+				_mm_storeu_si128((__m128i*)(row + 2 * x), _mm_unpacklo_epi32(pixels, pixels));
+				_mm_storeu_si128((__m128i*)(row + 2 * x + 4), _mm_unpackhi_epi32(pixels, pixels));
+			}
+		}
+#endif
+
+		for(; x < width; x++){
+			for(int c = 0; c < factor; c++){
+				row[x * factor + c] = src[x];
+			}
+		}
+
+		for(int r = 1; r < factor; r++){
+			memcpy(row + r * outWidth, row, outWidth * sizeof(uint32_t));
+		}
+	}
+}
+
+#if defined(UPSCALER_SSE2)
+static inline __m128i select(__m128i mask, __m128i yes, __m128i no){
+	return _mm_or_si128(_mm_and_si128(mask, yes), _mm_andnot_si128(mask, no));
+}
+#endif
+
+//   A B C
+//   D E F    E becomes 2x2 (scale2x) or 3x3 (scale3x) pixels
+//   G H I
+void Upscaler::scale2x(int width, uint32_t* out, int first, int last){
+	int pitch = width + 4;
+	int outWidth = width * 2;
+
+	for(int y = first; y < last; y++){
+		const uint32_t* up = &padded[(y + 1) * pitch + 2];
+		const uint32_t* mid = &padded[(y + 2) * pitch + 2];
+		const uint32_t* down = &padded[(y + 3) * pitch + 2];
+
+		uint32_t* row0 = out + (size_t)(y * 2) * outWidth;
+		uint32_t* row1 = row0 + outWidth;
+		int x = 0;
+
+#if defined(UPSCALER_SSE2)
+		for(; x + 4 <= width; x += 4){
+			__m128i B = _mm_loadu_si128((const __m128i*)(up + x));
+			__m128i D = _mm_loadu_si128((const __m128i*)(mid + x - 1));
+			__m128i E = _mm_loadu_si128((const __m128i*)(mid + x));
+			__m128i F = _mm_loadu_si128((const __m128i*)(mid + x + 1));
+			__m128i H = _mm_loadu_si128((const __m128i*)(down + x));
+
+			__m128i DB = _mm_cmpeq_epi32(D, B);
+			__m128i BF = _mm_cmpeq_epi32(B, F);
+			__m128i DH = _mm_cmpeq_epi32(D, H);
+			__m128i HF = _mm_cmpeq_epi32(H, F);
+
+			__m128i E0 = select(_mm_andnot_si128(_mm_or_si128(BF, DH), DB), D, E);
+			__m128i E1 = select(_mm_andnot_si128(_mm_or_si128(DB, HF), BF), F, E);
+			__m128i E2 = select(_mm_andnot_si128(_mm_or_si128(DB, HF), DH), D, E);
+			__m128i E3 = select(_mm_andnot_si128(_mm_or_si128(DH, BF), HF), F, E);
+
+			_mm_storeu_si128((__m128i*)(row0 + 2 * x), _mm_unpacklo_epi32(E0, E1));
+			_mm_storeu_si128((__m128i*)(row0 + 2 * x + 4), _mm_unpackhi_epi32(E0, E1));
+			_mm_storeu_si128((__m128i*)(row1 + 2 * x), _mm_unpacklo_epi32(E2, E3));
+			_mm_storeu_si128((__m128i*)(row1 + 2 * x + 4), _mm_unpackhi_epi32(E2, E3));
+		}
+#endif
+
+		for(; x < width; x++){
+			uint32_t B = up[x], D = mid[x - 1], E = mid[x], F = mid[x + 1], H = down[x];
+
+			row0[2 * x] = (D == B && B != F && D != H) ? D : E;
+			row0[2 * x + 1] = (B == F && B != D && F != H) ? F : E;
+			row1[2 * x] = (D == H && D != B && H != F) ? D : E;
+			row1[2 * x + 1] = (H == F && D != H && B != F) ? F : E;
+		}
+	}
+}
+
+void Upscaler::scale3x(int width, uint32_t* out, int first, int last){
+	int pitch = width + 4;
+	int outWidth = width * 3;
+
+	for(int y = first; y < last; y++){
+		const uint32_t* up = &padded[(y + 1) * pitch + 2];
+		const uint32_t* mid = &padded[(y + 2) * pitch + 2];
+		const uint32_t* down = &padded[(y + 3) * pitch + 2];
+
+		uint32_t* row0 = out + (size_t)(y * 3) * outWidth;
+		uint32_t* row1 = row0 + outWidth;
+		uint32_t* row2 = row1 + outWidth;
+		int x = 0;
+
+#if defined(UPSCALER_SSE2)
+		const __m128i ones = _mm_set1_epi32(-1);
+
+		for(; x + 4 <= width; x += 4){
+			__m128i A = _mm_loadu_si128((const __m128i*)(up + x - 1));
+			__m128i B = _mm_loadu_si128((const __m128i*)(up + x));
+			__m128i C = _mm_loadu_si128((const __m128i*)(up + x + 1));
+			__m128i D = _mm_loadu_si128((const __m128i*)(mid + x - 1));
+			__m128i E = _mm_loadu_si128((const __m128i*)(mid + x));
+			__m128i F = _mm_loadu_si128((const __m128i*)(mid + x + 1));
+			__m128i G = _mm_loadu_si128((const __m128i*)(down + x - 1));
+			__m128i H = _mm_loadu_si128((const __m128i*)(down + x));
+			__m128i I = _mm_loadu_si128((const __m128i*)(down + x + 1));
+
+			__m128i DB = _mm_cmpeq_epi32(D, B);
+			__m128i BF = _mm_cmpeq_epi32(B, F);
+			__m128i DH = _mm_cmpeq_epi32(D, H);
+			__m128i HF = _mm_cmpeq_epi32(H, F);
+
+			__m128i c1 = _mm_andnot_si128(_mm_or_si128(DH, BF), DB); 	// D == B, D != H, B != F
+			__m128i c2 = _mm_andnot_si128(_mm_or_si128(DB, HF), BF); 	// B == F, B != D, F != H
+			__m128i c3 = _mm_andnot_si128(_mm_or_si128(DB, HF), DH); 	// D == H, D != B, H != F
+			__m128i c4 = _mm_andnot_si128(_mm_or_si128(DH, BF), HF); 	// H == F, D != H, B != F
+
+			__m128i nA = _mm_xor_si128(_mm_cmpeq_epi32(E, A), ones);
+			__m128i nC = _mm_xor_si128(_mm_cmpeq_epi32(E, C), ones);
+			__m128i nG = _mm_xor_si128(_mm_cmpeq_epi32(E, G), ones);
+			__m128i nI = _mm_xor_si128(_mm_cmpeq_epi32(E, I), ones);
+
+			__m128i result[9];
+			result[0] = select(c1, D, E);
+			result[1] = select(_mm_or_si128(_mm_and_si128(c1, nC), _mm_and_si128(c2, nA)), B, E);
+			result[2] = select(c2, F, E);
+			result[3] = select(_mm_or_si128(_mm_and_si128(c1, nG), _mm_and_si128(c3, nA)), D, E);
+			result[4] = E;
+			result[5] = select(_mm_or_si128(_mm_and_si128(c2, nI), _mm_and_si128(c4, nC)), F, E);
+			result[6] = select(c3, D, E);
+			result[7] = select(_mm_or_si128(_mm_and_si128(c3, nI), _mm_and_si128(c4, nG)), H, E);
+			result[8] = select(c4, F, E);
+
+			uint32_t pixels[9][4];
+			for(int i = 0; i < 9; i++){
+				_mm_storeu_si128((__m128i*)pixels[i], result[i]);
+			}
+
+			for(int k = 0; k < 4; k++){
+				uint32_t* p0 = row0 + 3 * (x + k);
+				uint32_t* p1 = row1 + 3 * (x + k);
+				uint32_t* p2 = row2 + 3 * (x + k);
+
+				p0[0] = pixels[0][k]; p0[1] = pixels[1][k]; p0[2] = pixels[2][k];
+				p1[0] = pixels[3][k]; p1[1] = pixels[4][k]; p1[2] = pixels[5][k];
+				p2[0] = pixels[6][k]; p2[1] = pixels[7][k]; p2[2] = pixels[8][k];
+			}
+		}
+#endif
+
+		for(; x < width; x++){
+			uint32_t A = up[x - 1], B = up[x], C = up[x + 1];
+			uint32_t D = mid[x - 1], E = mid[x], F = mid[x + 1];
+			uint32_t G = down[x - 1], H = down[x], I = down[x + 1];
+
+			bool c1 = D == B && D != H && B != F;
+			bool c2 = B == F && B != D && F != H;
+			bool c3 = D == H && D != B && H != F;
+			bool c4 = H == F && D != H && B != F;
+
+			uint32_t* p0 = row0 + 3 * x;
+			uint32_t* p1 = row1 + 3 * x;
+			uint32_t* p2 = row2 + 3 * x;
+
+			p0[0] = c1 ? D : E;
+			p0[1] = ((c1 && E != C) || (c2 && E != A)) ? B : E;
+			p0[2] = c2 ? F : E;
+			p1[0] = ((c1 && E != G) || (c3 && E != A)) ? D : E;
+			p1[1] = E;
+			p1[2] = ((c2 && E != I) || (c4 && E != C)) ? F : E;
+			p2[0] = c3 ? D : E;
+			p2[1] = ((c3 && E != I) || (c4 && E != G)) ? H : E;
+			p2[2] = c4 ? F : E;
+		}
+	}
+}
+
+static inline uint32_t toYuv(uint32_t rgb){
+	int r = (rgb >> 16) & 0xFF;
+	int g = (rgb >> 8) & 0xFF;
+	int b = rgb & 0xFF;
+
+	int y = (299 * r + 587 * g + 114 * b) / 1000;
+	int u = 128 + (-169 * r - 331 * g + 500 * b) / 1000;
+	int v = 128 + (500 * r - 419 * g - 81 * b) / 1000;
+
+	return y | (u << 8) | (v << 16);
+}
+
+// Weighted YUV distance of xBR
+static inline int distance(uint32_t a, uint32_t b){
+	int y = abs((int)(a & 0xFF) - (int)(b & 0xFF));
+	int u = abs((int)((a >> 8) & 0xFF) - (int)((b >> 8) & 0xFF));
+	int v = abs((int)((a >> 16) & 0xFF) - (int)((b >> 16) & 0xFF));
+
+	return 48 * y + 7 * u + 6 * v;
+}
+
+static inline uint32_t blend(uint32_t a, uint32_t b){
+	return ((a & 0xFEFEFEFE) >> 1) + ((b & 0xFEFEFEFE) >> 1) + (a & b & 0x01010101);
+}
+
+namespace {
+// Lookup of the distance between a padded pixel and one of its 8 neighbours,
+// each pair is stored once at the upper (or left) pixel
+struct Distances{
+	const int* horizontal; 		// to x + 1
+	const int* vertical; 		// to y + 1
+	const int* diagonal; 		// to x + 1, y + 1
+	const int* antiDiagonal; 	// to x - 1, y + 1
+	int pitch;
+
+	template<int dx, int dy>
+	int to(int i) const {
+		if constexpr(dy < 0 || (dy == 0 && dx < 0)){
+			return to<-dx, -dy>(i + dx + dy * pitch);
+		} else if constexpr(dy == 0){
+			return horizontal[i];
+		} else if constexpr(dx == 0){
+			return vertical[i];
+		} else if constexpr(dx > 0){
+			return diagonal[i];
+		} else {
+			return antiDiagonal[i];
+		}
+	}
+};
+
+// xBR level 1 for the corner of E between F (one step along a) and H (one
+// step along b). An edge runs through the corner when the distances across
+// it beat those along it, and the corner is then half E and half the closer
+// of F and H.
+template<int ax, int by>
+inline uint32_t xbrCorner(const uint32_t* rgb, const Distances& d, int i){
+	int a = ax;
+	int b = by * d.pitch;
+
+	uint32_t E = rgb[i], F = rgb[i + a], H = rgb[i + b];
+
+	if(E == F || E == H)
+		return E;
+
+	int e = d.to<ax, -by>(i) + d.to<-ax, by>(i) + d.to<ax, -by>(i + a + b)
+		+ d.to<-ax, by>(i + a + b) + 4 * d.to<ax, -by>(i + b);
+	int f = d.to<-ax, -by>(i + b) + d.to<ax, by>(i + b) + d.to<ax, by>(i + a)
+		+ d.to<-ax, -by>(i + a) + 4 * d.to<ax, by>(i);
+
+	if(e >= f)
+		return E;
+
+	return blend(E, d.to<ax, 0>(i) <= d.to<0, by>(i) ? F : H);
+}
+}
+
+void Upscaler::xbr2x(int width, uint32_t* out, int first, int last){
+	int pitch = width + 4;
+	int outWidth = width * 2;
+
+	Distances d = { horizontal.data(), vertical.data(), diagonal.data(), antiDiagonal.data(), pitch };
+
+	for(int y = first; y < last; y++){
+		uint32_t* row0 = out + (size_t)(y * 2) * outWidth;
+		uint32_t* row1 = row0 + outWidth;
+		const uint32_t* rgb = padded.data();
+
+		for(int x = 0; x < width; x++){
+			int i = (y + 2) * pitch + x + 2;
+
+			row0[2 * x] = xbrCorner<-1, -1>(rgb, d, i);
+			row0[2 * x + 1] = xbrCorner<1, -1>(rgb, d, i);
+			row1[2 * x] = xbrCorner<-1, 1>(rgb, d, i);
+			row1[2 * x + 1] = xbrCorner<1, 1>(rgb, d, i);
+		}
+	}
+}
+
+#if defined(UPSCALER_SSE2)
+// distance() of 4 pairs of pixels
+static inline __m128i distance(__m128i a, __m128i b){
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weights = _mm_setr_epi16(48, 7, 6, 0, 48, 7, 6, 0);
+
+	__m128i difference = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+
+	// 48 y + 7 u and 6 v of each pixel, then the two added up
+	__m128 low = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(difference, zero), weights));
+	__m128 high = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(difference, zero), weights));
+
+	return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0))),
+		_mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+#endif
+
+// Distances from every padded pixel to its neighbours, rows first to last
+void Upscaler::distances(int width, int height, int first, int last){
+	int pitch = width + 4;
+	int rows = height + 4;
+
+	for(int y = first; y < last; y++){
+		bool below = y + 1 < rows;
+		int x = 0;
+
+		auto single = [&](int x){
+			int i = y * pitch + x;
+			bool right = x + 1 < pitch;
+			bool left = x > 0;
+
+			horizontal[i] = right ? distance(yuv[i], yuv[i + 1]) : 0;
+			vertical[i] = below ? distance(yuv[i], yuv[i + pitch]) : 0;
+			diagonal[i] = (right && below) ? distance(yuv[i], yuv[i + pitch + 1]) : 0;
+			antiDiagonal[i] = (left && below) ? distance(yuv[i], yuv[i + pitch - 1]) : 0;
+		};
+
+		single(x++);
+
+#if defined(UPSCALER_SSE2)
+		if(below){
+			for(; x + 5 <= pitch; x += 4){
+				int i = y * pitch + x;
+				const uint32_t* up = &yuv[i];
+				const uint32_t* down = &yuv[i + pitch];
+
+				__m128i center = _mm_loadu_si128((const __m128i*)up);
+
+				_mm_storeu_si128((__m128i*)&horizontal[i], distance(center, _mm_loadu_si128((const __m128i*)(up + 1))));
+				_mm_storeu_si128((__m128i*)&vertical[i], distance(center, _mm_loadu_si128((const __m128i*)down)));
+				_mm_storeu_si128((__m128i*)&diagonal[i], distance(center, _mm_loadu_si128((const __m128i*)(down + 1))));
+				_mm_storeu_si128((__m128i*)&antiDiagonal[i], distance(center, _mm_loadu_si128((const __m128i*)(down - 1))));
+			}
+		}
+#endif
+
+		for(; x < pitch; x++){
+			single(x);
+		}
+	}
+}
+
+void Upscaler::pass(const uint32_t* in, int width, int height, uint32_t* out){
+	pad(in, width, height);
+
+	int stripes = pool.threads() * 2;
+	if(stripes > height)
+		stripes = height;
+
+	if(mode == XbrLite){
+		yuv.resize(padded.size());
+		horizontal.resize(padded.size());
+		vertical.resize(padded.size());
+		diagonal.resize(padded.size());
+		antiDiagonal.resize(padded.size());
+
+		pool.run(stripes, [&](int stripe){
+			size_t first = padded.size() * stripe / stripes;
+			size_t last = padded.size() * (stripe + 1) / stripes;
+
+			for(size_t i = first; i < last; i++){
+				yuv[i] = toYuv(padded[i]);
+			}
+		});
+
+		// Needs the next row of yuv, so only after all of it is done
+		pool.run(stripes, [&](int stripe){
+			distances(width, height, (height + 4) * stripe / stripes, (height + 4) * (stripe + 1) / stripes);
+		});
+	}
+
+	pool.run(stripes, [&](int stripe){
+		int first = height * stripe / stripes;
+		int last = height * (stripe + 1) / stripes;
+
+		if(mode == Scale2x){
+			scale2x(width, out, first, last);
+		} else if(mode == Scale3x){
+			scale3x(width, out, first, last);
+		} else {
+			xbr2x(width, out, first, last);
+		}
+	});
+}
+
+void Upscaler::scale(const uint32_t* in, int width, int height, uint32_t* out){
+	if(mode == Nearest){
+		int stripes = pool.threads() * 2;
+		if(stripes > height)
+			stripes = height;
+
+		pool.run(stripes, [&](int stripe){
+			nearest(in, width, out, height * stripe / stripes, height * (stripe + 1) / stripes);
+		});
+		return;
+	}
+
+	if(factor == 4){
+		intermediate.resize(width * height * 4);
+
+		pass(in, width, height, intermediate.data());
+		pass(intermediate.data(), width * 2, height * 2, out);
+		return;
+	}
+
+	pass(in, width, height, out);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// Small pool running the stripes of one frame. The calling thread takes
+// stripes too, run returns once all of them are done.
+class StripePool{
+	std::vector<std::thread> workers;
+	std::mutex poolMutex;
+	std::condition_variable started;
+	std::condition_variable finished;
+
+	std::function<void(int)> job;
+	int jobs = 0;
+	std::atomic<int> nextJob{0};
+	int active = 0;
+	uint64_t generation = 0;
+	bool quit = false;
+
+	void work();
+	void worker();
+public:
+	// threads counts the caller, so 1 starts no threads at all
+	StripePool(int threads);
+	~StripePool();
+
+	int threads(){ return (int)workers.size() + 1; }
+
+	void run(int count, const std::function<void(int)>& stripe);
+};
+
+// Pixel art upscaling of a finished RGB frame, split into horizontal stripes
+// over a StripePool. Nearest takes any factor from 1 to 8, Scale2x and XbrLite
+// 2 or 4 (two passes), Scale3x only 3.
+class Upscaler{
+	StripePool pool;
+
+	// Source with 2 replicated pixels around it, and the intermediate frame of
+	// two pass modes
+	std::vector<uint32_t> padded;
+	std::vector<uint32_t> intermediate;
+
+	// Packed YUV of padded and the xBR color distances of each of its pixels
+	// to the neighbours right, below, below right and below left
+	std::vector<uint32_t> yuv;
+	std::vector<int> horizontal;
+	std::vector<int> vertical;
+	std::vector<int> diagonal;
+	std::vector<int> antiDiagonal;
+
+	void pad(const uint32_t* in, int width, int height);
+
+	void nearest(const uint32_t* in, int width, uint32_t* out, int first, int last);
+	void scale2x(int width, uint32_t* out, int first, int last);
+	void scale3x(int width, uint32_t* out, int first, int last);
+	void xbr2x(int width, uint32_t* out, int first, int last);
+	void distances(int width, int height, int first, int last);
+
+	void pass(const uint32_t* in, int width, int height, uint32_t* out);
+public:
+	enum filter{
+		Nearest = 0,
+		Scale2x = 1,
+		Scale3x = 2,
+		XbrLite = 3
+	};
+
+	// threads 0 picks up to 4 from the hardware
+	Upscaler(int threads = 0);
+
+	filter mode = Nearest;
+	int factor = 1;
+
+	// False if the factor doesn't suit the filter
+	bool setMode(filter mode, int factor);
+
+	// out holds width * factor by height * factor pixels
+	void scale(const uint32_t* in, int width, int height, uint32_t* out);
+};
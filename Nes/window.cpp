@@ -5,6 +5,27 @@
 using namespace std;
 uint32_t windowPixelColor[windowWidth * windowHeight] = {0};
 
+// Posted by setWindowUpscaler, the window is resized on its own thread
+const UINT WM_UPSCALER = WM_APP;
+
+static const DWORD windowStyle = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU;
+
+// Outer size of a window whose client area fits the upscaled frame
+static SIZE windowSize(){
+	Upscaler* upscaler = windowUpscaler.load(memory_order_acquire);
+	int scale = upscaler != nullptr ? upscaler->factor : 1;
+
+	RECT r;
+	r.left = 0;
+	r.top = 0;
+	r.right = windowWidth * scale;
+	r.bottom = windowHeight * scale;
+	AdjustWindowRectEx(&r, windowStyle, FALSE, 0);
+
+	SIZE size = { r.right - r.left, r.bottom - r.top };
+	return size;
+}
+
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
 	wchar_t msg[32];
@@ -12,62 +33,50 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 	{
 		// s d f enter 
 		case WM_KEYDOWN:
+		case WM_KEYUP:
+		{
+			uint8_t button = 0;
+
 			switch(wParam){
 				case 0x46: // F - A
-					controller |= 0x80;
+					button = 0x80;
 					break;
 				case 0x44: // D - B 
-					controller |= 0x40;
+					button = 0x40;
 					break;
 				case 0x53: // S - Select
-					controller |= 0x20;
+					button = 0x20;
 					break;
 				case 0x0D: // Enter - Start
-					controller |= 0x10;
+					button = 0x10;
 					break;
 				case 0x26: // UP 
-					controller |= 0x8;
+					button = 0x8;
 					break;
 				case 0x28: // Down
-					controller |= 0x4;
+					button = 0x4;
 					break;
 				case 0x25: // Left
-					controller |= 0x2;
+					button = 0x2;
 					break;
 				case 0x27: // Right
-					controller |= 0x1;
+					button = 0x1;
 					break;
 			}
-			break;
 
-		case WM_KEYUP:
-			switch(wParam){
-				case 0x46: // F - A
-					controller &= ~0x80;
-					break;
-				case 0x44: // D - B 
-					controller &= ~0x40;
-					break;
-				case 0x53: // S - Select
-					controller &= ~0x20;
-					break;
-				case 0x0D: // Enter - Start
-					controller &= ~0x10;
-					break;
-				case 0x26: // UP 
-					controller &= ~0x8;
-					break;
-				case 0x28: // Down
-					controller &= ~0x4;
-					break;
-				case 0x25: // Left
-					controller &= ~0x2;
-					break;
-				case 0x27: // Right
-					controller &= ~0x1;
-					break;
+			InputQueue* input = windowInput.load(memory_order_acquire);
+
+			// Bit 30 is set on auto repeats of a held key
+			if(button == 0 || input == nullptr || (uMsg == WM_KEYDOWN && (lParam & (1 << 30))))
+				break;
+
+			if(uMsg == WM_KEYDOWN){
+				input->press(0, button);
+			} else {
+				input->release(0, button);
 			}
 			break;
+		}
 
 		case WM_PAINT:
 		{
@@ -75,16 +84,19 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 			HDC hdc = BeginPaint(hwnd, &ps);
 			HDC hdcMem = CreateCompatibleDC(hdc);
 
-			int w = 256;
-			int h = 240;
+			// Frames go through the upscaler when one is set
+			Upscaler* upscaler = windowUpscaler.load(memory_order_acquire);
+			int scale = upscaler != nullptr ? upscaler->factor : 1;
+			int w = windowWidth * scale;
+			int h = windowHeight * scale;
 
 			int32_t* pvBits = NULL;
 
 			BITMAPINFO bmi;
 			memset(&bmi, 0, sizeof(BITMAPINFO));
 			bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-			bmi.bmiHeader.biWidth = 256;
-			bmi.bmiHeader.biHeight = -240;
+			bmi.bmiHeader.biWidth = w;
+			bmi.bmiHeader.biHeight = -h;
 			bmi.bmiHeader.biPlanes = 1;
 			bmi.bmiHeader.biBitCount = 32;
 			bmi.bmiHeader.biCompression = BI_RGB;
@@ -94,8 +106,12 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 			BitBlt(hdcMem, 0, 0, w, h, hdc, 0, 0, SRCCOPY);
 			
-			for(int i = 0; i < w * h; i++){
-				pvBits[i] = windowPixelColor[i];
+			if(upscaler != nullptr){
+				upscaler->scale(windowPixelColor, windowWidth, windowHeight, (uint32_t*)pvBits);
+			} else {
+				for(int i = 0; i < w * h; i++){
+					pvBits[i] = windowPixelColor[i];
+				}
 			}
 			BitBlt(hdc, 0, 0, w, h, hdcMem, 0, 0, SRCCOPY);
 
@@ -105,6 +121,18 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 			EndPaint(hwnd, &ps);
 
+			LatencyMonitor* latency = windowLatency.load(memory_order_acquire);
+			if(latency != nullptr)
+				latency->presented();
+
+			return 0;
+		}
+
+		case WM_UPSCALER:
+		{
+			SIZE size = windowSize();
+			SetWindowPos(hwnd, NULL, 0, 0, size.cx, size.cy, SWP_NOMOVE | SWP_NOZORDER | SWP_NOACTIVATE);
+			InvalidateRect(hwnd, NULL, FALSE);
 			return 0;
 		}
 
@@ -117,10 +145,23 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 	return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
+uint32_t* openWindow(){
+	CreateThread(NULL, 0, ep, NULL, 0, NULL);
+	return windowPixelColor;
+}
+
 void updateScreen(){
 	InvalidateRect( wind, NULL, FALSE );
 }
 
+void setWindowUpscaler(Upscaler* upscaler){
+	windowUpscaler.store(upscaler, memory_order_release);
+
+	// A window created after this is sized from the factor already
+	if(wind != NULL)
+		PostMessage(wind, WM_UPSCALER, 0, 0);
+}
+
 DWORD WINAPI ep(void* data){
 	HINSTANCE hInstance = GetModuleHandle(NULL);
 
@@ -134,22 +175,17 @@ DWORD WINAPI ep(void* data){
 
 	RegisterClass(&wc);
 
-	RECT r;
-	r.left = 0;
-	r.top = 0;
-	r.right = 256;
-	r.bottom = 240;
-	AdjustWindowRectEx(&r, WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU, FALSE, 0);
+	SIZE size = windowSize();
 
 	// Create the window.
 	wind = CreateWindowEx(
 		0,
 		CLASSNAME,
 		L"Nes",
-		WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU, 
+		windowStyle, 
 
 		// Size and position
-		CW_USEDEFAULT, CW_USEDEFAULT, r.right - r.left, r.bottom-r.top,
+		CW_USEDEFAULT, CW_USEDEFAULT, size.cx, size.cy,
 
 		NULL,
 		NULL,
@@ -162,6 +198,9 @@ DWORD WINAPI ep(void* data){
 		return 0;
 	}
 	
+	// An upscaler set while the window was being created
+	PostMessage(wind, WM_UPSCALER, 0, 0);
+
 	ShowWindow(wind, 1);
 
 	MSG msg = { };
@@ -1,25 +1,55 @@
 #pragma once
 
+#if defined(_WIN32)
 #ifndef UNICODE
 #define UNICODE
 #endif
 
 #include <windows.h>
+#endif
+
 #include <iostream>
 #include <stdlib.h>
 #include <cstdint>
+#include <atomic>
+
+#include "upscaler.h"
+#include "input.h"
+#include "latency.h"
 
+#if defined(_WIN32)
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
+inline HWND wind = NULL;
+#endif
+
+// Win32 in window.cpp, X11 in x11window.cpp. openWindow starts the window on
+// its own thread and returns the buffer the ppu draws into, updateScreen marks
+// it for presenting.
+uint32_t* openWindow();
 void updateScreen();
 
-inline HWND wind = NULL;
+// Set by the bus on the emulation thread and used from the window thread,
+// stores release and loads acquire so the window sees the object complete.
+// Keyboard events of the window go to the queue of the windowed bus.
+inline std::atomic<InputQueue*> windowInput{nullptr};
+
+// Told about every present when measuring latency
+inline std::atomic<LatencyMonitor*> windowLatency{nullptr};
 
-inline uint8_t controller;
-inline bool runProgram = true;
+// Cleared by the window thread when the window closes
+inline std::atomic<bool> runProgram{true};
 
 const int windowWidth = 256;
 const int windowHeight = 240;
 extern uint32_t windowPixelColor[windowWidth * windowHeight];
 
+// Upscaling of the frame when presenting, none for a 1:1 blit. Set it with
+// setWindowUpscaler, which also resizes the window to the factor; call it
+// again after changing the factor and with nullptr before deleting it.
+inline std::atomic<Upscaler*> windowUpscaler{nullptr};
+void setWindowUpscaler(Upscaler* upscaler);
+
+#if defined(_WIN32)
 DWORD WINAPI ep(void* data);
+#endif
@@ -0,0 +1,401 @@
+#include "window.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/XKBlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <poll.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// X11 window for Linux, linked instead of window.cpp with -lX11 -lXext.
+// The ppu draws straight into an MIT-SHM segment the server reads the frame
+// from, so presenting is one copy on the server side and none here. Without
+// the extension (e.g. remote displays) frames go out with XPutImage from
+// windowPixelColor instead, and on visuals that don't take 0x00RRGGBB
+// pixels as they are they are converted into an image of the visual's
+// format first. With an upscaler set frames are scaled into an image of
+// their own and always go out with XPutImage. Works the same under Xvfb.
+uint32_t windowPixelColor[windowWidth * windowHeight] = {0};
+
+static Display* display = nullptr;
+static Window window;
+static GC gc;
+static XImage* image = nullptr;
+static XShmSegmentInfo segment;
+static Atom deleteWindow;
+static Visual* visual = nullptr;
+static int depth = 0;
+
+// What the ppu draws into, the shared segment or windowPixelColor
+static uint32_t* frame = windowPixelColor;
+
+// Upscaled frames, the window is sized for scale
+static int scale = 1;
+static vector<uint32_t> scaledPixels;
+static XImage* scaledImage = nullptr;
+
+static bool shared = false;
+static int completionEvent = -1;
+
+// Pixels are converted for visuals with other channel masks or depths
+static bool converted = false;
+
+struct Channel{
+	int shift;
+	int bits;
+};
+
+static Channel channels[3]; 	// red, green, blue
+
+// Set by the emulation thread, frames are only put from the window thread
+static atomic<bool> dirty{false};
+
+// A shared put is in flight until its ShmCompletion arrives
+static bool presenting = false;
+
+static bool attachFailed = false;
+
+static int attachError(Display*, XErrorEvent*){
+	attachFailed = true;
+	return 0;
+}
+
+static uint8_t buttonOf(KeySym key){
+	switch(key){
+		case XK_f: 		return 0x80; 	// A
+		case XK_d: 		return 0x40; 	// B
+		case XK_s: 		return 0x20; 	// Select
+		case XK_Return: return 0x10; 	// Start
+		case XK_Up: 	return 0x8;
+		case XK_Down: 	return 0x4;
+		case XK_Left: 	return 0x2;
+		case XK_Right: 	return 0x1;
+	}
+
+	return 0;
+}
+
+static int hostByteOrder(){
+	uint16_t one = 1;
+	return *(uint8_t*)&one ? LSBFirst : MSBFirst;
+}
+
+// The ppu writes 0x00RRGGBB, which a 24 bit TrueColor visual takes as is
+static bool nativeFormat(Visual* visual, int depth){
+	return depth >= 24 && visual->red_mask == 0xFF0000 && visual->green_mask == 0xFF00 && visual->blue_mask == 0xFF;
+}
+
+static Channel channelOf(unsigned long mask){
+	Channel channel = {0, 0};
+
+	if(mask == 0)
+		return channel;
+
+	while(!((mask >> channel.shift) & 1))
+		channel.shift++;
+
+	while((mask >> (channel.shift + channel.bits)) & 1)
+		channel.bits++;
+
+	return channel;
+}
+
+static unsigned long place(uint32_t value, const Channel& channel){
+	unsigned long bits = channel.bits >= 8 ? value << (channel.bits - 8) : value >> (8 - channel.bits);
+	return bits << channel.shift;
+}
+
+// Into the target's own buffer, in whatever layout the visual has
+static void convertPixels(const uint32_t* pixels, XImage* target, int width, int height){
+	for(int y = 0; y < height; y++){
+		for(int x = 0; x < width; x++){
+			uint32_t color = pixels[y * width + x];
+
+			unsigned long pixel = place((color >> 16) & 0xFF, channels[0])
+				| place((color >> 8) & 0xFF, channels[1])
+				| place(color & 0xFF, channels[2]);
+
+			XPutPixel(target, x, y, pixel);
+		}
+	}
+}
+
+static bool createSharedImage(Visual* visual, int depth){
+	if(!XShmQueryExtension(display))
+		return false;
+
+	image = XShmCreateImage(display, visual, depth, ZPixmap, nullptr, &segment, windowWidth, windowHeight);
+	if(image == nullptr)
+		return false;
+
+	// The ppu writes 0x00RRGGBB pixels in its own byte order without a row pitch
+	if(image->bits_per_pixel != 32 || image->bytes_per_line != windowWidth * 4 || image->byte_order != hostByteOrder()){
+		XDestroyImage(image);
+		image = nullptr;
+		return false;
+	}
+
+	segment.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * image->height, IPC_CREAT | 0600);
+	if(segment.shmid < 0){
+		XDestroyImage(image);
+		image = nullptr;
+		return false;
+	}
+
+	void* address = shmat(segment.shmid, nullptr, 0);
+	if(address == (void*)-1){
+		shmctl(segment.shmid, IPC_RMID, nullptr);
+		XDestroyImage(image);
+		image = nullptr;
+		return false;
+	}
+
+	segment.shmaddr = image->data = (char*)address;
+	segment.readOnly = False;
+
+	// Attaching fails asynchronously, e.g. on a display over the network
+	attachFailed = false;
+	XErrorHandler previous = XSetErrorHandler(attachError);
+	XShmAttach(display, &segment);
+	XSync(display, False);
+	XSetErrorHandler(previous);
+
+	// Freed once both sides have detached
+	shmctl(segment.shmid, IPC_RMID, nullptr);
+
+	if(attachFailed){
+		shmdt(segment.shmaddr);
+		image->data = nullptr;
+		XDestroyImage(image);
+		image = nullptr;
+		return false;
+	}
+
+	completionEvent = XShmGetEventBase(display) + ShmCompletion;
+	return true;
+}
+
+static void setWindowSize(int width, int height){
+	XSizeHints hints = {};
+	hints.flags = PMinSize | PMaxSize;
+	hints.min_width = hints.max_width = width;
+	hints.min_height = hints.max_height = height;
+	XSetWMNormalHints(display, window, &hints);
+	XResizeWindow(display, window, width, height);
+}
+
+// Resizes the window and the scaled image when the factor changed
+static void applyScale(int factor){
+	if(factor == scale)
+		return;
+
+	scale = factor;
+
+	if(scaledImage != nullptr){
+		// Only the converted image's buffer is Xlib's to free
+		if(!converted)
+			scaledImage->data = nullptr;
+
+		XDestroyImage(scaledImage);
+		scaledImage = nullptr;
+	}
+
+	int width = windowWidth * factor;
+	int height = windowHeight * factor;
+
+	if(factor > 1){
+		scaledPixels.resize(width * height);
+
+		if(converted){
+			scaledImage = XCreateImage(display, visual, depth, ZPixmap, 0, nullptr, width, height, 32, 0);
+			scaledImage->data = (char*)calloc(scaledImage->bytes_per_line, height);
+		} else {
+			scaledImage = XCreateImage(display, visual, depth, ZPixmap, 0, (char*)scaledPixels.data(), width, height, 32, width * 4);
+			scaledImage->byte_order = hostByteOrder();
+		}
+	}
+
+	setWindowSize(width, height);
+}
+
+static void presented(){
+	LatencyMonitor* latency = windowLatency.load(memory_order_acquire);
+	if(latency != nullptr)
+		latency->presented();
+}
+
+static void present(){
+	Upscaler* upscaler = windowUpscaler.load(memory_order_acquire);
+	applyScale(upscaler != nullptr ? upscaler->factor : 1);
+
+	if(scale > 1){
+		int width = windowWidth * scale;
+		int height = windowHeight * scale;
+
+		upscaler->scale(frame, windowWidth, windowHeight, scaledPixels.data());
+
+		if(converted)
+			convertPixels(scaledPixels.data(), scaledImage, width, height);
+
+		XPutImage(display, window, gc, scaledImage, 0, 0, 0, 0, width, height);
+		XFlush(display);
+		presented();
+		return;
+	}
+
+	if(shared){
+		XShmPutImage(display, window, gc, image, 0, 0, 0, 0, windowWidth, windowHeight, True);
+		presenting = true;
+	} else {
+		if(converted)
+			convertPixels(windowPixelColor, image, windowWidth, windowHeight);
+
+		XPutImage(display, window, gc, image, 0, 0, 0, 0, windowWidth, windowHeight);
+	}
+
+	XFlush(display);
+
+	if(!shared)
+		presented();
+}
+
+static void run(){
+	pollfd connection = { ConnectionNumber(display), POLLIN, 0 };
+
+	while(runProgram){
+		while(XPending(display)){
+			XEvent event;
+			XNextEvent(display, &event);
+
+			switch(event.type){
+				case KeyPress:
+				case KeyRelease:
+				{
+					uint8_t button = buttonOf(XLookupKeysym(&event.xkey, 0));
+					InputQueue* input = windowInput.load(memory_order_acquire);
+
+					if(button != 0 && input != nullptr){
+						if(event.type == KeyPress){
+							input->press(0, button);
+						} else {
+							input->release(0, button);
+						}
+					}
+					break;
+				}
+
+				// Keys released in another window never come back here
+				case FocusOut:
+				{
+					InputQueue* input = windowInput.load(memory_order_acquire);
+					if(input != nullptr)
+						input->set(0, 0);
+					break;
+				}
+
+				case Expose:
+					dirty = true;
+					break;
+
+				case ClientMessage:
+					if((Atom)event.xclient.data.l[0] == deleteWindow)
+						runProgram = false;
+					break;
+
+				default:
+					if(event.type == completionEvent){
+						presenting = false;
+						presented();
+					}
+					break;
+			}
+		}
+
+		// Frames finished while a put is still in flight are merged into the
+		// next one, like WM_PAINT merges invalidations
+		if(!presenting && dirty.exchange(false))
+			present();
+
+		poll(&connection, 1, 2);
+	}
+}
+
+uint32_t* openWindow(){
+	display = XOpenDisplay(nullptr);
+	if(display == nullptr){
+		cerr << "Cannot open X display" << endl;
+		return windowPixelColor;
+	}
+
+	int screenNumber = DefaultScreen(display);
+	visual = DefaultVisual(display, screenNumber);
+	depth = DefaultDepth(display, screenNumber);
+
+	window = XCreateSimpleWindow(display, RootWindow(display, screenNumber), 0, 0, windowWidth, windowHeight, 0,
+		BlackPixel(display, screenNumber), BlackPixel(display, screenNumber));
+	XStoreName(display, window, "Nes");
+	setWindowSize(windowWidth, windowHeight);
+
+	deleteWindow = XInternAtom(display, "WM_DELETE_WINDOW", False);
+	XSetWMProtocols(display, window, &deleteWindow, 1);
+
+	// Held keys would otherwise repeat as release and press pairs
+	XkbSetDetectableAutoRepeat(display, True, nullptr);
+
+	XSelectInput(display, window, ExposureMask | KeyPressMask | KeyReleaseMask | FocusChangeMask);
+	gc = XCreateGC(display, window, 0, nullptr);
+
+	bool native = nativeFormat(visual, depth);
+	shared = native && createSharedImage(visual, depth);
+
+	uint32_t* buffer = windowPixelColor;
+
+	if(shared){
+		buffer = (uint32_t*)image->data;
+		memset(buffer, 0, windowWidth * windowHeight * sizeof(uint32_t));
+	} else if(native){
+		image = XCreateImage(display, visual, depth, ZPixmap, 0, (char*)windowPixelColor, windowWidth, windowHeight, 32, windowWidth * 4);
+
+		// Xlib swaps the pixels for a server of the other byte order
+		image->byte_order = hostByteOrder();
+	} else {
+		image = XCreateImage(display, visual, depth, ZPixmap, 0, nullptr, windowWidth, windowHeight, 32, 0);
+		image->data = (char*)calloc(image->bytes_per_line, windowHeight);
+
+		channels[0] = channelOf(visual->red_mask);
+		channels[1] = channelOf(visual->green_mask);
+		channels[2] = channelOf(visual->blue_mask);
+		converted = true;
+	}
+
+	frame = buffer;
+
+	XMapWindow(display, window);
+	XFlush(display);
+
+	// Xlib is only used from the window thread from here on
+	thread(run).detach();
+
+	return buffer;
+}
+
+void updateScreen(){
+	dirty.store(true, memory_order_relaxed);
+}
+
+// The window thread resizes on the next present
+void setWindowUpscaler(Upscaler* upscaler){
+	windowUpscaler.store(upscaler, memory_order_release);
+	dirty.store(true, memory_order_relaxed);
+}